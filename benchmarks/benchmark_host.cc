@@ -0,0 +1,343 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// A fake Crosswalk host that loads one extension through XW_Initialize(),
+// replays a recorded mix of commands against it and reports the throughput
+// and latency percentiles of each command.
+//
+// Usage: extension_benchmark <libtizen_foo.so> <mix.json> [iterations]
+//
+// A mix file looks like:
+//
+//   {
+//     "iterations": 1000,
+//     "setup": [
+//       { "sync": false, "message": { "cmd": "FileOpenStream", ... },
+//         "save": { "fd": "fileDescriptor" } }
+//     ],
+//     "commands": [
+//       { "sync": true, "message": { "cmd": "FileStreamRead",
+//                                    "fileDescriptor": "$fd" } }
+//     ]
+//   }
+//
+// Setup messages run once. "save" stores members of their reply, and any
+// string value "$name" in later messages is replaced by the saved value.
+// Commands run |iterations| times each. Async commands are timed until the
+// extension posts a reply, unless "expectReply" is false.
+
+#include <dlfcn.h>
+#include <glib.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/XW_Extension.h"
+#include "common/XW_Extension_SyncMessage.h"
+#include "common/picojson.h"
+
+namespace {
+
+const XW_Extension kExtension = 1;
+const XW_Instance kInstance = 1;
+
+// How long to wait for the reply of an async command.
+const uint64_t kReplyTimeoutNs = 5000000000ULL;
+
+XW_CreatedInstanceCallback g_created = NULL;
+XW_DestroyedInstanceCallback g_destroyed = NULL;
+XW_ShutdownCallback g_shutdown = NULL;
+XW_HandleMessageCallback g_handle_message = NULL;
+XW_HandleSyncMessageCallback g_handle_sync_message = NULL;
+void* g_instance_data = NULL;
+
+pthread_mutex_t g_replies_mutex = PTHREAD_MUTEX_INITIALIZER;
+std::vector<std::string> g_replies;
+std::string g_sync_reply;
+
+uint64_t Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void SetExtensionName(XW_Extension, const char*) {}
+void SetJavaScriptAPI(XW_Extension, const char*) {}
+
+void RegisterInstanceCallbacks(XW_Extension,
+                               XW_CreatedInstanceCallback created,
+                               XW_DestroyedInstanceCallback destroyed) {
+  g_created = created;
+  g_destroyed = destroyed;
+}
+
+void RegisterShutdownCallback(XW_Extension, XW_ShutdownCallback shutdown) {
+  g_shutdown = shutdown;
+}
+
+void SetInstanceData(XW_Instance, void* data) {
+  g_instance_data = data;
+}
+
+void* GetInstanceData(XW_Instance) {
+  return g_instance_data;
+}
+
+void RegisterMessageCallback(XW_Extension,
+                             XW_HandleMessageCallback handle_message) {
+  g_handle_message = handle_message;
+}
+
+void PostMessage(XW_Instance, const char* message) {
+  pthread_mutex_lock(&g_replies_mutex);
+  g_replies.push_back(message);
+  pthread_mutex_unlock(&g_replies_mutex);
+}
+
+void RegisterBinaryMessageCallback(XW_Extension,
+                                   XW_HandleBinaryMessageCallback) {}
+
+void PostBinaryMessage(XW_Instance instance, const char* message,
+                       const size_t size) {
+  PostMessage(instance, std::string(message, size).c_str());
+}
+
+void RegisterSyncMessageCallback(XW_Extension,
+                                 XW_HandleSyncMessageCallback handle_message) {
+  g_handle_sync_message = handle_message;
+}
+
+void SetSyncReply(XW_Instance, const char* reply) {
+  g_sync_reply = reply;
+}
+
+const void* GetInterface(const char* name) {
+  static const XW_CoreInterface core = {
+    SetExtensionName, SetJavaScriptAPI, RegisterInstanceCallbacks,
+    RegisterShutdownCallback, SetInstanceData, GetInstanceData
+  };
+  static const XW_MessagingInterface messaging = {
+    RegisterMessageCallback, PostMessage
+  };
+  static const XW_MessagingInterface2 messaging2 = {
+    RegisterMessageCallback, PostMessage, RegisterBinaryMessageCallback,
+    PostBinaryMessage
+  };
+  static const XW_Internal_SyncMessagingInterface sync_messaging = {
+    RegisterSyncMessageCallback, SetSyncReply
+  };
+
+  if (!strcmp(name, XW_CORE_INTERFACE))
+    return &core;
+  if (!strcmp(name, XW_MESSAGING_INTERFACE))
+    return &messaging;
+  if (!strcmp(name, XW_MESSAGING_INTERFACE_2))
+    return &messaging2;
+  if (!strcmp(name, XW_INTERNAL_SYNC_MESSAGING_INTERFACE))
+    return &sync_messaging;
+  return NULL;
+}
+
+size_t PendingReplies() {
+  pthread_mutex_lock(&g_replies_mutex);
+  size_t size = g_replies.size();
+  pthread_mutex_unlock(&g_replies_mutex);
+  return size;
+}
+
+std::string TakeReply() {
+  pthread_mutex_lock(&g_replies_mutex);
+  std::string reply = g_replies.front();
+  g_replies.erase(g_replies.begin());
+  pthread_mutex_unlock(&g_replies_mutex);
+  return reply;
+}
+
+// Replaces "$name" strings by the values saved from setup replies.
+void Substitute(picojson::value& value,
+                const std::map<std::string, picojson::value>& saved) {
+  if (value.is<std::string>()) {
+    const std::string& s = value.get<std::string>();
+    if (s.size() > 1 && s[0] == '$') {
+      std::map<std::string, picojson::value>::const_iterator it =
+          saved.find(s.substr(1));
+      if (it != saved.end())
+        value = it->second;
+    }
+  } else if (value.is<picojson::array>()) {
+    picojson::array& a = value.get<picojson::array>();
+    for (picojson::array::iterator it = a.begin(); it != a.end(); ++it)
+      Substitute(*it, saved);
+  } else if (value.is<picojson::object>()) {
+    picojson::object& o = value.get<picojson::object>();
+    for (picojson::object::iterator it = o.begin(); it != o.end(); ++it)
+      Substitute(it->second, saved);
+  }
+}
+
+struct Command {
+  std::string name;
+  bool sync;
+  bool expect_reply;
+  std::string message;
+};
+
+// Sends |command| and returns its reply, or an empty string if there was
+// none. |latency| gets the time it took in nanoseconds.
+std::string Run(const Command& command, uint64_t* latency) {
+  uint64_t start = Now();
+  if (command.sync) {
+    g_sync_reply.clear();
+    g_handle_sync_message(kInstance, command.message.c_str());
+    *latency = Now() - start;
+    return g_sync_reply;
+  }
+
+  size_t pending = PendingReplies();
+  g_handle_message(kInstance, command.message.c_str());
+  if (command.expect_reply) {
+    // Replies may come from idle callbacks or worker threads.
+    while (PendingReplies() == pending && Now() - start < kReplyTimeoutNs)
+      g_main_context_iteration(NULL, FALSE);
+  }
+  *latency = Now() - start;
+
+  if (PendingReplies() == pending)
+    return std::string();
+  std::string reply;
+  while (PendingReplies())
+    reply = TakeReply();
+  return reply;
+}
+
+Command ParseCommand(const picojson::value& entry,
+                     const std::map<std::string, picojson::value>& saved) {
+  Command command;
+  picojson::value message = entry.get("message");
+  Substitute(message, saved);
+  command.name = message.get("cmd").to_str();
+  command.sync = entry.get("sync").evaluate_as_boolean();
+  command.expect_reply = !entry.contains("expectReply")
+      || entry.get("expectReply").evaluate_as_boolean();
+  command.message = message.serialize();
+  return command;
+}
+
+double Percentile(const std::vector<uint64_t>& sorted, double p) {
+  size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[index] / 1000.0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <extension.so> <mix.json> [iterations]\n",
+            argv[0]);
+    return 1;
+  }
+
+  std::ifstream mix_file(argv[2]);
+  if (!mix_file) {
+    fprintf(stderr, "Can't open %s.\n", argv[2]);
+    return 1;
+  }
+  picojson::value mix;
+  std::string err;
+  picojson::parse(mix, std::istreambuf_iterator<char>(mix_file),
+                  std::istreambuf_iterator<char>(), &err);
+  if (!err.empty()) {
+    fprintf(stderr, "Can't parse %s: %s\n", argv[2], err.c_str());
+    return 1;
+  }
+
+  int iterations = argc > 3 ? atoi(argv[3])
+      : static_cast<int>(mix.get("iterations").get<double>());
+  if (iterations <= 0)
+    iterations = 1000;
+
+  void* library = dlopen(argv[1], RTLD_NOW | RTLD_LOCAL);
+  if (!library) {
+    fprintf(stderr, "Can't load %s: %s\n", argv[1], dlerror());
+    return 1;
+  }
+  XW_Initialize_Func initialize = reinterpret_cast<XW_Initialize_Func>(
+      dlsym(library, "XW_Initialize"));
+  if (!initialize || initialize(kExtension, GetInterface) != XW_OK) {
+    fprintf(stderr, "Can't initialize %s.\n", argv[1]);
+    return 1;
+  }
+  if (!g_created || !g_handle_message || !g_handle_sync_message) {
+    fprintf(stderr, "%s didn't register its callbacks.\n", argv[1]);
+    return 1;
+  }
+  g_created(kInstance);
+
+  std::map<std::string, picojson::value> saved;
+  if (mix.get("setup").is<picojson::array>()) {
+    const picojson::array& setup = mix.get("setup").get<picojson::array>();
+    for (picojson::array::const_iterator it = setup.begin();
+         it != setup.end(); ++it) {
+      uint64_t latency;
+      std::string reply = Run(ParseCommand(*it, saved), &latency);
+      if (!it->get("save").is<picojson::object>())
+        continue;
+      picojson::value reply_value;
+      picojson::parse(reply_value, reply.begin(), reply.end(), &err);
+      const picojson::object& save = it->get("save").get<picojson::object>();
+      for (picojson::object::const_iterator s = save.begin();
+           s != save.end(); ++s)
+        saved[s->first] = reply_value.get(s->second.to_str());
+    }
+  }
+
+  std::vector<Command> commands;
+  if (mix.get("commands").is<picojson::array>()) {
+    const picojson::array& entries =
+        mix.get("commands").get<picojson::array>();
+    for (picojson::array::const_iterator it = entries.begin();
+         it != entries.end(); ++it)
+      commands.push_back(ParseCommand(*it, saved));
+  }
+
+  // Commands are interleaved, as they would be in a real page.
+  std::vector<std::vector<uint64_t> > latencies(commands.size());
+  for (int i = 0; i < iterations; ++i) {
+    for (size_t c = 0; c < commands.size(); ++c) {
+      uint64_t latency;
+      Run(commands[c], &latency);
+      latencies[c].push_back(latency);
+    }
+  }
+
+  printf("%-32s %10s %12s %10s %10s %10s\n", "command", "calls", "ops/s",
+         "p50 us", "p99 us", "max us");
+  for (size_t c = 0; c < commands.size(); ++c) {
+    std::vector<uint64_t>& sorted = latencies[c];
+    std::sort(sorted.begin(), sorted.end());
+    uint64_t total = 0;
+    for (size_t i = 0; i < sorted.size(); ++i)
+      total += sorted[i];
+    printf("%-32s %10zu %12.0f %10.1f %10.1f %10.1f\n",
+           commands[c].name.c_str(), sorted.size(),
+           total ? sorted.size() * 1e9 / total : 0.0,
+           Percentile(sorted, 0.5), Percentile(sorted, 0.99),
+           sorted.back() / 1000.0);
+  }
+
+  if (g_destroyed)
+    g_destroyed(kInstance);
+  if (g_shutdown)
+    g_shutdown(kExtension);
+  return 0;
+}
@@ -0,0 +1,27 @@
+{
+  'includes':[
+    '../common/common.gypi',
+  ],
+  'targets': [
+    {
+      'target_name': 'extension_benchmark',
+      'type': 'executable',
+      'variables': {
+        'packages': [
+          'glib-2.0',
+        ],
+      },
+      'includes': [
+        '../common/pkg-config.gypi',
+      ],
+      'sources': [
+        'benchmark_host.cc',
+      ],
+      'link_settings': {
+        'libraries': [
+          '-ldl',
+        ],
+      },
+    },
+  ],
+}
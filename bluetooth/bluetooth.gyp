@@ -20,6 +20,7 @@
         'bluetooth_api.js',
         'bluetooth_context.cc',
         'bluetooth_context.h',
+        '../common/outbound_queue.cc',
       ],
       'conditions': [
         [ 'bluetooth == "bluez5"', {
@@ -13,10 +13,28 @@ var postMessage = function(msg, callback) {
   extension.postMessage(JSON.stringify(msg));
 };
 
+// Socket data comes as a binary message (an ArrayBuffer), or base64 encoded
+// in the "binary" member of a JSON message when the runtime doesn't support
+// binary messages.
+var decodeBinaryMessage = function(encoded) {
+  var decoded = atob(encoded);
+  var bytes = new Uint8Array(decoded.length);
+  for (var i = 0; i < decoded.length; i++)
+    bytes[i] = decoded.charCodeAt(i);
+  return bytes.buffer;
+};
+
 extension.setMessageListener(function(json) {
+  if (json instanceof ArrayBuffer) {
+    handleSocketHasData(json);
+    return;
+  }
+
   var msg = JSON.parse(json);
 
-  if (msg.cmd == 'DeviceFound')
+  if (msg.binary !== undefined)
+    handleSocketHasData(decodeBinaryMessage(msg.binary));
+  else if (msg.cmd == 'DeviceFound')
     handleDeviceFound(msg);
   else if (msg.cmd == 'DiscoveryFinished')
     handleDiscoveryFinished();
@@ -28,8 +46,6 @@ extension.setMessageListener(function(json) {
     handleAdapterUpdated(msg);
   else if (msg.cmd == 'RFCOMMSocketAccept')
     handleRFCOMMSocketAccept(msg);
-  else if (msg.cmd == 'SocketHasData')
-    handleSocketHasData(msg);
   else if (msg.cmd == 'SocketClosed')
     handleSocketClosed(msg);
   else { // Then we are dealing with postMessage return.
@@ -233,11 +249,13 @@ var handleRFCOMMSocketAccept = function(msg) {
   }
 };
 
-var handleSocketHasData = function(msg) {
+// |buffer| holds the socket fd as a big endian 32 bit integer, then the data.
+var handleSocketHasData = function(buffer) {
+  var socket_fd = new DataView(buffer).getUint32(0);
   for (var i in adapter.sockets) {
     var socket = adapter.sockets[i];
-    if (socket.socket_fd === msg.socket_fd) {
-      socket.data = msg.data;
+    if (socket.socket_fd === socket_fd) {
+      socket.data = Array.prototype.slice.call(new Uint8Array(buffer, 4));
 
       if (socket.onmessage && typeof socket.onmessage === 'function')
         socket.onmessage();
@@ -20,11 +20,44 @@ int32_t XW_Initialize(XW_Extension extension, XW_GetInterface get_interface) {
                                                         get_interface);
 }
 
+common::CommandTable<BluetoothContext::Handler>
+    BluetoothContext::async_handlers_;
+common::CommandTable<BluetoothContext::Handler>
+    BluetoothContext::sync_handlers_;
+
 BluetoothContext::BluetoothContext(ContextAPI* api)
-    : api_(api) {
+    : api_(api),
+      outbound_queue_(api) {
+  if (async_handlers_.empty())
+    RegisterHandlers();
   PlatformInitialize();
 }
 
+// static
+void BluetoothContext::RegisterHandlers() {
+  async_handlers_.Register("DiscoverDevices",
+                           &BluetoothContext::HandleDiscoverDevices);
+  async_handlers_.Register("StopDiscovery",
+                           &BluetoothContext::HandleStopDiscovery);
+  async_handlers_.Register("SetAdapterProperty",
+                           &BluetoothContext::HandleSetAdapterProperty);
+  async_handlers_.Register("CreateBonding",
+                           &BluetoothContext::HandleCreateBonding);
+  async_handlers_.Register("DestroyBonding",
+                           &BluetoothContext::HandleDestroyBonding);
+  async_handlers_.Register("RFCOMMListen",
+                           &BluetoothContext::HandleRFCOMMListen);
+  async_handlers_.Register("CloseSocket",
+                           &BluetoothContext::HandleCloseSocket);
+  async_handlers_.Register("UnregisterServer",
+                           &BluetoothContext::HandleUnregisterServer);
+
+  sync_handlers_.Register("GetDefaultAdapter",
+                          &BluetoothContext::HandleGetDefaultAdapter);
+  sync_handlers_.Register("SocketWriteData",
+                          &BluetoothContext::HandleSocketWriteData);
+}
+
 const char BluetoothContext::name[] = "tizen.bluetooth";
 
 extern const char kSource_bluetooth_api[];
@@ -43,23 +76,9 @@ void BluetoothContext::HandleMessage(const char* message) {
     return;
   }
 
-  std::string cmd = v.get("cmd").to_str();
-  if (cmd == "DiscoverDevices")
-    HandleDiscoverDevices(v);
-  else if (cmd == "StopDiscovery")
-    HandleStopDiscovery(v);
-  else if (cmd == "SetAdapterProperty")
-    HandleSetAdapterProperty(v);
-  else if (cmd == "CreateBonding")
-    HandleCreateBonding(v);
-  else if (cmd == "DestroyBonding")
-    HandleDestroyBonding(v);
-  else if (cmd == "RFCOMMListen")
-    HandleRFCOMMListen(v);
-  else if (cmd == "CloseSocket")
-    HandleCloseSocket(v);
-  else if (cmd == "UnregisterServer")
-    HandleUnregisterServer(v);
+  Handler handler;
+  if (async_handlers_.Lookup(v.get("cmd").to_str(), &handler))
+    (this->*handler)(v);
 }
 
 void BluetoothContext::HandleSyncMessage(const char* message) {
@@ -72,11 +91,9 @@ void BluetoothContext::HandleSyncMessage(const char* message) {
     return;
   }
 
-  std::string cmd = v.get("cmd").to_str();
-  if (cmd == "GetDefaultAdapter")
-    HandleGetDefaultAdapter(v);
-  else if (cmd == "SocketWriteData")
-    HandleSocketWriteData(v);
+  Handler handler;
+  if (sync_handlers_.Lookup(v.get("cmd").to_str(), &handler))
+    (this->*handler)(v);
 }
 
 void BluetoothContext::HandleDiscoverDevices(const picojson::value& msg) {
@@ -148,7 +165,8 @@ void BluetoothContext::FlushPendingMessages() {
   if (!queue_.empty()) {
     MessageQueue::iterator it;
     for (it = queue_.begin(); it != queue_.end(); ++it)
-      api_->PostMessage((*it).serialize().c_str());
+      outbound_queue_.Post((*it).serialize());
+    queue_.clear();
   }
 }
 
@@ -186,11 +204,11 @@ void BluetoothContext::PostMessage(picojson::value v) {
   }
 
   FlushPendingMessages();
-  api_->PostMessage(v.serialize().c_str());
+  outbound_queue_.Post(v.serialize());
 }
 
 void BluetoothContext::SetSyncReply(picojson::value v) {
-  api_->SetSyncReply(v.serialize().c_str());
+  api_->SetSyncReply(v);
 
   FlushPendingMessages();
 }
@@ -10,7 +10,9 @@
 #include <string>
 #include <vector>
 
+#include "common/command_table.h"
 #include "common/extension_adapter.h"
+#include "common/outbound_queue.h"
 #include "common/picojson.h"
 
 #define G_CALLBACK_1(METHOD, SENDER, ARG0)                                     \
@@ -93,6 +95,12 @@ class BluetoothContext {
   void HandleSyncMessage(const char* message);
 
  private:
+  typedef void (BluetoothContext::*Handler)(const picojson::value& msg);
+
+  static void RegisterHandlers();
+  static common::CommandTable<Handler> async_handlers_;
+  static common::CommandTable<Handler> sync_handlers_;
+
   void PlatformInitialize();
 
   G_CALLBACK_CANCELLABLE_1(OnAdapterProxyCreated, GObject*, GAsyncResult*);
@@ -118,6 +126,7 @@ class BluetoothContext {
   void AdapterInfoToValue(picojson::value::object& o);
 
   ContextAPI* api_;
+  common::OutboundQueue outbound_queue_;
   std::string discover_callback_id_;
   std::string stop_discovery_callback_id_;
   std::map<std::string, std::string> adapter_info_;
@@ -8,6 +8,8 @@
 #include <bluetooth.h>
 #endif
 
+#include <arpa/inet.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -605,6 +607,7 @@ void BluetoothContext::OnFoundDevice(GObject*, GAsyncResult* res) {
 }
 
 BluetoothContext::~BluetoothContext() {
+  outbound_queue_.Clear();
   delete api_;
 
   g_cancellable_cancel(all_pending_);
@@ -773,18 +776,22 @@ gboolean BluetoothContext::OnSocketHasData(GSocket* client, GIOCondition cond,
     return false;
   }
 
-  gchar buf[512];
+  // The data goes as a binary message, after the socket fd in network byte
+  // order, so that it doesn't have to be valid UTF-8.
+  gchar buf[4 + 512];
   gssize len;
 
-  len = g_socket_receive(client, buf, sizeof(buf), NULL, NULL);
+  len = g_socket_receive(client, buf + 4, sizeof(buf) - 4, NULL, NULL);
   if (len < 0)
     return false;
 
-  o["cmd"] = picojson::value("SocketHasData");
-  o["socket_fd"] = picojson::value(static_cast<double>(fd));
-  o["data"] = picojson::value(buf, len);
+  uint32_t socket_fd = htonl(static_cast<uint32_t>(fd));
+  memcpy(buf, &socket_fd, 4);
 
-  handler->PostMessage(picojson::value(o));
+  // Messages still queued, like the RFCOMMSocketAccept of this socket, go
+  // first.
+  handler->outbound_queue_.Flush();
+  handler->api_->PostBinaryMessage(buf, 4 + len);
 
   return true;
 }
@@ -154,6 +154,7 @@ void BluetoothContext::OnManagerCreated(GObject*, GAsyncResult* res) {
 }
 
 BluetoothContext::~BluetoothContext() {
+  outbound_queue_.Clear();
   delete api_;
 
   if (adapter_proxy_)
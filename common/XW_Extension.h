@@ -33,6 +33,7 @@ extern "C" {
 #define XW_EXPORT __declspec(dllexport)
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 
@@ -178,6 +179,40 @@ struct XW_MessagingInterface_1 {
 
 typedef struct XW_MessagingInterface_1 XW_MessagingInterface;
 
+// Version 2 of the messaging interface adds length-delimited binary messages
+// on top of the string ones. Binary payloads are not required to be valid
+// UTF-8 nor NUL-terminated, so no escaping or strlen() is needed to move them
+// across. Hosts that don't provide this version can still be used through
+// XW_MESSAGING_INTERFACE_1.
+#define XW_MESSAGING_INTERFACE_2 "XW_MessagingInterface_2"
+
+typedef void (*XW_HandleBinaryMessageCallback)(XW_Instance instance,
+                                               const char* message,
+                                               const size_t size);
+
+struct XW_MessagingInterface_2 {
+  // Same as in XW_MessagingInterface_1.
+  void (*Register)(XW_Extension extension,
+                   XW_HandleMessageCallback handle_message);
+  void (*PostMessage)(XW_Instance instance, const char* message);
+
+  // Register a callback to be called when the JavaScript code associated
+  // with the extension posts a binary message (an ArrayBuffer).
+  void (*RegisterBinaryMessageCallback)(
+      XW_Extension extension,
+      XW_HandleBinaryMessageCallback handle_binary_message);
+
+  // Post a binary message of |size| bytes to the web content associated with
+  // the instance. The JavaScript listener will receive an ArrayBuffer.
+  //
+  // This function is thread-safe and can be called until the instance is
+  // destroyed.
+  void (*PostBinaryMessage)(XW_Instance instance, const char* message,
+                            const size_t size);
+};
+
+typedef struct XW_MessagingInterface_2 XW_MessagingInterface2;
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -0,0 +1,475 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "common/base64.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// The x86 kernels are built with per-function target attributes, so the rest
+// of the code doesn't need -mssse3 or -mavx2 and still runs on older CPUs.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define BASE64_X86_KERNELS
+#include <immintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define BASE64_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace common {
+namespace base64 {
+
+namespace {
+
+const char kEncodeTable[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Maps each character to its 6-bit value, or to 0xff if it isn't part of the
+// alphabet. Padding is handled separately.
+const uint8_t kDecodeTable[256] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff,   62, 0xff, 0xff, 0xff,   63,
+    52,   53,   54,   55,   56,   57,   58,   59,
+    60,   61, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff,    0,    1,    2,    3,    4,    5,    6,
+     7,    8,    9,   10,   11,   12,   13,   14,
+    15,   16,   17,   18,   19,   20,   21,   22,
+    23,   24,   25, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff,   26,   27,   28,   29,   30,   31,   32,
+    33,   34,   35,   36,   37,   38,   39,   40,
+    41,   42,   43,   44,   45,   46,   47,   48,
+    49,   50,   51, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+// A kernel encodes as many whole blocks from the start of |src| as it can and
+// returns the number of bytes consumed, always a multiple of 3. |dst| must
+// have room for the encoding of all of |src|.
+typedef size_t (*EncodeKernel)(const uint8_t* src, size_t size, char* dst);
+
+// A kernel decodes as many whole blocks from the start of |src| as it can and
+// returns the number of characters consumed, always a multiple of 4. |src|
+// must not contain padding. Kernels stop before the first block with invalid
+// characters and leave it to the scalar code to reject.
+typedef size_t (*DecodeKernel)(const char* src, size_t size, uint8_t* dst);
+
+void EncodeScalar(const uint8_t* src, size_t size, char* dst) {
+  size_t i = 0;
+  for (; i + 3 <= size; i += 3) {
+    uint32_t triple = src[i] << 16 | src[i + 1] << 8 | src[i + 2];
+    dst[0] = kEncodeTable[triple >> 18];
+    dst[1] = kEncodeTable[(triple >> 12) & 0x3f];
+    dst[2] = kEncodeTable[(triple >> 6) & 0x3f];
+    dst[3] = kEncodeTable[triple & 0x3f];
+    dst += 4;
+  }
+
+  size_t left = size - i;
+  if (!left)
+    return;
+  uint32_t triple = src[i] << 16;
+  if (left == 2)
+    triple |= src[i + 1] << 8;
+  dst[0] = kEncodeTable[triple >> 18];
+  dst[1] = kEncodeTable[(triple >> 12) & 0x3f];
+  dst[2] = left == 2 ? kEncodeTable[(triple >> 6) & 0x3f] : '=';
+  dst[3] = '=';
+}
+
+// Decodes |size| characters, a multiple of 4 without padding.
+bool DecodeScalar(const char* src, size_t size, uint8_t* dst) {
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+  for (size_t i = 0; i < size; i += 4) {
+    uint8_t a = kDecodeTable[in[i]];
+    uint8_t b = kDecodeTable[in[i + 1]];
+    uint8_t c = kDecodeTable[in[i + 2]];
+    uint8_t d = kDecodeTable[in[i + 3]];
+    if ((a | b | c | d) & 0x80)
+      return false;
+    dst[0] = a << 2 | b >> 4;
+    dst[1] = b << 4 | c >> 2;
+    dst[2] = c << 6 | d;
+    dst += 3;
+  }
+  return true;
+}
+
+// Decodes the last four characters, with |padding| of them being '='.
+bool DecodeLast(const char* src, size_t padding, uint8_t* dst) {
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+  uint8_t a = kDecodeTable[in[0]];
+  uint8_t b = kDecodeTable[in[1]];
+  uint8_t c = padding < 2 ? kDecodeTable[in[2]] : 0;
+  uint8_t d = padding < 1 ? kDecodeTable[in[3]] : 0;
+  if ((a | b | c | d) & 0x80)
+    return false;
+  dst[0] = a << 2 | b >> 4;
+  if (padding < 2)
+    dst[1] = b << 4 | c >> 2;
+  if (padding < 1)
+    dst[2] = c << 6 | d;
+  return true;
+}
+
+#if defined(BASE64_X86_KERNELS)
+
+// The x86 kernels work on 12 byte groups per 128 bits: the bytes are spread
+// so each 32-bit lane holds one group of three, the four 6-bit indices are
+// pulled apart with two multiplications and then mapped to ASCII by adding an
+// offset looked up with a byte shuffle. Decoding runs the same steps in
+// reverse, rejecting anything outside of the alphabet with a pair of nibble
+// lookups.
+
+__attribute__((target("ssse3")))
+inline __m128i EncodeIndicesSSSE3(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                         4, 5, 3, 4, 1, 2, 0, 1));
+  __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+inline __m128i EncodeLookupSSSE3(__m128i indices) {
+  // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12.
+  __m128i offset = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  offset = _mm_or_si128(offset, _mm_and_si128(upper, _mm_set1_epi8(13)));
+  const __m128i shift = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+      '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(indices, _mm_shuffle_epi8(shift, offset));
+}
+
+__attribute__((target("ssse3")))
+size_t EncodeSSSE3(const uint8_t* src, size_t size, char* dst) {
+  size_t i = 0;
+  // Each step reads 16 bytes but only consumes 12.
+  for (; i + 16 <= size; i += 12) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i out = EncodeLookupSSSE3(EncodeIndicesSSSE3(in));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), out);
+    dst += 16;
+  }
+  return i;
+}
+
+// Returns the 6-bit values of |in|, or sets |valid| to false.
+__attribute__((target("ssse3")))
+inline __m128i DecodeLookupSSSE3(__m128i in, bool* valid) {
+  const __m128i lut_lo = _mm_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+  const __m128i lut_hi = _mm_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2f);
+
+  __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+  __m128i lo_nibbles = _mm_and_si128(in, mask_2f);
+  __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+  __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+  __m128i bad = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+  *valid = _mm_movemask_epi8(bad) == 0xffff;
+
+  __m128i slash = _mm_cmpeq_epi8(in, mask_2f);
+  __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(slash, hi_nibbles));
+  return _mm_add_epi8(in, roll);
+}
+
+// Packs the 6-bit values of each 32-bit lane into 3 bytes, in the low 12
+// bytes of the result.
+__attribute__((target("ssse3")))
+inline __m128i DecodePackSSSE3(__m128i values) {
+  __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  __m128i out = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+                                             8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+size_t DecodeSSSE3(const char* src, size_t size, uint8_t* dst) {
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    bool valid;
+    __m128i values = DecodeLookupSSSE3(in, &valid);
+    if (!valid)
+      break;
+    __m128i out = DecodePackSSSE3(values);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), out);
+    uint32_t last = _mm_cvtsi128_si32(_mm_srli_si128(out, 8));
+    memcpy(dst + 8, &last, 4);
+    dst += 12;
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+inline __m256i Broadcast(__m128i value) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(value), value, 1);
+}
+
+__attribute__((target("avx2")))
+size_t EncodeAVX2(const uint8_t* src, size_t size, char* dst) {
+  const __m256i spread = Broadcast(_mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                                4, 5, 3, 4, 1, 2, 0, 1));
+  const __m256i shift = Broadcast(_mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+      '/' - 63, 'A', 0, 0));
+
+  size_t i = 0;
+  // Each step reads 12 bytes into each 128-bit lane, the second load ends 4
+  // bytes past what is consumed.
+  for (; i + 28 <= size; i += 24) {
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i hi =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12));
+    __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+    in = _mm256_shuffle_epi8(in, spread);
+    __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i offset = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    offset = _mm256_or_si256(
+        offset, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+    __m256i out =
+        _mm256_add_epi8(indices, _mm256_shuffle_epi8(shift, offset));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), out);
+    dst += 32;
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+size_t DecodeAVX2(const char* src, size_t size, uint8_t* dst) {
+  const __m256i lut_lo = Broadcast(_mm_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a));
+  const __m256i lut_hi = Broadcast(_mm_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+  const __m256i lut_roll = Broadcast(_mm_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+  const __m256i pack = Broadcast(_mm_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+
+    __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+    __m256i lo_nibbles = _mm256_and_si256(in, mask_2f);
+    __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    if (!_mm256_testz_si256(lo, hi))
+      break;
+    __m256i slash = _mm256_cmpeq_epi8(in, mask_2f);
+    __m256i roll =
+        _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(slash, hi_nibbles));
+    __m256i values = _mm256_add_epi8(in, roll);
+
+    __m256i merged =
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i out = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+    out = _mm256_shuffle_epi8(out, pack);
+    // Move the 12 bytes of the upper lane next to those of the lower one.
+    out = _mm256_permutevar8x32_epi32(
+        out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                     _mm256_castsi256_si128(out));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 16),
+                     _mm256_extracti128_si256(out, 1));
+    dst += 24;
+  }
+  return i;
+}
+
+#elif defined(BASE64_NEON_KERNELS)
+
+// The NEON kernels use the structured loads and stores to split the input in
+// one register per byte (or character) position of a group, so the 6-bit
+// values can be computed with plain shifts, and map them with compares and
+// selects.
+
+inline uint8x16_t EncodeLookupNEON(uint8x16_t indices) {
+  // 'A' + index, then correct for the ranges past 'Z'.
+  uint8x16_t out = vaddq_u8(indices, vdupq_n_u8('A'));
+  out = vaddq_u8(out, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(26)),
+                               vdupq_n_u8('a' - 26 - 'A')));
+  out = vaddq_u8(out, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(52)),
+                               vdupq_n_u8('0' - 52 - ('a' - 26))));
+  out = vaddq_u8(out, vandq_u8(vceqq_u8(indices, vdupq_n_u8(62)),
+                               vdupq_n_u8('+' - 62 - ('0' - 52))));
+  out = vaddq_u8(out, vandq_u8(vceqq_u8(indices, vdupq_n_u8(63)),
+                               vdupq_n_u8('/' - 63 - ('0' - 52))));
+  return out;
+}
+
+size_t EncodeNEON(const uint8_t* src, size_t size, char* dst) {
+  const uint8x16_t mask = vdupq_n_u8(0x3f);
+  size_t i = 0;
+  for (; i + 48 <= size; i += 48) {
+    uint8x16x3_t in = vld3q_u8(src + i);
+    uint8x16x4_t out;
+    out.val[0] = vshrq_n_u8(in.val[0], 2);
+    out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4),
+                                   vshrq_n_u8(in.val[1], 4)), mask);
+    out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2),
+                                   vshrq_n_u8(in.val[2], 6)), mask);
+    out.val[3] = vandq_u8(in.val[2], mask);
+    for (int j = 0; j < 4; ++j)
+      out.val[j] = EncodeLookupNEON(out.val[j]);
+    vst4q_u8(reinterpret_cast<uint8_t*>(dst), out);
+    dst += 64;
+  }
+  return i;
+}
+
+// Returns the 6-bit values of |in|, 0xff for characters outside of the
+// alphabet.
+inline uint8x16_t DecodeLookupNEON(uint8x16_t in) {
+  uint8x16_t out = vdupq_n_u8(0xff);
+  uint8x16_t upper = vsubq_u8(in, vdupq_n_u8('A'));
+  out = vbslq_u8(vcltq_u8(upper, vdupq_n_u8(26)), upper, out);
+  uint8x16_t lower = vsubq_u8(in, vdupq_n_u8('a'));
+  out = vbslq_u8(vcltq_u8(lower, vdupq_n_u8(26)),
+                 vaddq_u8(lower, vdupq_n_u8(26)), out);
+  uint8x16_t digit = vsubq_u8(in, vdupq_n_u8('0'));
+  out = vbslq_u8(vcltq_u8(digit, vdupq_n_u8(10)),
+                 vaddq_u8(digit, vdupq_n_u8(52)), out);
+  out = vbslq_u8(vceqq_u8(in, vdupq_n_u8('+')), vdupq_n_u8(62), out);
+  out = vbslq_u8(vceqq_u8(in, vdupq_n_u8('/')), vdupq_n_u8(63), out);
+  return out;
+}
+
+size_t DecodeNEON(const char* src, size_t size, uint8_t* dst) {
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    uint8x16x4_t in = vld4q_u8(reinterpret_cast<const uint8_t*>(src + i));
+    uint8x16_t bad = vdupq_n_u8(0);
+    for (int j = 0; j < 4; ++j) {
+      in.val[j] = DecodeLookupNEON(in.val[j]);
+      bad = vorrq_u8(bad, in.val[j]);
+    }
+    uint64x2_t high = vreinterpretq_u64_u8(vshrq_n_u8(bad, 6));
+    if (vgetq_lane_u64(high, 0) | vgetq_lane_u64(high, 1))
+      break;
+
+    uint8x16x3_t out;
+    out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+    out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+    out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+    vst3q_u8(dst, out);
+    dst += 48;
+  }
+  return i;
+}
+
+#endif
+
+struct Kernels {
+  EncodeKernel encode;
+  DecodeKernel decode;
+};
+
+Kernels SelectKernels() {
+  Kernels kernels = { NULL, NULL };
+#if defined(BASE64_X86_KERNELS)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.encode = EncodeAVX2;
+    kernels.decode = DecodeAVX2;
+  } else if (__builtin_cpu_supports("ssse3")) {
+    kernels.encode = EncodeSSSE3;
+    kernels.decode = DecodeSSSE3;
+  }
+#elif defined(BASE64_NEON_KERNELS)
+  kernels.encode = EncodeNEON;
+  kernels.decode = DecodeNEON;
+#endif
+  return kernels;
+}
+
+const Kernels& GetKernels() {
+  static const Kernels kernels = SelectKernels();
+  return kernels;
+}
+
+}  // namespace
+
+void Encode(const char* data, size_t size, std::string* out) {
+  out->resize(EncodedSize(size));
+  if (!size)
+    return;
+
+  const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+  char* dst = &(*out)[0];
+  size_t done = 0;
+  EncodeKernel kernel = GetKernels().encode;
+  if (kernel)
+    done = kernel(src, size, dst);
+  EncodeScalar(src + done, size - done, dst + done / 3 * 4);
+}
+
+bool Decode(const char* data, size_t size, std::string* out) {
+  out->clear();
+  if (size % 4)
+    return false;
+  if (!size)
+    return true;
+
+  size_t padding = 0;
+  if (data[size - 1] == '=')
+    padding = data[size - 2] == '=' ? 2 : 1;
+  out->resize(size / 4 * 3 - padding);
+
+  // Everything but the last group can go through the kernels, padding is
+  // only allowed at the very end.
+  uint8_t* dst = reinterpret_cast<uint8_t*>(&(*out)[0]);
+  size_t body = size - 4;
+  size_t done = 0;
+  DecodeKernel kernel = GetKernels().decode;
+  if (kernel)
+    done = kernel(data, body, dst);
+  if (!DecodeScalar(data + done, body - done, dst + done / 4 * 3))
+    return false;
+  return DecodeLast(data + body, padding, dst + body / 4 * 3);
+}
+
+}  // namespace base64
+}  // namespace common
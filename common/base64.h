@@ -0,0 +1,47 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef COMMON_BASE64_H_
+#define COMMON_BASE64_H_
+
+#include <stddef.h>
+
+#include <string>
+
+namespace common {
+namespace base64 {
+
+// Standard base64 (RFC 4648, '+' and '/', padded with '='). Long inputs are
+// handled by SSSE3 or AVX2 kernels when the CPU supports them, picked once at
+// runtime, or by NEON when the build targets it. Everything else goes through
+// a table driven scalar loop. The output is sized once, up front.
+
+// Returns the length of the encoding of |size| bytes.
+inline size_t EncodedSize(size_t size) {
+  return (size + 2) / 3 * 4;
+}
+
+// Replaces the contents of |out| with the encoding of |data|.
+void Encode(const char* data, size_t size, std::string* out);
+
+inline std::string Encode(const std::string& data) {
+  std::string out;
+  Encode(data.data(), data.size(), &out);
+  return out;
+}
+
+// Replaces the contents of |out| with the bytes encoded in |data|. Returns
+// false, leaving |out| in an unspecified state, if |data| isn't a multiple of
+// four characters, has characters outside of the alphabet or misplaced
+// padding.
+bool Decode(const char* data, size_t size, std::string* out);
+
+inline bool Decode(const std::string& data, std::string* out) {
+  return Decode(data.data(), data.size(), out);
+}
+
+}  // namespace base64
+}  // namespace common
+
+#endif  // COMMON_BASE64_H_
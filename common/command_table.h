@@ -0,0 +1,158 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef COMMON_COMMAND_TABLE_H_
+#define COMMON_COMMAND_TABLE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace common {
+
+// Maps command names to handlers (usually pointers to member functions) so
+// that messages can be dispatched with a single hash lookup instead of a
+// chain of string comparisons. Each extension fills its tables once and
+// shares them between all of its instances.
+//
+// Names are not copied, so they must be string literals or otherwise outlive
+// the table. Every successful Lookup() is counted per command. Lookups may
+// come from several threads at once, but registration must be done first.
+template <typename Handler>
+class CommandTable {
+ public:
+  typedef std::vector<std::pair<const char*, uint64_t> > CallCounts;
+
+  CommandTable() : size_(0) {}
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  void Register(const char* name, Handler handler) {
+    if ((size_ + 1) * 2 > slots_.size())
+      Grow();
+    if (Insert(name, strlen(name), handler))
+      size_++;
+  }
+
+  // Returns true and sets |handler| if |name| was registered.
+  bool Lookup(const char* name, size_t length, Handler* handler) {
+    Slot* slot = Find(name, length);
+    if (!slot)
+      return false;
+    slot->calls.fetch_add(1, std::memory_order_relaxed);
+    *handler = slot->handler;
+    return true;
+  }
+
+  bool Lookup(const std::string& name, Handler* handler) {
+    return Lookup(name.data(), name.size(), handler);
+  }
+
+  uint64_t CallCount(const char* name) const {
+    const Slot* slot = const_cast<CommandTable*>(this)->Find(name,
+                                                             strlen(name));
+    return slot ? slot->calls.load() : 0;
+  }
+
+  CallCounts GetCallCounts() const {
+    CallCounts counts;
+    for (typename Slots::const_iterator it = slots_.begin();
+         it != slots_.end(); ++it) {
+      if (it->name)
+        counts.push_back(std::make_pair(it->name, it->calls.load()));
+    }
+    return counts;
+  }
+
+ private:
+  struct Slot {
+    Slot() : name(NULL), length(0), hash(0), handler(), calls(0) {}
+    // Only copied while growing, before the table is shared.
+    Slot(const Slot& other)
+        : name(other.name), length(other.length), hash(other.hash),
+          handler(other.handler), calls(other.calls.load()) {}
+    Slot& operator=(const Slot& other) {
+      name = other.name;
+      length = other.length;
+      hash = other.hash;
+      handler = other.handler;
+      calls.store(other.calls.load());
+      return *this;
+    }
+    const char* name;
+    size_t length;
+    uint32_t hash;
+    Handler handler;
+    std::atomic<uint64_t> calls;
+  };
+  typedef std::vector<Slot> Slots;
+
+  // FNV-1a, good enough for short ASCII command names.
+  static uint32_t Hash(const char* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+      hash ^= static_cast<unsigned char>(name[i]);
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+
+  // The table is kept at most half full, so probing stays short and the cost
+  // of a lookup doesn't depend on how many commands are registered.
+  Slot* Find(const char* name, size_t length) {
+    if (slots_.empty())
+      return NULL;
+    uint32_t hash = Hash(name, length);
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask; slots_[i].name; i = (i + 1) & mask) {
+      Slot& slot = slots_[i];
+      if (slot.hash == hash && slot.length == length
+          && !memcmp(slot.name, name, length))
+        return &slot;
+    }
+    return NULL;
+  }
+
+  bool Insert(const char* name, size_t length, Handler handler) {
+    Slot* existing = Find(name, length);
+    if (existing) {
+      existing->handler = handler;
+      return false;
+    }
+    uint32_t hash = Hash(name, length);
+    size_t mask = slots_.size() - 1;
+    size_t i = hash & mask;
+    while (slots_[i].name)
+      i = (i + 1) & mask;
+    slots_[i].name = name;
+    slots_[i].length = length;
+    slots_[i].hash = hash;
+    slots_[i].handler = handler;
+    return true;
+  }
+
+  void Grow() {
+    Slots old;
+    old.swap(slots_);
+    slots_.resize(old.empty() ? 16 : old.size() * 2);
+    for (typename Slots::iterator it = old.begin(); it != old.end(); ++it) {
+      if (!it->name)
+        continue;
+      Insert(it->name, it->length, it->handler);
+      Find(it->name, it->length)->calls.store(it->calls.load());
+    }
+  }
+
+  Slots slots_;
+  size_t size_;
+};
+
+}  // namespace common
+
+#endif  // COMMON_COMMAND_TABLE_H_
@@ -5,15 +5,25 @@
 #include "common/extension.h"
 
 #include <assert.h>
+#include <string.h>
+
 #include <iostream>
+#include <string>
+
+#include "common/base64.h"
+#include "common/message_batch.h"
+#include "common/perf_counters.h"
+#include "common/picojson.h"
 
 namespace {
 
 common::Extension* g_extension = NULL;
 XW_Extension g_xw_extension = 0;
+std::string g_javascript_api;
 
 const XW_CoreInterface* g_core = NULL;
 const XW_MessagingInterface* g_messaging = NULL;
+const XW_MessagingInterface2* g_messaging2 = NULL;
 const XW_Internal_SyncMessagingInterface* g_sync_messaging = NULL;
 
 bool InitializeInterfaces(XW_GetInterface get_interface) {
@@ -24,9 +34,14 @@ bool InitializeInterfaces(XW_GetInterface get_interface) {
     return false;
   }
 
+  // The binary capable interface is optional, PostBinaryMessage() falls back
+  // to string messages when it's not available.
+  g_messaging2 = reinterpret_cast<const XW_MessagingInterface2*>(
+      get_interface(XW_MESSAGING_INTERFACE_2));
+
   g_messaging = reinterpret_cast<const XW_MessagingInterface*>(
       get_interface(XW_MESSAGING_INTERFACE));
-  if (!g_messaging) {
+  if (!g_messaging && !g_messaging2) {
     std::cerr <<
         "Can't initialize extension: error getting Messaging interface.\n";
     return false;
@@ -44,6 +59,14 @@ bool InitializeInterfaces(XW_GetInterface get_interface) {
   return true;
 }
 
+void PostBatchReply(XW_Instance xw_instance, const char* msg) {
+  common::perf::RecordPost(xw_instance, strlen(msg));
+  if (g_messaging2)
+    g_messaging2->PostMessage(xw_instance, msg);
+  else
+    g_messaging->PostMessage(xw_instance, msg);
+}
+
 }  // namespace
 
 int32_t XW_Initialize(XW_Extension extension, XW_GetInterface get_interface) {
@@ -65,7 +88,13 @@ int32_t XW_Initialize(XW_Extension extension, XW_GetInterface get_interface) {
   g_core->RegisterInstanceCallbacks(
       g_xw_extension, Extension::OnInstanceCreated,
       Extension::OnInstanceDestroyed);
-  g_messaging->Register(g_xw_extension, Extension::HandleMessage);
+  if (g_messaging2) {
+    g_messaging2->Register(g_xw_extension, Extension::HandleMessage);
+    g_messaging2->RegisterBinaryMessageCallback(
+        g_xw_extension, Extension::HandleBinaryMessage);
+  } else {
+    g_messaging->Register(g_xw_extension, Extension::HandleMessage);
+  }
   g_sync_messaging->Register(g_xw_extension, Extension::HandleSyncMessage);
   return XW_OK;
 }
@@ -78,10 +107,16 @@ Extension::~Extension() {}
 
 void Extension::SetExtensionName(const char* name) {
   g_core->SetExtensionName(g_xw_extension, name);
+  perf::SetExtensionName(name);
 }
 
-void Extension::SetJavaScriptAPI(const char* api) {
-  g_core->SetJavaScriptAPI(g_xw_extension, api);
+void Extension::SetJavaScriptAPI(const char* api, bool batch_messages) {
+  if (!batch_messages) {
+    g_core->SetJavaScriptAPI(g_xw_extension, api);
+    return;
+  }
+  g_javascript_api = WrapJavaScriptAPI(api);
+  g_core->SetJavaScriptAPI(g_xw_extension, g_javascript_api.c_str());
 }
 
 Instance* Extension::CreateInstance() {
@@ -90,6 +125,7 @@ Instance* Extension::CreateInstance() {
 
 // static
 void Extension::OnShutdown(XW_Extension) {
+  perf::DumpTrace();
   delete g_extension;
   g_extension = NULL;
 }
@@ -107,6 +143,7 @@ void Extension::OnInstanceCreated(XW_Instance xw_instance) {
 
 // static
 void Extension::OnInstanceDestroyed(XW_Instance xw_instance) {
+  perf::RecordInstanceDestroyed(xw_instance);
   Instance* instance =
       reinterpret_cast<Instance*>(g_core->GetInstanceData(xw_instance));
   if (!instance)
@@ -117,6 +154,13 @@ void Extension::OnInstanceDestroyed(XW_Instance xw_instance) {
 
 // static
 void Extension::HandleMessage(XW_Instance xw_instance, const char* msg) {
+  size_t size = strlen(msg);
+  perf::ScopedMessage perf(msg, size, false);
+  if (IsBatchMessage(msg)) {
+    DispatchBatch(xw_instance, msg, size, Extension::HandleMessage,
+                  PostBatchReply);
+    return;
+  }
   Instance* instance =
       reinterpret_cast<Instance*>(g_core->GetInstanceData(xw_instance));
   if (!instance)
@@ -126,6 +170,11 @@ void Extension::HandleMessage(XW_Instance xw_instance, const char* msg) {
 
 // static
 void Extension::HandleSyncMessage(XW_Instance xw_instance, const char* msg) {
+  if (perf::IsPerfMessage(msg)) {
+    g_sync_messaging->SetSyncReply(xw_instance, perf::GetReport().c_str());
+    return;
+  }
+  perf::ScopedMessage perf(msg, strlen(msg), true);
   Instance* instance =
       reinterpret_cast<Instance*>(g_core->GetInstanceData(xw_instance));
   if (!instance)
@@ -133,6 +182,17 @@ void Extension::HandleSyncMessage(XW_Instance xw_instance, const char* msg) {
   instance->HandleSyncMessage(msg);
 }
 
+// static
+void Extension::HandleBinaryMessage(XW_Instance xw_instance, const char* msg,
+                                    const size_t size) {
+  perf::ScopedMessage perf(msg, size, false);
+  Instance* instance =
+      reinterpret_cast<Instance*>(g_core->GetInstanceData(xw_instance));
+  if (!instance)
+    return;
+  instance->HandleBinaryMessage(msg, size);
+}
+
 Instance::Instance()
     : xw_instance_(0) {}
 
@@ -146,7 +206,48 @@ void Instance::PostMessage(const char* msg) {
               << "instance was destroyed.";
     return;
   }
-  g_messaging->PostMessage(xw_instance_, msg);
+  if (CaptureBatchReply(xw_instance_, msg))
+    return;
+  perf::RecordPost(xw_instance_, strlen(msg));
+  if (g_messaging2)
+    g_messaging2->PostMessage(xw_instance_, msg);
+  else
+    g_messaging->PostMessage(xw_instance_, msg);
+}
+
+void Instance::PostBinaryMessage(const void* msg, size_t size) {
+  if (!xw_instance_) {
+    std::cerr << "Ignoring PostBinaryMessage() in the constructor or after "
+              << "the instance was destroyed.";
+    return;
+  }
+  if (g_messaging2) {
+    perf::RecordPost(xw_instance_, size);
+    g_messaging2->PostBinaryMessage(
+        xw_instance_, static_cast<const char*>(msg), size);
+    return;
+  }
+
+  // Raw bytes are not valid UTF-8 in general, so they can't go as they are
+  // in a JSON string.
+  std::string encoded;
+  base64::Encode(static_cast<const char*>(msg), size, &encoded);
+  picojson::value::object o;
+  o["binary"] = picojson::value(encoded);
+  PostMessage(picojson::value(o).serialize().c_str());
+}
+
+bool Instance::SupportsBinaryMessages() const {
+  return g_messaging2 != NULL;
+}
+
+void Instance::HandleBinaryMessage(const char* msg, size_t size) {
+  if (memchr(msg, '\0', size)) {
+    std::cerr << "Ignoring binary message with NUL bytes, the instance only "
+              << "handles string messages.\n";
+    return;
+  }
+  HandleMessage(std::string(msg, size).c_str());
 }
 
 void Instance::SendSyncReply(const char* reply) {
@@ -158,4 +259,24 @@ void Instance::SendSyncReply(const char* reply) {
   g_sync_messaging->SetSyncReply(xw_instance_, reply);
 }
 
+void Instance::PostMessage(const picojson::value& value) {
+  PostMessage(Serialize(value)->c_str());
+}
+
+void Instance::SendSyncReply(const picojson::value& value) {
+  SendSyncReply(Serialize(value)->c_str());
+}
+
+// static
+std::string* Instance::Serialize(const picojson::value& value) {
+  perf::ScopedPhase phase(perf::kSerialize);
+  // Never freed, the threads that reply live as long as the process.
+  static __thread std::string* buffer = NULL;
+  if (!buffer)
+    buffer = new std::string;
+  buffer->clear();
+  value.serialize(buffer);
+  return buffer;
+}
+
 }  // namespace common
@@ -16,9 +16,19 @@
 // script context associated with a frame in the page. These objects serves as
 // storage points for extension specific objects, use them for that.
 
+#include <stddef.h>
+
+#include <string>
+
 #include "common/XW_Extension.h"
 #include "common/XW_Extension_SyncMessage.h"
 
+namespace picojson {
+
+class value;
+
+}  // namespace picojson
+
 namespace common {
 
 class Instance;
@@ -39,9 +49,11 @@ class Extension {
   Extension();
   virtual ~Extension();
 
-  // These should be called in the subclass constructor.
+  // These should be called in the subclass constructor. With
+  // |batch_messages|, the JavaScript API can send batches of messages with
+  // extension.postBatch(), see common/message_batch.h.
   void SetExtensionName(const char* name);
-  void SetJavaScriptAPI(const char* api);
+  void SetJavaScriptAPI(const char* api, bool batch_messages = false);
 
   virtual Instance* CreateInstance();
 
@@ -55,6 +67,8 @@ class Extension {
   static void OnInstanceDestroyed(XW_Instance xw_instance);
   static void HandleMessage(XW_Instance xw_instance, const char* msg);
   static void HandleSyncMessage(XW_Instance xw_instance, const char* msg);
+  static void HandleBinaryMessage(XW_Instance xw_instance, const char* msg,
+                                  const size_t size);
 };
 
 class Instance {
@@ -65,15 +79,35 @@ class Instance {
   void PostMessage(const char* msg);
   void SendSyncReply(const char* reply);
 
+  // Serialize |value| into a buffer kept by the calling thread and reused by
+  // its every reply. Not one per instance, as GLib callbacks may post from
+  // another thread than the one handling messages.
+  void PostMessage(const picojson::value& value);
+  void SendSyncReply(const picojson::value& value);
+
+  // Posts |size| bytes as a binary message. If the runtime doesn't support
+  // binary messages, the bytes are sent base64 encoded in the "binary" member
+  // of a JSON message, check SupportsBinaryMessages() to know which one the
+  // JS side will get.
+  void PostBinaryMessage(const void* msg, size_t size);
+  bool SupportsBinaryMessages() const;
+
   virtual void Initialize() {}
   virtual void HandleMessage(const char* msg) = 0;
   virtual void HandleSyncMessage(const char* msg) {}
 
+  // The default implementation hands the payload to HandleMessage(), unless
+  // it has NUL bytes that would cut it short there. Instances that take
+  // arbitrary bytes must override it.
+  virtual void HandleBinaryMessage(const char* msg, size_t size);
+
   XW_Instance xw_instance() const { return xw_instance_; }
 
  private:
   friend class Extension;
 
+  static std::string* Serialize(const picojson::value& value);
+
   XW_Instance xw_instance_;
 };
 
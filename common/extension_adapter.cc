@@ -4,16 +4,28 @@
 
 #include "common/extension_adapter.h"
 
+#include <string.h>
+
 #include <iostream>
+#include <string>
+
+#include "common/base64.h"
+#include "common/picojson.h"
 
 namespace {
 
 XW_Extension g_extension = 0;
+std::string g_javascript_api;
 
 const XW_CoreInterface* g_core = NULL;
 const XW_MessagingInterface* g_messaging = NULL;
+const XW_MessagingInterface2* g_messaging2 = NULL;
 const XW_Internal_SyncMessagingInterface* g_sync_messaging = NULL;
 
+void OnShutdown(XW_Extension) {
+  common::perf::DumpTrace();
+}
+
 }  // namespace
 
 namespace internal {
@@ -25,7 +37,10 @@ int32_t InitializeExtension(XW_Extension extension,
                             XW_CreatedInstanceCallback created,
                             XW_DestroyedInstanceCallback destroyed,
                             XW_HandleMessageCallback handle_message,
-                            XW_HandleSyncMessageCallback handle_sync_message) {
+                            XW_HandleSyncMessageCallback handle_sync_message,
+                            XW_HandleBinaryMessageCallback
+                                handle_binary_message,
+                            bool batch_messages) {
   if (g_extension != 0) {
     std::cerr << "Can't initialize same extension multiple times!\n";
     return XW_ERROR;
@@ -40,17 +55,33 @@ int32_t InitializeExtension(XW_Extension extension,
     return XW_ERROR;
   }
   g_core->SetExtensionName(extension, name);
+  common::perf::SetExtensionName(name);
+  if (batch_messages) {
+    g_javascript_api = common::WrapJavaScriptAPI(api);
+    api = g_javascript_api.c_str();
+  }
   g_core->SetJavaScriptAPI(extension, api);
   g_core->RegisterInstanceCallbacks(extension, created, destroyed);
-
-  g_messaging = reinterpret_cast<const XW_MessagingInterface*>(
-      get_interface(XW_MESSAGING_INTERFACE));
-  if (!g_messaging) {
-    std::cerr <<
-        "Can't initialize extension: error getting Messaging interface.\n";
-    return XW_ERROR;
+  g_core->RegisterShutdownCallback(extension, OnShutdown);
+
+  // Prefer the binary capable messaging interface, but keep working with
+  // runtimes that only know about the string one.
+  g_messaging2 = reinterpret_cast<const XW_MessagingInterface2*>(
+      get_interface(XW_MESSAGING_INTERFACE_2));
+  if (g_messaging2) {
+    g_messaging2->Register(extension, handle_message);
+    g_messaging2->RegisterBinaryMessageCallback(extension,
+                                                handle_binary_message);
+  } else {
+    g_messaging = reinterpret_cast<const XW_MessagingInterface*>(
+        get_interface(XW_MESSAGING_INTERFACE));
+    if (!g_messaging) {
+      std::cerr <<
+          "Can't initialize extension: error getting Messaging interface.\n";
+      return XW_ERROR;
+    }
+    g_messaging->Register(extension, handle_message);
   }
-  g_messaging->Register(extension, handle_message);
 
   g_sync_messaging =
       reinterpret_cast<const XW_Internal_SyncMessagingInterface*>(
@@ -66,7 +97,44 @@ int32_t InitializeExtension(XW_Extension extension,
 }
 
 void PostMessage(XW_Instance instance, const char* message) {
-  g_messaging->PostMessage(instance, message);
+  if (common::CaptureBatchReply(instance, message))
+    return;
+  common::perf::RecordPost(instance, strlen(message));
+  if (g_messaging2)
+    g_messaging2->PostMessage(instance, message);
+  else
+    g_messaging->PostMessage(instance, message);
+}
+
+void PostBinaryMessage(XW_Instance instance, const char* message,
+                       size_t size) {
+  if (g_messaging2) {
+    common::perf::RecordPost(instance, size);
+    g_messaging2->PostBinaryMessage(instance, message, size);
+    return;
+  }
+
+  // Fallback for runtimes without binary messaging: wrap the payload in a
+  // JSON message so the JavaScript side can still get the bytes, base64
+  // encoded since they aren't valid UTF-8 in general.
+  std::string encoded;
+  common::base64::Encode(message, size, &encoded);
+  picojson::value::object o;
+  o["binary"] = picojson::value(encoded);
+  PostMessage(instance, picojson::value(o).serialize().c_str());
+}
+
+std::string* GetReplyBuffer() {
+  // Never freed, the threads that reply live as long as the process.
+  static __thread std::string* buffer = NULL;
+  if (!buffer)
+    buffer = new std::string;
+  buffer->clear();
+  return buffer;
+}
+
+bool HasBinaryMessaging() {
+  return g_messaging2 != NULL;
 }
 
 void SetSyncReply(XW_Instance instance, const char* reply) {
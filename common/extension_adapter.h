@@ -6,9 +6,15 @@
 #define COMMON_EXTENSION_ADAPTER_H_
 
 #include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <map>
+#include <string>
 #include "common/XW_Extension.h"
 #include "common/XW_Extension_SyncMessage.h"
+#include "common/message_batch.h"
+#include "common/perf_counters.h"
+#include "common/picojson.h"
 
 namespace internal {
 
@@ -19,11 +25,56 @@ int32_t InitializeExtension(XW_Extension extension,
                          XW_CreatedInstanceCallback created,
                          XW_DestroyedInstanceCallback destroyed,
                          XW_HandleMessageCallback handle_message,
-                         XW_HandleSyncMessageCallback handle_sync_message);
+                         XW_HandleSyncMessageCallback handle_sync_message,
+                         XW_HandleBinaryMessageCallback handle_binary_message,
+                         bool batch_messages);
 
 void PostMessage(XW_Instance instance, const char* message);
+void PostBinaryMessage(XW_Instance instance, const char* message, size_t size);
 void SetSyncReply(XW_Instance instance, const char* reply);
 
+// Returns the emptied reply buffer of the calling thread, see ContextAPI.
+std::string* GetReplyBuffer();
+
+// Returns true if the runtime provides XW_MESSAGING_INTERFACE_2. Otherwise
+// binary messages are posted base64 encoded in a JSON message, see
+// PostBinaryMessage.
+bool HasBinaryMessaging();
+
+// Contexts are not required to implement HandleBinaryMessage(), the ones that
+// don't get the payload through their regular HandleMessage(). Payloads with
+// NUL bytes would be cut short there, so those are dropped instead.
+template <class T>
+auto DispatchBinaryMessage(T* context, const char* message, size_t size, int)
+    -> decltype(context->HandleBinaryMessage(message, size), void()) {
+  context->HandleBinaryMessage(message, size);
+}
+
+template <class T>
+void DispatchBinaryMessage(T* context, const char* message, size_t size,
+                           long) {  // NOLINT
+  if (memchr(message, '\0', size)) {
+    std::cerr << "Ignoring binary message with NUL bytes, the context only "
+              << "handles string messages.\n";
+    return;
+  }
+  context->HandleMessage(std::string(message, size).c_str());
+}
+
+// Contexts whose JavaScript sends batches of messages (see
+// common/message_batch.h) opt in with:
+//
+//   static const bool batch_messages = true;
+template <class T>
+auto UsesBatchMessages(int) -> decltype(T::batch_messages, bool()) {
+  return T::batch_messages;
+}
+
+template <class T>
+bool UsesBatchMessages(long) {  // NOLINT
+  return false;
+}
+
 }  // namespace internal
 
 class ContextAPI {
@@ -33,11 +84,44 @@ class ContextAPI {
   void PostMessage(const char* message) {
     internal::PostMessage(instance_, message);
   }
+  void PostBinaryMessage(const void* message, size_t size) {
+    internal::PostBinaryMessage(
+        instance_, static_cast<const char*>(message), size);
+  }
+  bool SupportsBinaryMessages() const {
+    return internal::HasBinaryMessaging();
+  }
   void SetSyncReply(const char* reply) {
     internal::SetSyncReply(instance_, reply);
   }
 
+  // These serialize |value| into a buffer kept by the calling thread, so
+  // once it has grown to the size of the usual reply no allocation is
+  // needed. Messages are handled on the extension thread, but GLib callbacks
+  // (timers, TaskRunner replies) may run on another one, so the buffer
+  // can't belong to the context.
+  void PostMessage(const picojson::value& value) {
+    PostMessage(Serialize(value)->c_str());
+  }
+  void SetSyncReply(const picojson::value& value) {
+    SetSyncReply(Serialize(value)->c_str());
+  }
+
+  // Returns the emptied reply buffer of the calling thread, so big replies
+  // can be written in place with common::JsonWriter and then posted or set
+  // as the sync reply. It's reused by the next reply of the same thread.
+  std::string* reply_buffer() {
+    return internal::GetReplyBuffer();
+  }
+
  private:
+  std::string* Serialize(const picojson::value& value) {
+    common::perf::ScopedPhase phase(common::perf::kSerialize);
+    std::string* buffer = internal::GetReplyBuffer();
+    value.serialize(buffer);
+    return buffer;
+  }
+
   XW_Instance instance_;
 };
 
@@ -53,6 +137,8 @@ class ExtensionAdapter {
 
   static void HandleMessage(XW_Instance instance, const char* message);
   static void HandleSyncMessage(XW_Instance instance, const char* message);
+  static void HandleBinaryMessage(XW_Instance instance, const char* message,
+                                  const size_t size);
 
   typedef std::map<XW_Instance, T*> InstanceMap;
   static InstanceMap g_instances;
@@ -66,7 +152,8 @@ int32_t ExtensionAdapter<T>::Initialize(XW_Extension extension,
                                         XW_GetInterface get_interface) {
   return internal::InitializeExtension(
       extension, get_interface, T::name, T::GetJavaScript(),
-      DidCreateInstance, DidDestroyInstance, HandleMessage, HandleSyncMessage);
+      DidCreateInstance, DidDestroyInstance, HandleMessage, HandleSyncMessage,
+      HandleBinaryMessage, internal::UsesBatchMessages<T>(0));
 }
 
 template <class T>
@@ -78,11 +165,19 @@ template <class T>
 void ExtensionAdapter<T>::DidDestroyInstance(XW_Instance instance) {
   delete g_instances[instance];
   g_instances.erase(instance);
+  common::perf::RecordInstanceDestroyed(instance);
 }
 
 template <class T>
 void ExtensionAdapter<T>::HandleMessage(XW_Instance instance,
                                         const char* message) {
+  size_t size = strlen(message);
+  common::perf::ScopedMessage perf(message, size, false);
+  if (common::IsBatchMessage(message)) {
+    common::DispatchBatch(instance, message, size, HandleMessage,
+                          internal::PostMessage);
+    return;
+  }
   g_instances[instance]->HandleMessage(message);
 }
 
@@ -90,9 +185,22 @@ void ExtensionAdapter<T>::HandleMessage(XW_Instance instance,
 template <class T>
 void ExtensionAdapter<T>::HandleSyncMessage(XW_Instance instance,
                                             const char* message) {
+  if (common::perf::IsPerfMessage(message)) {
+    internal::SetSyncReply(instance, common::perf::GetReport().c_str());
+    return;
+  }
+  common::perf::ScopedMessage perf(message, strlen(message), true);
   g_instances[instance]->HandleSyncMessage(message);
 }
 
+template <class T>
+void ExtensionAdapter<T>::HandleBinaryMessage(XW_Instance instance,
+                                              const char* message,
+                                              const size_t size) {
+  common::perf::ScopedMessage perf(message, size, false);
+  internal::DispatchBinaryMessage(g_instances[instance], message, size, 0);
+}
+
 #define DEFINE_XWALK_EXTENSION(NAME)                                    \
   int32_t XW_Initialize(XW_Extension extension,                         \
                         XW_GetInterface get_interface) {                \
@@ -0,0 +1,142 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef COMMON_JSON_WRITER_H_
+#define COMMON_JSON_WRITER_H_
+
+#include <assert.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "common/picojson.h"
+
+namespace common {
+
+// Writes JSON straight into a string, without building a picojson::value
+// tree first. Use it for replies with many entries, where the tree would
+// cost a few allocations per entry:
+//
+//   JsonWriter writer(buffer);
+//   writer.BeginObject();
+//   writer.Key("value").BeginArray();
+//   for (...)
+//     writer.String(name);
+//   writer.EndArray();
+//   writer.EndObject();
+//
+// Output is appended to |out|, escaped the same way picojson does it. Calls
+// must be properly nested, this is only checked in debug builds.
+class JsonWriter {
+ public:
+  explicit JsonWriter(std::string* out) : out_(out), after_key_(false) {}
+
+  JsonWriter& BeginObject() { return Open('{'); }
+  JsonWriter& EndObject() { return Close('}'); }
+  JsonWriter& BeginArray() { return Open('['); }
+  JsonWriter& EndArray() { return Close(']'); }
+
+  JsonWriter& Key(const char* key) {
+    return Key(key, strlen(key));
+  }
+  JsonWriter& Key(const std::string& key) {
+    return Key(key.data(), key.size());
+  }
+  JsonWriter& Key(const char* key, size_t size) {
+    assert(!after_key_ && !first_.empty());
+    Separate();
+    picojson::serialize_str(key, size, out_);
+    out_->push_back(':');
+    after_key_ = true;
+    return *this;
+  }
+
+  JsonWriter& String(const char* value) {
+    return String(value, strlen(value));
+  }
+  JsonWriter& String(const std::string& value) {
+    return String(value.data(), value.size());
+  }
+  JsonWriter& String(const char* value, size_t size) {
+    Separate();
+    picojson::serialize_str(value, size, out_);
+    return *this;
+  }
+
+  JsonWriter& Number(double value) {
+    Separate();
+    char buf[256];
+    out_->append(buf, picojson::format_number(value, buf, sizeof(buf)));
+    return *this;
+  }
+
+  JsonWriter& Bool(bool value) {
+    Separate();
+    if (value)
+      out_->append("true", 4);
+    else
+      out_->append("false", 5);
+    return *this;
+  }
+
+  JsonWriter& Null() {
+    Separate();
+    out_->append("null", 4);
+    return *this;
+  }
+
+  // Writes an existing tree, for the small parts of a reply that are easier
+  // to build as a picojson::value.
+  JsonWriter& Value(const picojson::value& value) {
+    Separate();
+    value.serialize(out_);
+    return *this;
+  }
+
+  // Writes |json| as is, it must already be a serialized JSON value.
+  JsonWriter& Raw(const std::string& json) {
+    Separate();
+    out_->append(json);
+    return *this;
+  }
+
+ private:
+  // Adds the comma between members, unless this follows a key.
+  void Separate() {
+    if (after_key_) {
+      after_key_ = false;
+      return;
+    }
+    if (first_.empty())
+      return;
+    if (first_.back())
+      first_.back() = false;
+    else
+      out_->push_back(',');
+  }
+
+  JsonWriter& Open(char bracket) {
+    Separate();
+    out_->push_back(bracket);
+    first_.push_back(true);
+    return *this;
+  }
+
+  JsonWriter& Close(char bracket) {
+    assert(!after_key_ && !first_.empty());
+    first_.pop_back();
+    out_->push_back(bracket);
+    return *this;
+  }
+
+  std::string* out_;
+  // One entry per open object or array, true until it gets a member.
+  std::vector<bool> first_;
+  bool after_key_;
+};
+
+}  // namespace common
+
+#endif  // COMMON_JSON_WRITER_H_
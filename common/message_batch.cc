@@ -0,0 +1,135 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "common/message_batch.h"
+
+#include <string.h>
+
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "common/picojson.h"
+
+namespace {
+
+// JSON.stringify() keeps the insertion order of the properties, so the
+// prologue below always produces messages starting with this.
+const char kBatchPrefix[] = "{\"cmd\":\"batch\",";
+
+const char kBatchPrologue[] =
+    "(function() {\n"
+    "  var setMessageListener = extension.setMessageListener;\n"
+    "  extension.setMessageListener = function(listener) {\n"
+    "    setMessageListener(function(msg) {\n"
+    "      if (msg.lastIndexOf('{\"cmd\":\"batch_reply\",', 0) !== 0) {\n"
+    "        listener(msg);\n"
+    "        return;\n"
+    "      }\n"
+    "      var replies = JSON.parse(msg).replies;\n"
+    "      for (var i = 0; i < replies.length; i++)\n"
+    "        listener(replies[i]);\n"
+    "    });\n"
+    "  };\n"
+    "  extension.postBatch = function(messages) {\n"
+    "    extension.postMessage(\n"
+    "        JSON.stringify({ cmd: 'batch', batch: messages }));\n"
+    "  };\n"
+    "})();\n";
+
+struct Batch {
+  XW_Instance instance;
+  std::vector<std::string> replies;
+};
+
+// Only the thread dispatching a batch can add replies to it, messages posted
+// by other threads at the same time are not part of the batch.
+__thread Batch* g_current_batch = NULL;
+
+}  // namespace
+
+namespace common {
+
+bool IsBatchMessage(const char* message) {
+  return !strncmp(message, kBatchPrefix, sizeof(kBatchPrefix) - 1);
+}
+
+bool DispatchBatch(XW_Instance instance, const char* message, size_t size,
+                   XW_HandleMessageCallback handle_message,
+                   void (*post_message)(XW_Instance, const char*)) {
+  if (g_current_batch) {
+    std::cerr << "Ignoring batch nested in another batch.\n";
+    return false;
+  }
+
+  picojson::object_view v;
+  std::string err;
+  picojson::parse_view(v, message, message + size, &err);
+  const picojson::object_view::entry* messages = v.find("batch", 5);
+  if (!err.empty() || !messages || messages->type != picojson::array_type) {
+    std::cerr << "Ignoring invalid batch message.\n";
+    return false;
+  }
+
+  Batch batch;
+  batch.instance = instance;
+  g_current_batch = &batch;
+
+  // The array was already validated, only where each message starts and
+  // ends is needed. Messages that are objects are handed over as they are
+  // in the batch, strings have to be unescaped first.
+  picojson::input<const char*> in(messages->raw,
+                                  messages->raw + messages->raw_len);
+  in.expect('[');
+  if (!in.expect(']')) {
+    std::string buffer;
+    do {
+      in.skip_ws();
+      const char* first = in.pos();
+      picojson::null_parse_context ctx;
+      picojson::_parse(ctx, in);
+      if (*first == '"') {
+        picojson::value string;
+        picojson::parse(string, first, in.pos(), NULL);
+        buffer = string.get<std::string>();
+      } else {
+        buffer.assign(first, in.pos());
+      }
+      handle_message(instance, buffer.c_str());
+    } while (in.expect(','));
+  }
+
+  g_current_batch = NULL;
+
+  if (batch.replies.empty())
+    return true;
+
+  std::string reply("{\"cmd\":\"batch_reply\",\"replies\":[");
+  for (std::vector<std::string>::const_iterator it = batch.replies.begin();
+       it != batch.replies.end(); ++it) {
+    if (it != batch.replies.begin())
+      reply.push_back(',');
+    picojson::serialize_str(*it, std::back_inserter(reply));
+  }
+  reply.append("]}");
+  post_message(instance, reply.c_str());
+  return true;
+}
+
+bool CaptureBatchReply(XW_Instance instance, const char* message) {
+  if (!g_current_batch || g_current_batch->instance != instance)
+    return false;
+  g_current_batch->replies.push_back(message);
+  return true;
+}
+
+std::string WrapJavaScriptAPI(const char* api) {
+  std::string wrapped(kBatchPrologue);
+  wrapped.append("(function() {\n");
+  wrapped.append(api);
+  wrapped.append("\n}).call(this);\n");
+  return wrapped;
+}
+
+}  // namespace common
@@ -0,0 +1,63 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef COMMON_MESSAGE_BATCH_H_
+#define COMMON_MESSAGE_BATCH_H_
+
+// A batch lets the JavaScript side send several commands in a single
+// message:
+//
+//   {"cmd":"batch","batch":[<message>, <message>, ...]}
+//
+// Each message is handed to the extension's regular HandleMessage(), and the
+// replies posted while the batch is being dispatched are sent back together:
+//
+//   {"cmd":"batch_reply","replies":["<reply>", "<reply>", ...]}
+//
+// Replies are kept as the strings the handlers posted, so reply ids and
+// everything else come back untouched.
+//
+// Only what the handlers post synchronously, on the dispatching thread,
+// joins the batch reply. Everything else is sent as usual, on its own:
+//  - replies of work handed off elsewhere: TaskRunner tasks, GLib timers,
+//    other asynchronous callbacks;
+//  - messages that go through an OutboundQueue, which sends them later from
+//    an idle callback.
+// The batch reply is not held until every command in the batch has replied.
+// The extension can't tell which commands will ever reply. Sync messages
+// can't be batched; they get their reply from HandleSyncMessage() as
+// always.
+//
+// Extensions opt in to batches, and then WrapJavaScriptAPI() adds a prologue
+// to their JavaScript. It provides extension.postBatch() and unpacks the
+// batch replies before they reach the message listener, so the extension's
+// own JavaScript doesn't need to know about the envelope.
+
+#include <string>
+
+#include "common/XW_Extension.h"
+
+namespace common {
+
+bool IsBatchMessage(const char* message);
+
+// Hands every message of the batch to |handle_message| and posts the replies
+// collected meanwhile with |post_message|. |size| is the length of
+// |message|. Returns false if |message| is not a valid batch.
+bool DispatchBatch(XW_Instance instance, const char* message, size_t size,
+                   XW_HandleMessageCallback handle_message,
+                   void (*post_message)(XW_Instance, const char*));
+
+// Called when posting a message. Returns true if |message| was taken as a
+// reply of the batch being dispatched for |instance| on the current thread,
+// in which case it must not be posted.
+bool CaptureBatchReply(XW_Instance instance, const char* message);
+
+// Returns |api| after the batch prologue. |api| runs in a function of its
+// own, so that a "use strict" directive at its start still applies to it.
+std::string WrapJavaScriptAPI(const char* api);
+
+}  // namespace common
+
+#endif  // COMMON_MESSAGE_BATCH_H_
@@ -0,0 +1,119 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "common/outbound_queue.h"
+
+#include "common/perf_counters.h"
+
+namespace {
+
+struct AutoLock {
+  explicit AutoLock(pthread_mutex_t* m) : m_(m) { pthread_mutex_lock(m_); }
+  ~AutoLock() { pthread_mutex_unlock(m_); }
+ private:
+  pthread_mutex_t* m_;
+};
+
+}  // namespace
+
+namespace common {
+
+const size_t OutboundQueue::kDefaultHighWaterMark;
+
+OutboundQueue::OutboundQueue(ContextAPI* api, size_t high_water_mark)
+    : api_(api),
+      high_water_mark_(high_water_mark ? high_water_mark : 1),
+      size_(0),
+      idle_source_id_(0) {
+  pthread_mutex_init(&flush_mutex_, NULL);
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+OutboundQueue::~OutboundQueue() {
+  Clear();
+  pthread_mutex_destroy(&mutex_);
+  pthread_mutex_destroy(&flush_mutex_);
+}
+
+bool OutboundQueue::Post(const std::string& message) {
+  return Post(std::string(), message);
+}
+
+bool OutboundQueue::Post(const std::string& topic,
+                         const std::string& message) {
+  AutoLock lock(&mutex_);
+
+  if (!topic.empty()) {
+    TopicMap::iterator it = topics_.find(topic);
+    if (it != topics_.end()) {
+      it->second->message = message;
+      return true;
+    }
+  }
+
+  if (size_ >= high_water_mark_) {
+    perf::RecordQueueDrop("outbound");
+    return false;
+  }
+
+  Entry entry;
+  entry.topic = topic;
+  entry.message = message;
+  EntryList::iterator it = entries_.insert(entries_.end(), entry);
+  size_++;
+  if (!topic.empty())
+    topics_[topic] = it;
+  perf::RecordQueueDepth("outbound", size_);
+
+  if (!idle_source_id_)
+    idle_source_id_ = g_idle_add(OnIdle, this);
+  return true;
+}
+
+void OutboundQueue::Flush() {
+  AutoLock flush_lock(&flush_mutex_);
+  EntryList entries;
+  {
+    AutoLock lock(&mutex_);
+    entries.swap(entries_);
+    topics_.clear();
+    size_ = 0;
+    if (idle_source_id_) {
+      g_source_remove(idle_source_id_);
+      idle_source_id_ = 0;
+    }
+  }
+  for (EntryList::iterator it = entries.begin(); it != entries.end(); ++it)
+    api_->PostMessage(it->message.c_str());
+}
+
+void OutboundQueue::Clear() {
+  AutoLock lock(&mutex_);
+  entries_.clear();
+  topics_.clear();
+  size_ = 0;
+  if (idle_source_id_) {
+    g_source_remove(idle_source_id_);
+    idle_source_id_ = 0;
+  }
+}
+
+size_t OutboundQueue::pending() const {
+  AutoLock lock(&mutex_);
+  return size_;
+}
+
+// static
+gboolean OutboundQueue::OnIdle(gpointer user_data) {
+  OutboundQueue* queue = static_cast<OutboundQueue*>(user_data);
+  {
+    AutoLock lock(&queue->mutex_);
+    // Returning FALSE removes the source, it must not be removed again.
+    queue->idle_source_id_ = 0;
+  }
+  queue->Flush();
+  return FALSE;
+}
+
+}  // namespace common
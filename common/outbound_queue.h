@@ -0,0 +1,81 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef COMMON_OUTBOUND_QUEUE_H_
+#define COMMON_OUTBOUND_QUEUE_H_
+
+#include <glib.h>
+#include <pthread.h>
+
+#include <list>
+#include <map>
+#include <string>
+
+#include "common/extension_adapter.h"
+#include "common/utils.h"
+
+namespace common {
+
+// Queues the messages posted to one instance and sends them from an idle
+// callback on the default GLib main context, instead of doing one IPC per
+// event.
+//
+// Messages posted with a topic coalesce: while a message is pending, a newer
+// one with the same topic replaces it in place, so a slow consumer only gets
+// the latest state (e.g. the last progress of each download). Once
+// |high_water_mark| messages are pending, the queue refuses new messages
+// until it was flushed: Post() returns false and the message is dropped.
+// Messages that replace a pending one of their topic are still taken, they
+// don't make the queue grow.
+//
+// Post() may be called from any thread, and never waits for messages being
+// sent. The owner must call Flush() or Clear() before |api| goes away.
+class OutboundQueue {
+ public:
+  static const size_t kDefaultHighWaterMark = 256;
+
+  explicit OutboundQueue(ContextAPI* api,
+                         size_t high_water_mark = kDefaultHighWaterMark);
+  ~OutboundQueue();
+
+  bool Post(const std::string& message);
+  bool Post(const std::string& topic, const std::string& message);
+
+  // Sends all the pending messages now.
+  void Flush();
+
+  // Drops all the pending messages.
+  void Clear();
+
+  size_t pending() const;
+
+ private:
+  struct Entry {
+    std::string topic;
+    std::string message;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef std::map<std::string, EntryList::iterator> TopicMap;
+
+  static gboolean OnIdle(gpointer user_data);
+
+  ContextAPI* api_;
+  size_t high_water_mark_;
+
+  // Held while sending, so that messages taken by concurrent flushes still
+  // go out in order. |mutex_| only guards the pending messages, and is
+  // never held while sending.
+  pthread_mutex_t flush_mutex_;
+  mutable pthread_mutex_t mutex_;
+  EntryList entries_;
+  size_t size_;
+  TopicMap topics_;
+  guint idle_source_id_;
+
+  DISALLOW_COPY_AND_ASSIGN(OutboundQueue);
+};
+
+}  // namespace common
+
+#endif  // COMMON_OUTBOUND_QUEUE_H_
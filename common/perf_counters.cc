@@ -0,0 +1,535 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "common/perf_counters.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <vector>
+
+#include "common/picojson.h"
+
+namespace {
+
+// Bucket i counts the latencies in [2^i, 2^(i+1)) microseconds, the first
+// one also takes everything below 1us and the last one everything above.
+const int kHistogramBuckets = 24;
+
+// Keeps a long running trace from growing without bounds. Later events are
+// only counted.
+const size_t kMaxTraceEvents = 1 << 16;
+
+const char kPerfPrefix[] = "{\"cmd\":\"__perf\"";
+const char kCmdKey[] = "\"cmd\":\"";
+
+const char* const kPhaseNames[] = { "parse", "handler", "serialize" };
+
+const char kUnknownCommand[] = "<unknown>";
+const char kOtherCommands[] = "<other>";
+
+// The counters are kept by each thread for the messages it handles and the
+// posts it makes, so that recording them takes no lock. Slots are only
+// claimed by their thread and never move, and each table publishes its
+// slots with a release store of its count, so the report can read them from
+// another thread at any time.
+const size_t kMaxThreadCommands = 64;
+const size_t kMaxCommandName = 48;
+const size_t kMaxThreadInstances = 16;
+const size_t kMaxQueues = 8;
+
+typedef std::atomic<uint64_t> Counter;
+
+// Only for counters written by a single thread.
+void Add(Counter* counter, uint64_t n) {
+  counter->store(counter->load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+}
+
+uint64_t Get(const Counter& counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+struct CommandSlot {
+  void Reset(const char* new_name, size_t size) {
+    name_size = std::min(size, kMaxCommandName);
+    memcpy(name, new_name, name_size);
+    calls.store(0, std::memory_order_relaxed);
+    sync_calls.store(0, std::memory_order_relaxed);
+    bytes_in.store(0, std::memory_order_relaxed);
+    total_ns.store(0, std::memory_order_relaxed);
+    max_ns.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < common::perf::kPhaseCount; ++i)
+      phase_ns[i].store(0, std::memory_order_relaxed);
+    for (int i = 0; i < kHistogramBuckets; ++i)
+      histogram[i].store(0, std::memory_order_relaxed);
+  }
+
+  char name[kMaxCommandName];
+  size_t name_size;
+  Counter calls;
+  Counter sync_calls;
+  Counter bytes_in;
+  Counter total_ns;
+  Counter max_ns;
+  Counter phase_ns[common::perf::kPhaseCount];
+  Counter histogram[kHistogramBuckets];
+};
+
+// Slots of destroyed instances are reused by the next instance the thread
+// posts to.
+struct InstanceSlot {
+  std::atomic<XW_Instance> instance;
+  std::atomic<bool> destroyed;
+  Counter posts;
+  Counter bytes_out;
+};
+
+struct ThreadStats {
+  ThreadStats() : command_count(0), instance_count(0) {}
+
+  // The last slot takes all the commands that didn't get one.
+  CommandSlot commands[kMaxThreadCommands];
+  std::atomic<size_t> command_count;
+  InstanceSlot instances[kMaxThreadInstances];
+  std::atomic<size_t> instance_count;
+};
+
+// Queues are posted to from any thread, so their counters are shared.
+struct QueueSlot {
+  const char* name;
+  std::atomic<uint64_t> depth;
+  std::atomic<uint64_t> max_depth;
+  // Messages refused because the queue was full.
+  std::atomic<uint64_t> dropped;
+};
+
+// What the report adds up from every thread.
+struct CommandStats {
+  CommandStats() : calls(0), sync_calls(0), bytes_in(0), total_ns(0),
+                   max_ns(0) {
+    memset(phase_ns, 0, sizeof(phase_ns));
+    memset(histogram, 0, sizeof(histogram));
+  }
+  uint64_t calls;
+  uint64_t sync_calls;
+  uint64_t bytes_in;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t phase_ns[common::perf::kPhaseCount];
+  uint64_t histogram[kHistogramBuckets];
+};
+
+struct InstanceStats {
+  InstanceStats() : posts(0), bytes_out(0) {}
+  uint64_t posts;
+  uint64_t bytes_out;
+};
+
+struct TraceEvent {
+  std::string name;
+  uint64_t start_us;
+  uint64_t duration_us;
+  pid_t tid;
+};
+
+// Only registering threads and queues, tracing and reading the counters
+// take |mutex|.
+struct Registry {
+  Registry()
+      : queue_count(0),
+        trace_file(getenv("XW_EXTENSION_TRACE_FILE")),
+        dropped_events(0) {
+    pthread_mutex_init(&mutex, NULL);
+  }
+
+  pthread_mutex_t mutex;
+  std::vector<ThreadStats*> threads;
+  QueueSlot queues[kMaxQueues];
+  std::atomic<size_t> queue_count;
+
+  std::string extension_name;
+  const char* trace_file;
+  std::vector<TraceEvent> trace;
+  uint64_t dropped_events;
+};
+
+Registry& GetRegistry() {
+  static Registry* registry = new Registry;
+  return *registry;
+}
+
+struct AutoLock {
+  explicit AutoLock(pthread_mutex_t* m) : m_(m) { pthread_mutex_lock(m_); }
+  ~AutoLock() { pthread_mutex_unlock(m_); }
+ private:
+  pthread_mutex_t* m_;
+};
+
+// Never freed, the threads that handle messages live as long as the process.
+ThreadStats* GetThreadStats() {
+  static __thread ThreadStats* stats = NULL;
+  if (!stats) {
+    stats = new ThreadStats;
+    Registry& registry = GetRegistry();
+    AutoLock lock(&registry.mutex);
+    registry.threads.push_back(stats);
+  }
+  return stats;
+}
+
+CommandSlot* GetCommandSlot(ThreadStats* stats, const char* name,
+                            size_t size) {
+  size = std::min(size, kMaxCommandName);
+  size_t count = stats->command_count.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < count; ++i) {
+    CommandSlot& slot = stats->commands[i];
+    if (slot.name_size == size && !memcmp(slot.name, name, size))
+      return &slot;
+  }
+  if (count == kMaxThreadCommands)
+    return &stats->commands[count - 1];
+  if (count == kMaxThreadCommands - 1) {
+    name = kOtherCommands;
+    size = sizeof(kOtherCommands) - 1;
+  }
+  stats->commands[count].Reset(name, size);
+  stats->command_count.store(count + 1, std::memory_order_release);
+  return &stats->commands[count];
+}
+
+InstanceSlot* GetInstanceSlot(ThreadStats* stats, XW_Instance instance) {
+  size_t count = stats->instance_count.load(std::memory_order_relaxed);
+  InstanceSlot* unused = NULL;
+  for (size_t i = 0; i < count; ++i) {
+    InstanceSlot& slot = stats->instances[i];
+    if (slot.destroyed.load(std::memory_order_relaxed)) {
+      unused = &slot;
+      continue;
+    }
+    if (slot.instance.load(std::memory_order_relaxed) == instance)
+      return &slot;
+  }
+  if (!unused && count == kMaxThreadInstances)
+    return NULL;
+
+  InstanceSlot* slot = unused ? unused : &stats->instances[count];
+  slot->instance.store(instance, std::memory_order_relaxed);
+  slot->posts.store(0, std::memory_order_relaxed);
+  slot->bytes_out.store(0, std::memory_order_relaxed);
+  slot->destroyed.store(false, std::memory_order_release);
+  if (!unused)
+    stats->instance_count.store(count + 1, std::memory_order_release);
+  return slot;
+}
+
+QueueSlot* GetQueueSlot(const char* queue) {
+  Registry& registry = GetRegistry();
+  size_t count = registry.queue_count.load(std::memory_order_acquire);
+  for (size_t i = 0; i < count; ++i) {
+    if (!strcmp(registry.queues[i].name, queue))
+      return &registry.queues[i];
+  }
+
+  AutoLock lock(&registry.mutex);
+  count = registry.queue_count.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < count; ++i) {
+    if (!strcmp(registry.queues[i].name, queue))
+      return &registry.queues[i];
+  }
+  if (count == kMaxQueues)
+    return NULL;
+  QueueSlot& slot = registry.queues[count];
+  slot.name = queue;
+  slot.depth.store(0, std::memory_order_relaxed);
+  slot.max_depth.store(0, std::memory_order_relaxed);
+  slot.dropped.store(0, std::memory_order_relaxed);
+  registry.queue_count.store(count + 1, std::memory_order_release);
+  return &slot;
+}
+
+uint64_t Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Avoids parsing the whole message just to know its name: JSON strings
+// can't contain a raw '"', so the key can't be mistaken for string content.
+// |name| points into |message|.
+void GetCommandName(const char* message, size_t size, const char** name,
+                    size_t* name_size) {
+  *name = kUnknownCommand;
+  *name_size = sizeof(kUnknownCommand) - 1;
+  const char* key = static_cast<const char*>(
+      memmem(message, size, kCmdKey, sizeof(kCmdKey) - 1));
+  if (!key)
+    return;
+  const char* begin = key + sizeof(kCmdKey) - 1;
+  const char* end = static_cast<const char*>(
+      memchr(begin, '"', message + size - begin));
+  if (!end)
+    return;
+  *name = begin;
+  *name_size = end - begin;
+}
+
+int HistogramBucket(uint64_t ns) {
+  uint64_t us = ns / 1000;
+  int bucket = 0;
+  while (us > 1 && bucket < kHistogramBuckets - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+__thread common::perf::ScopedMessage* g_current_message = NULL;
+
+}  // namespace
+
+namespace common {
+namespace perf {
+
+ScopedMessage::ScopedMessage(const char* message, size_t size, bool sync)
+    : parent_(g_current_message),
+      message_(message),
+      size_(size),
+      sync_(sync),
+      start_(Now()) {
+  memset(phases_, 0, sizeof(phases_));
+  g_current_message = this;
+}
+
+ScopedMessage::~ScopedMessage() {
+  uint64_t end = Now();
+  uint64_t total = end - start_;
+  uint64_t other = phases_[kParse] + phases_[kSerialize];
+  phases_[kHandler] = total > other ? total - other : 0;
+  g_current_message = parent_;
+
+  const char* name;
+  size_t name_size;
+  GetCommandName(message_, size_, &name, &name_size);
+
+  CommandSlot* stats = GetCommandSlot(GetThreadStats(), name, name_size);
+  Add(&stats->calls, 1);
+  if (sync_)
+    Add(&stats->sync_calls, 1);
+  Add(&stats->bytes_in, size_);
+  Add(&stats->total_ns, total);
+  if (total > Get(stats->max_ns))
+    stats->max_ns.store(total, std::memory_order_relaxed);
+  for (int i = 0; i < kPhaseCount; ++i)
+    Add(&stats->phase_ns[i], phases_[i]);
+  Add(&stats->histogram[HistogramBucket(total)], 1);
+
+  Registry& registry = GetRegistry();
+  if (!registry.trace_file)
+    return;
+  AutoLock lock(&registry.mutex);
+  if (registry.trace.size() >= kMaxTraceEvents) {
+    registry.dropped_events++;
+  } else {
+    TraceEvent event;
+    event.name.assign(name, name_size);
+    event.start_us = start_ / 1000;
+    event.duration_us = total / 1000;
+    event.tid = syscall(SYS_gettid);
+    registry.trace.push_back(event);
+  }
+}
+
+ScopedPhase::ScopedPhase(Phase phase)
+    : phase_(phase),
+      start_(g_current_message ? Now() : 0) {
+}
+
+ScopedPhase::~ScopedPhase() {
+  if (g_current_message && start_)
+    g_current_message->phases_[phase_] += Now() - start_;
+}
+
+void SetExtensionName(const char* name) {
+  Registry& registry = GetRegistry();
+  AutoLock lock(&registry.mutex);
+  registry.extension_name = name;
+}
+
+void RecordPost(XW_Instance instance, size_t size) {
+  InstanceSlot* stats = GetInstanceSlot(GetThreadStats(), instance);
+  if (!stats)
+    return;
+  Add(&stats->posts, 1);
+  Add(&stats->bytes_out, size);
+}
+
+void RecordInstanceDestroyed(XW_Instance instance) {
+  Registry& registry = GetRegistry();
+  AutoLock lock(&registry.mutex);
+  for (size_t i = 0; i < registry.threads.size(); ++i) {
+    ThreadStats* stats = registry.threads[i];
+    size_t count = stats->instance_count.load(std::memory_order_acquire);
+    for (size_t j = 0; j < count; ++j) {
+      InstanceSlot& slot = stats->instances[j];
+      if (slot.instance.load(std::memory_order_relaxed) == instance)
+        slot.destroyed.store(true, std::memory_order_relaxed);
+    }
+  }
+}
+
+void RecordQueueDepth(const char* queue, size_t depth) {
+  QueueSlot* stats = GetQueueSlot(queue);
+  if (!stats)
+    return;
+  stats->depth.store(depth, std::memory_order_relaxed);
+  uint64_t max_depth = stats->max_depth.load(std::memory_order_relaxed);
+  while (depth > max_depth
+         && !stats->max_depth.compare_exchange_weak(max_depth, depth,
+                                                    std::memory_order_relaxed))
+    continue;
+}
+
+void RecordQueueDrop(const char* queue) {
+  QueueSlot* stats = GetQueueSlot(queue);
+  if (stats)
+    stats->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool IsPerfMessage(const char* message) {
+  return !strncmp(message, kPerfPrefix, sizeof(kPerfPrefix) - 1);
+}
+
+std::string GetReport() {
+  Registry& registry = GetRegistry();
+  AutoLock lock(&registry.mutex);
+
+  std::map<std::string, CommandStats> command_stats;
+  std::map<XW_Instance, InstanceStats> instance_stats;
+  for (size_t i = 0; i < registry.threads.size(); ++i) {
+    const ThreadStats* thread = registry.threads[i];
+    size_t count = thread->command_count.load(std::memory_order_acquire);
+    for (size_t j = 0; j < count; ++j) {
+      const CommandSlot& slot = thread->commands[j];
+      CommandStats& stats =
+          command_stats[std::string(slot.name, slot.name_size)];
+      stats.calls += Get(slot.calls);
+      stats.sync_calls += Get(slot.sync_calls);
+      stats.bytes_in += Get(slot.bytes_in);
+      stats.total_ns += Get(slot.total_ns);
+      stats.max_ns = std::max(stats.max_ns, Get(slot.max_ns));
+      for (int k = 0; k < kPhaseCount; ++k)
+        stats.phase_ns[k] += Get(slot.phase_ns[k]);
+      for (int k = 0; k < kHistogramBuckets; ++k)
+        stats.histogram[k] += Get(slot.histogram[k]);
+    }
+
+    count = thread->instance_count.load(std::memory_order_acquire);
+    for (size_t j = 0; j < count; ++j) {
+      const InstanceSlot& slot = thread->instances[j];
+      if (slot.destroyed.load(std::memory_order_acquire))
+        continue;
+      InstanceStats& stats =
+          instance_stats[slot.instance.load(std::memory_order_relaxed)];
+      stats.posts += Get(slot.posts);
+      stats.bytes_out += Get(slot.bytes_out);
+    }
+  }
+
+  picojson::value::object commands;
+  for (std::map<std::string, CommandStats>::const_iterator it =
+           command_stats.begin(); it != command_stats.end(); ++it) {
+    const CommandStats& stats = it->second;
+    picojson::value::object o;
+    o["calls"] = picojson::value(static_cast<double>(stats.calls));
+    o["syncCalls"] = picojson::value(static_cast<double>(stats.sync_calls));
+    o["bytesIn"] = picojson::value(static_cast<double>(stats.bytes_in));
+    o["totalUs"] = picojson::value(stats.total_ns / 1000.0);
+    o["maxUs"] = picojson::value(stats.max_ns / 1000.0);
+    for (int i = 0; i < kPhaseCount; ++i)
+      o[std::string(kPhaseNames[i]) + "Us"] =
+          picojson::value(stats.phase_ns[i] / 1000.0);
+    picojson::value::array histogram;
+    for (int i = 0; i < kHistogramBuckets; ++i)
+      histogram.push_back(
+          picojson::value(static_cast<double>(stats.histogram[i])));
+    o["histogram"] = picojson::value(histogram);
+    commands[it->first] = picojson::value(o);
+  }
+
+  picojson::value::object instances;
+  for (std::map<XW_Instance, InstanceStats>::const_iterator it =
+           instance_stats.begin(); it != instance_stats.end(); ++it) {
+    char id[16];
+    snprintf(id, sizeof(id), "%d", it->first);
+    picojson::value::object o;
+    o["posts"] = picojson::value(static_cast<double>(it->second.posts));
+    o["bytesOut"] = picojson::value(static_cast<double>(it->second.bytes_out));
+    instances[id] = picojson::value(o);
+  }
+
+  picojson::value::object queues;
+  size_t queue_count = registry.queue_count.load(std::memory_order_acquire);
+  for (size_t i = 0; i < queue_count; ++i) {
+    const QueueSlot& slot = registry.queues[i];
+    picojson::value::object o;
+    o["depth"] = picojson::value(static_cast<double>(Get(slot.depth)));
+    o["maxDepth"] = picojson::value(static_cast<double>(Get(slot.max_depth)));
+    o["dropped"] = picojson::value(static_cast<double>(Get(slot.dropped)));
+    queues[slot.name] = picojson::value(o);
+  }
+
+  picojson::value::object report;
+  report["commands"] = picojson::value(commands);
+  report["instances"] = picojson::value(instances);
+  report["queues"] = picojson::value(queues);
+  return picojson::value(report).serialize();
+}
+
+void DumpTrace() {
+  Registry& registry = GetRegistry();
+  AutoLock lock(&registry.mutex);
+  if (!registry.trace_file)
+    return;
+
+  pid_t pid = getpid();
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d", pid);
+  std::string path = std::string(registry.trace_file) + "."
+      + (registry.extension_name.empty()
+         ? "extension" : registry.extension_name) + suffix;
+  FILE* file = fopen(path.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "Can't write trace to %s.\n", path.c_str());
+    return;
+  }
+
+  fprintf(file, "{\"droppedEvents\":%llu,\"traceEvents\":[",
+          static_cast<unsigned long long>(registry.dropped_events));  // NOLINT
+  for (size_t i = 0; i < registry.trace.size(); ++i) {
+    const TraceEvent& event = registry.trace[i];
+    fprintf(file,
+            "%s{\"name\":%s,\"cat\":\"extension\",\"ph\":\"X\","
+            "\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%d}",
+            i ? "," : "", picojson::value(event.name).serialize().c_str(),
+            static_cast<unsigned long long>(event.start_us),  // NOLINT
+            static_cast<unsigned long long>(event.duration_us),  // NOLINT
+            pid, event.tid);
+  }
+  fputs("]}\n", file);
+  fclose(file);
+  registry.trace.clear();
+  registry.dropped_events = 0;
+}
+
+}  // namespace perf
+}  // namespace common
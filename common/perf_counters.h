@@ -0,0 +1,89 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef COMMON_PERF_COUNTERS_H_
+#define COMMON_PERF_COUNTERS_H_
+
+// Lightweight instrumentation shared by both extension wrappers. For every
+// command it keeps the number of calls, the bytes received and a latency
+// histogram, split in parse, handler and serialize time when the extension
+// marks those phases with ScopedPhase. It also counts the messages and bytes
+// posted to each instance, and the depth of the outbound queues and the
+// messages they refused. Recording takes no lock unless tracing is on.
+//
+// The data can be read from JavaScript with the reserved sync message
+// {"cmd":"__perf"}. If XW_EXTENSION_TRACE_FILE is set in the environment,
+// every message is also recorded as a Chrome trace event and the trace is
+// written when the extension shuts down, to that path suffixed with the
+// extension name and the process id since all extensions of a process see
+// the same variable (load it in chrome://tracing).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "common/XW_Extension.h"
+
+namespace common {
+namespace perf {
+
+enum Phase {
+  kParse,
+  kHandler,
+  kSerialize,
+  kPhaseCount
+};
+
+// Measures the handling of one incoming message, from construction to
+// destruction. The command name is taken from its "cmd" member.
+class ScopedMessage {
+ public:
+  ScopedMessage(const char* message, size_t size, bool sync);
+  ~ScopedMessage();
+
+ private:
+  friend class ScopedPhase;
+
+  ScopedMessage* parent_;
+  const char* message_;
+  size_t size_;
+  bool sync_;
+  uint64_t start_;
+  uint64_t phases_[kPhaseCount];
+};
+
+// Attributes the time spent in its scope to |phase| of the message being
+// handled on the current thread, if any.
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(Phase phase);
+  ~ScopedPhase();
+
+ private:
+  Phase phase_;
+  uint64_t start_;
+};
+
+// Names the trace file of this extension.
+void SetExtensionName(const char* name);
+
+void RecordPost(XW_Instance instance, size_t size);
+// Forgets the counters of |instance|.
+void RecordInstanceDestroyed(XW_Instance instance);
+void RecordQueueDepth(const char* queue, size_t depth);
+void RecordQueueDrop(const char* queue);
+
+bool IsPerfMessage(const char* message);
+
+// Returns the counters as a JSON object.
+std::string GetReport();
+
+// Writes the Chrome trace, if tracing was enabled.
+void DumpTrace();
+
+}  // namespace perf
+}  // namespace common
+
+#endif  // COMMON_PERF_COUNTERS_H_
@@ -101,6 +101,9 @@ namespace picojson {
     bool contains(const std::string& key) const;
     std::string to_str() const;
     template <typename Iter> void serialize(Iter os) const;
+    // Appends to |out| with bulk writes. Reusing |out| across calls keeps its
+    // capacity, so steady-state serialization doesn't allocate.
+    void serialize(std::string* out) const;
     std::string serialize() const;
   private:
     template <typename T> value(const T*); // intentionally defined to block implicit conversion of pointer to bool
@@ -259,14 +262,39 @@ namespace picojson {
     return i != u_.object_->end();
   }
   
+  inline size_t format_number(double n, char* buf, size_t size) {
+    double tmp;
+    bool integral = fabs(n) < (1ULL << 53) && modf(n, &tmp) == 0;
+    // Integers (reply ids, sizes, error codes) are by far the most common,
+    // print them without going through snprintf. -0 is left to "%.f".
+    if (integral && size > 17 && (n != 0 || !std::signbit(n))) {
+      long long i = static_cast<long long>(n);
+      unsigned long long u = i < 0 ? -i : i;
+      char digits[20];
+      size_t count = 0;
+      do {
+	digits[count++] = '0' + u % 10;
+	u /= 10;
+      } while (u);
+      size_t len = 0;
+      if (i < 0)
+	buf[len++] = '-';
+      while (count)
+	buf[len++] = digits[--count];
+      buf[len] = '\0';
+      return len;
+    }
+    int len = SNPRINTF(buf, size, integral ? "%.f" : "%.17g", n);
+    return len < 0 ? 0 : std::min(static_cast<size_t>(len), size - 1);
+  }
+  
   inline std::string value::to_str() const {
     switch (type_) {
     case null_type:      return "null";
     case boolean_type:   return u_.boolean_ ? "true" : "false";
     case number_type:    {
       char buf[256];
-      double tmp;
-      SNPRINTF(buf, sizeof(buf), fabs(u_.number_) < (1ULL << 53) && modf(u_.number_, &tmp) == 0 ? "%.f" : "%.17g", u_.number_);
+      format_number(u_.number_, buf, sizeof(buf));
       return buf;
     }
     case string_type:    return *u_.string_;
@@ -351,9 +379,104 @@ namespace picojson {
     }
   }
   
+  inline bool needs_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\' || c == '/' || c == 0x7f;
+  }
+  
+  // Same output as serialize_str(), but runs of characters that need no
+  // escaping (usually the whole string) are appended in one go.
+  inline void serialize_str(const char* s, size_t size, std::string* out) {
+    out->push_back('"');
+    const char* run = s;
+    const char* end = run + size;
+    for (const char* i = run; i != end; ++i) {
+      if (!needs_escape(*i))
+	continue;
+      out->append(run, i - run);
+      switch (*i) {
+#define MAP(val, sym) case val: out->append(sym, sizeof(sym) - 1); break
+	MAP('"', "\\\"");
+	MAP('\\', "\\\\");
+	MAP('/', "\\/");
+	MAP('\b', "\\b");
+	MAP('\f', "\\f");
+	MAP('\n', "\\n");
+	MAP('\r', "\\r");
+	MAP('\t', "\\t");
+#undef MAP
+      default: {
+	char buf[7];
+	SNPRINTF(buf, sizeof(buf), "\\u%04x", *i & 0xff);
+	out->append(buf, 6);
+	break;
+      }
+      }
+      run = i + 1;
+    }
+    out->append(run, end - run);
+    out->push_back('"');
+  }
+  
+  inline void serialize_str(const std::string& s, std::string* out) {
+    serialize_str(s.data(), s.size(), out);
+  }
+  
+  inline void value::serialize(std::string* out) const {
+    switch (type_) {
+    case null_type:
+      out->append("null", 4);
+      break;
+    case boolean_type:
+      if (u_.boolean_)
+	out->append("true", 4);
+      else
+	out->append("false", 5);
+      break;
+    case number_type: {
+      char buf[256];
+      out->append(buf, format_number(u_.number_, buf, sizeof(buf)));
+      break;
+    }
+    case string_type:
+      serialize_str(*u_.string_, out);
+      break;
+    case array_type: {
+      out->push_back('[');
+      for (array::const_iterator i = u_.array_->begin();
+           i != u_.array_->end();
+           ++i) {
+	if (i != u_.array_->begin()) {
+	  out->push_back(',');
+	}
+	i->serialize(out);
+      }
+      out->push_back(']');
+      break;
+    }
+    case object_type: {
+      out->push_back('{');
+      for (object::const_iterator i = u_.object_->begin();
+	   i != u_.object_->end();
+	   ++i) {
+	if (i != u_.object_->begin()) {
+	  out->push_back(',');
+	}
+	serialize_str(i->first, out);
+	out->push_back(':');
+	i->second.serialize(out);
+      }
+      out->push_back('}');
+      break;
+    }
+    default:
+      assert(0);
+      break;
+    }
+  }
+  
   inline std::string value::serialize() const {
     std::string s;
-    serialize(std::back_inserter(s));
+    serialize(&s);
     return s;
   }
   
@@ -387,6 +510,9 @@ namespace picojson {
       }
     }
     Iter cur() const { return cur_; }
+    // Position of the next character to be read, taking a pending ungetc()
+    // into account. Only valid for random access iterators.
+    Iter pos() const { return ungot_ ? cur_ - 1 : cur_; }
     int line() const { return line_; }
     void skip_ws() {
       while (1) {
@@ -735,6 +861,197 @@ namespace picojson {
     return err;
   }
   
+  // Non-owning, in-situ view of a JSON object. Parsing only validates the
+  // input and records where each top-level member lives in the original
+  // buffer, so it doesn't allocate per value. Members are converted to
+  // picojson::value on demand. The parsed buffer must outlive the view.
+  class object_view {
+  public:
+    struct entry {
+      const char* key;
+      size_t key_len;
+      bool key_escaped;
+      const char* raw;      // member value, as found in the buffer
+      size_t raw_len;
+      int type;
+    };
+    typedef std::vector<entry> entries;
+  protected:
+    entries entries_;
+  public:
+    object_view() {}
+    void clear() { entries_.clear(); }
+    const entries& index() const { return entries_; }
+    size_t size() const { return entries_.size(); }
+    const entry* find(const char* key, size_t len) const;
+    bool contains(const std::string& key) const;
+    const value get(const std::string& key) const;
+    bool get_raw_string(const std::string& key, const char** s, size_t* len) const;
+    bool equals(const std::string& key, const char* s, size_t len) const;
+    bool equals(const std::string& key, const char* s) const {
+      return equals(key, s, strlen(s));
+    }
+    friend bool _parse_view(object_view& out, input<const char*>& in);
+  };
+
+  inline int _view_type(int ch) {
+    switch (ch) {
+    case 'n': return null_type;
+    case 't':
+    case 'f': return boolean_type;
+    case '"': return string_type;
+    case '[': return array_type;
+    case '{': return object_type;
+    default:  return number_type;
+    }
+  }
+
+  inline const object_view::entry* object_view::find(const char* key, size_t len) const {
+    // Command messages have a handful of members, so a linear scan over the
+    // index is cheaper than hashing.
+    for (entries::const_iterator i = entries_.begin(); i != entries_.end(); ++i) {
+      if (i->key_len == len && ! i->key_escaped && memcmp(i->key, key, len) == 0) {
+        return &*i;
+      }
+    }
+    for (entries::const_iterator i = entries_.begin(); i != entries_.end(); ++i) {
+      if (i->key_escaped) {
+        value k;
+        std::string raw(i->key - 1, i->key_len + 2);
+        if (parse(k, raw.begin(), raw.end(), NULL) == raw.end()
+            && k.get<std::string>() == std::string(key, len)) {
+          return &*i;
+        }
+      }
+    }
+    return NULL;
+  }
+
+  inline bool object_view::contains(const std::string& key) const {
+    return find(key.data(), key.size()) != NULL;
+  }
+
+  inline const value object_view::get(const std::string& key) const {
+    const entry* e = find(key.data(), key.size());
+    if (! e) {
+      return value();
+    }
+    switch (e->type) {
+    case null_type:
+      return value();
+    case boolean_type:
+      return value(e->raw[0] == 't');
+    case number_type:
+      // The member is always followed by ',' or '}', which stops strtod().
+      return value(strtod(e->raw, NULL));
+    case string_type: {
+      const char* s;
+      size_t len;
+      if (get_raw_string(key, &s, &len)) {
+        return value(s, len);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+    value v;
+    parse(v, e->raw, e->raw + e->raw_len, NULL);
+    return v;
+  }
+
+  // Points |s| straight into the parsed buffer. Fails for members that are
+  // not strings or that would need unescaping.
+  inline bool object_view::get_raw_string(const std::string& key, const char** s, size_t* len) const {
+    const entry* e = find(key.data(), key.size());
+    if (! e || e->type != string_type) {
+      return false;
+    }
+    const char* first = e->raw + 1;
+    const char* last = e->raw + e->raw_len - 1;
+    if (std::find(first, last, '\\') != last) {
+      return false;
+    }
+    *s = first;
+    *len = last - first;
+    return true;
+  }
+
+  inline bool object_view::equals(const std::string& key, const char* s, size_t len) const {
+    const char* str;
+    size_t str_len;
+    if (get_raw_string(key, &str, &str_len)) {
+      return str_len == len && memcmp(str, s, len) == 0;
+    }
+    const value v = get(key);
+    return v.is<std::string>() && v.get<std::string>() == std::string(s, len);
+  }
+
+  class _counting_str {
+  public:
+    size_t n;
+    _counting_str() : n(0) {}
+    void push_back(int) { n++; }
+  };
+
+  inline bool _parse_view(object_view& out, input<const char*>& in) {
+    out.clear();
+    if (! in.expect('{')) {
+      return false;
+    }
+    if (in.expect('}')) {
+      return true;
+    }
+    do {
+      if (! in.expect('"')) {
+        return false;
+      }
+      object_view::entry e;
+      e.key = in.pos();
+      _counting_str key_chars;
+      if (! _parse_string(key_chars, in)) {
+        return false;
+      }
+      e.key_len = in.pos() - 1 - e.key;
+      // Escape sequences always decode to fewer characters than they take.
+      e.key_escaped = key_chars.n != e.key_len;
+      if (! in.expect(':')) {
+        return false;
+      }
+      in.skip_ws();
+      e.raw = in.pos();
+      null_parse_context ctx;
+      if (! _parse(ctx, in)) {
+        return false;
+      }
+      e.raw_len = in.pos() - e.raw;
+      e.type = _view_type(*e.raw);
+      out.entries_.push_back(e);
+    } while (in.expect(','));
+    return in.expect('}');
+  }
+
+  inline const char* parse_view(object_view& out, const char* first, const char* last, std::string* err) {
+    input<const char*> in(first, last);
+    if (! _parse_view(out, in)) {
+      out.clear();
+      if (err != NULL) {
+        char buf[64];
+        SNPRINTF(buf, sizeof(buf), "syntax error at line %d near: ", in.line());
+        *err = buf;
+        while (1) {
+          int ch = in.getc();
+          if (ch == -1 || ch == '\n') {
+            break;
+          } else if (ch >= ' ') {
+            err->push_back(ch);
+          }
+        }
+      }
+    }
+    return in.cur();
+  }
+  
   template <typename T> struct last_error_t {
     static std::string s;
   };
@@ -838,7 +1155,7 @@ template <typename T> void is(const T& x, const T& y, const char* name = "")
 
 int main(void)
 {
-  plan(85);
+  plan(96);
 
   // constructors
 #define TEST(expr, expected) \
@@ -1002,6 +1319,9 @@ int main(void)
 
   ok(picojson::value(3.0).serialize() == "3",
      "integral number should be serialized as a integer");
+  is(picojson::value(-9007199254740991.0).serialize(), string("-9007199254740991"),
+     "large negative integer");
+  is(picojson::value(-0.0).serialize(), string("-0"), "negative zero");
   
   {
     const char* s = "{ \"a\": [1,2], \"d\": 2 }";
@@ -1030,6 +1350,36 @@ int main(void)
     ok(v1.is<picojson::array>(), "swap (array)");
     ok(v2.is<picojson::object>(), "swap (object)");
   }
+
+  {
+    const char* s = "{ \"cmd\": \"Read\", \"fd\": 5, \"s\": \"a\\nb\", \"o\": {\"x\":[1]} }";
+    picojson::object_view v;
+    string err;
+    picojson::parse_view(v, s, s + strlen(s), &err);
+    ok(err.empty(), "object_view no error");
+    is(v.size(), size_t(4), "object_view index size");
+    ok(v.equals("cmd", "Read"), "object_view equals");
+    is(v.get("fd").get<double>(), 5.0, "object_view number");
+    is(v.get("s").get<string>(), string("a\nb"), "object_view escaped string");
+    is(v.get("o").serialize(), string("{\"x\":[1]}"), "object_view object");
+    ok(!v.contains("z") && v.get("z").is<picojson::null>(), "object_view missing member");
+  }
+
+  {
+    picojson::object o;
+    o["s"] = picojson::value(string("a\"b/\x01\tc"));
+    o["n"] = picojson::value(1.5);
+    o["a"] = picojson::value(picojson::array(2, picojson::value(true)));
+    picojson::value v(o);
+    string iter;
+    v.serialize(std::back_inserter(iter));
+    string buffer("x");
+    v.serialize(&buffer);
+    is(buffer, "x" + iter, "serialize to buffer appends");
+    buffer.clear();
+    v.serialize(&buffer);
+    is(buffer, iter, "serialize to reused buffer");
+  }
   
   return success ? 0 : 1;
 }
@@ -0,0 +1,191 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "common/task_runner.h"
+
+#include <iostream>
+
+#include "common/perf_counters.h"
+
+namespace {
+
+struct AutoLock {
+  explicit AutoLock(pthread_mutex_t* m) : m_(m) { pthread_mutex_lock(m_); }
+  ~AutoLock() { pthread_mutex_unlock(m_); }
+ private:
+  pthread_mutex_t* m_;
+};
+
+}  // namespace
+
+namespace common {
+
+const size_t TaskRunner::kDefaultMaxThreads;
+
+TaskRunner::TaskRunner(size_t max_threads)
+    : max_threads_(max_threads ? max_threads : 1),
+      idle_threads_(0),
+      shutting_down_(false) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&cond_, NULL);
+}
+
+TaskRunner::~TaskRunner() {
+  {
+    AutoLock lock(&mutex_);
+    shutting_down_ = true;
+    pthread_cond_broadcast(&cond_);
+  }
+
+  for (size_t i = 0; i < threads_.size(); ++i)
+    pthread_join(threads_[i], NULL);
+
+  // Replies already handed to the main context still point to their jobs, so
+  // only the ones that never ran are freed here.
+  for (std::deque<Job*>::iterator it = pending_.begin();
+       it != pending_.end(); ++it)
+    delete *it;
+
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+// static
+TaskRunner* TaskRunner::GetDefault() {
+  // Intentionally leaked, the workers may still be running at exit.
+  static TaskRunner* runner = new TaskRunner(kDefaultMaxThreads);
+  return runner;
+}
+
+void TaskRunner::PostTaskAndReply(const void* owner, const Closure& task,
+                                  const Closure& reply) {
+  PostJob(owner, task, reply, false);
+}
+
+void TaskRunner::PostTask(const void* owner, const Closure& task) {
+  PostJob(owner, task, Closure(), false);
+}
+
+void TaskRunner::PostUncancelableTaskAndReply(const void* owner,
+                                              const Closure& task,
+                                              const Closure& reply) {
+  PostJob(owner, task, reply, true);
+}
+
+void TaskRunner::PostJob(const void* owner, const Closure& task,
+                         const Closure& reply, bool uncancelable) {
+  Job* job = new Job;
+  job->runner = this;
+  job->owner = owner;
+  job->task = task;
+  job->reply = reply;
+  job->uncancelable = uncancelable;
+  job->canceled = false;
+
+  {
+    AutoLock lock(&mutex_);
+    if (!idle_threads_ && threads_.size() < max_threads_)
+      StartThreadLocked();
+    if (!threads_.empty()) {
+      pending_.push_back(job);
+      perf::RecordQueueDepth("task_runner", pending_.size());
+      pthread_cond_signal(&cond_);
+      return;
+    }
+  }
+
+  // Not even one worker could be started, so the job would never run.
+  job->task();
+  if (job->reply)
+    job->reply();
+  delete job;
+}
+
+void TaskRunner::CancelTasks(const void* owner) {
+  AutoLock lock(&mutex_);
+
+  std::deque<Job*>::iterator it = pending_.begin();
+  while (it != pending_.end()) {
+    if ((*it)->owner == owner && (*it)->uncancelable) {
+      // Runs anyway, without its reply.
+      (*it)->canceled = true;
+      ++it;
+    } else if ((*it)->owner == owner) {
+      delete *it;
+      it = pending_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  for (std::list<Job*>::iterator it = running_.begin();
+       it != running_.end(); ++it) {
+    if ((*it)->owner == owner)
+      (*it)->canceled = true;
+  }
+}
+
+void TaskRunner::StartThreadLocked() {
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, ThreadMain, this)) {
+    std::cerr << "Can't create worker thread.\n";
+    return;
+  }
+  threads_.push_back(thread);
+}
+
+// static
+void* TaskRunner::ThreadMain(void* data) {
+  static_cast<TaskRunner*>(data)->RunJobs();
+  return NULL;
+}
+
+void TaskRunner::RunJobs() {
+  pthread_mutex_lock(&mutex_);
+  while (true) {
+    while (pending_.empty() && !shutting_down_) {
+      idle_threads_++;
+      pthread_cond_wait(&cond_, &mutex_);
+      idle_threads_--;
+    }
+    if (shutting_down_)
+      break;
+
+    Job* job = pending_.front();
+    pending_.pop_front();
+    running_.push_back(job);
+    pthread_mutex_unlock(&mutex_);
+
+    job->task();
+
+    pthread_mutex_lock(&mutex_);
+    if (!job->reply || job->canceled) {
+      running_.remove(job);
+      delete job;
+      continue;
+    }
+    // The job stays in |running_| until its reply runs, so it can still be
+    // canceled meanwhile.
+    g_idle_add(RunReply, job);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+// static
+gboolean TaskRunner::RunReply(gpointer data) {
+  Job* job = static_cast<Job*>(data);
+  TaskRunner* runner = job->runner;
+  bool canceled;
+  {
+    AutoLock lock(&runner->mutex_);
+    runner->running_.remove(job);
+    canceled = job->canceled;
+  }
+  if (!canceled)
+    job->reply();
+  delete job;
+  return FALSE;
+}
+
+}  // namespace common
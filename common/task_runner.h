@@ -0,0 +1,88 @@
+// Copyright (c) 2013 Intel Corporation. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef COMMON_TASK_RUNNER_H_
+#define COMMON_TASK_RUNNER_H_
+
+#include <glib.h>
+#include <pthread.h>
+
+#include <deque>
+#include <functional>
+#include <list>
+#include <vector>
+
+#include "common/utils.h"
+
+namespace common {
+
+// Runs blocking work (file I/O, device enumeration, ...) on a bounded pool of
+// worker threads, so it doesn't hold up the messages of other instances and
+// API calls. Replies run on the default GLib main context, where it's safe to
+// touch the state of the instance and post messages.
+//
+// Tasks must not access the object that posted them, only copies of what
+// they need. Replies may, as long as the object calls CancelTasks() when it
+// goes away.
+class TaskRunner {
+ public:
+  typedef std::function<void()> Closure;
+
+  static const size_t kDefaultMaxThreads = 4;
+
+  explicit TaskRunner(size_t max_threads);
+  ~TaskRunner();
+
+  // Returns the pool shared by the whole extension.
+  static TaskRunner* GetDefault();
+
+  // Runs |task| on a worker thread and then |reply|, if not empty, on the
+  // main context. |owner| is only used to cancel the work, see CancelTasks().
+  void PostTaskAndReply(const void* owner, const Closure& task,
+                        const Closure& reply);
+  void PostTask(const void* owner, const Closure& task);
+  // Like PostTaskAndReply(), but CancelTasks() only drops |reply|, |task|
+  // runs all the same. For work that was already promised, like writes.
+  void PostUncancelableTaskAndReply(const void* owner, const Closure& task,
+                                    const Closure& reply);
+
+  // Drops the tasks posted by |owner| that haven't started yet, except
+  // uncancelable ones, and all the replies for it that haven't run. Tasks
+  // already running are not interrupted. Must be called from the main
+  // context.
+  void CancelTasks(const void* owner);
+
+ private:
+  struct Job {
+    TaskRunner* runner;
+    const void* owner;
+    Closure task;
+    Closure reply;
+    bool uncancelable;
+    bool canceled;
+  };
+
+  void PostJob(const void* owner, const Closure& task, const Closure& reply,
+               bool uncancelable);
+  void StartThreadLocked();
+  static void* ThreadMain(void* data);
+  static gboolean RunReply(gpointer data);
+  void RunJobs();
+
+  size_t max_threads_;
+  std::vector<pthread_t> threads_;
+  size_t idle_threads_;
+  bool shutting_down_;
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  std::deque<Job*> pending_;
+  std::list<Job*> running_;
+
+  DISALLOW_COPY_AND_ASSIGN(TaskRunner);
+};
+
+}  // namespace common
+
+#endif  // COMMON_TASK_RUNNER_H_
@@ -6,6 +6,14 @@
     {
       'target_name': 'tizen_download',
       'type': 'loadable_module',
+      'variables': {
+        'packages': [
+          'glib-2.0',
+        ],
+      },
+      'includes': [
+        '../common/pkg-config.gypi',
+      ],
       'sources': [
         'download_api.js',
         'download_context.cc',
@@ -13,12 +21,10 @@
         'download_context_desktop.cc',
         'download_context_mobile.cc',
         'download_utils.h',
+        '../common/outbound_queue.cc',
       ],
       'conditions': [
         ['extension_host_os=="mobile"', {
-          'includes': [
-            '../common/pkg-config.gypi',
-          ],
           'variables': {
             'packages': [
               'capi-appfw-application',
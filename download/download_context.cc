@@ -32,11 +32,35 @@ using download_utils::ToString;
   } \
 } while (0)
 
+common::CommandTable<DownloadContext::Handler>
+    DownloadContext::async_handlers_;
+common::CommandTable<DownloadContext::Handler>
+    DownloadContext::sync_handlers_;
+
 DownloadContext::DownloadContext(ContextAPI* api)
-    : api_(api) {
+    : api_(api),
+      outbound_queue_(api) {
+  if (async_handlers_.empty())
+    RegisterHandlers();
+}
+
+// static
+void DownloadContext::RegisterHandlers() {
+  async_handlers_.Register("DownloadStart", &DownloadContext::HandleStart);
+  async_handlers_.Register("DownloadPause", &DownloadContext::HandlePause);
+  async_handlers_.Register("DownloadResume", &DownloadContext::HandleResume);
+  async_handlers_.Register("DownloadCancel", &DownloadContext::HandleCancel);
+  async_handlers_.Register("DownloadGetNetworkType",
+                           &DownloadContext::HandleGetNetworkType);
+
+  sync_handlers_.Register("DownloadGetState",
+                          &DownloadContext::HandleGetState);
+  sync_handlers_.Register("DownloadGetMIMEType",
+                          &DownloadContext::HandleGetMIMEType);
 }
 
 DownloadContext::~DownloadContext() {
+  outbound_queue_.Clear();
   delete (api_);
   for (DownloadArgsVector::iterator it = args_.begin();
        it != args_.end(); it++) {
@@ -64,16 +88,9 @@ void DownloadContext::HandleMessage(const char* message) {
   }
 
   std::string cmd = v.get("cmd").to_str();
-  if (cmd == "DownloadStart")
-    HandleStart(v);
-  else if (cmd == "DownloadPause")
-    HandleGeneral(v, download_pause, "HandlePause");
-  else if (cmd == "DownloadResume")
-    HandleGeneral(v, download_start, "HandleResume");
-  else if (cmd == "DownloadCancel")
-    HandleGeneral(v, download_cancel, "HandleCancel");
-  else if (cmd == "DownloadGetNetworkType")
-    HandleGetNetworkType(v);
+  Handler handler;
+  if (async_handlers_.Lookup(cmd, &handler))
+    (this->*handler)(v);
   else
     fprintf(stderr, "Not supported async command %s\n", cmd.c_str());
 }
@@ -89,10 +106,9 @@ void DownloadContext::HandleSyncMessage(const char* message) {
   }
 
   std::string cmd = v.get("cmd").to_str();
-  if (cmd == "DownloadGetState")
-    HandleGetState(v);
-  else if (cmd == "DownloadGetMIMEType")
-    HandleGetMIMEType(v);
+  Handler handler;
+  if (sync_handlers_.Lookup(cmd, &handler))
+    (this->*handler)(v);
   else
     fprintf(stderr, "Not supported sync command %s\n", cmd.c_str());
 }
@@ -148,7 +164,8 @@ void DownloadContext::OnProgressInfo(int download_id,
   o["receivedSize"] = picojson::value(ToString(received));
   o["totalSize"] = picojson::value(ToString(downloadItem->file_size));
   picojson::value v(o);
-  args->context->api_->PostMessage(v.serialize().c_str());
+  // Only the latest progress of each download is worth delivering.
+  args->context->outbound_queue_.Post(args->download_uid, v.serialize());
 }
 
 void DownloadContext::OnFinishedInfo(int download_id, void* user_param) {
@@ -165,7 +182,7 @@ void DownloadContext::OnFinishedInfo(int download_id, void* user_param) {
   o["fullPath"] = picojson::value(full_path);
   o["uid"] = picojson::value(args->download_uid);
   picojson::value v(o);
-  args->context->api_->PostMessage(v.serialize().c_str());
+  args->context->outbound_queue_.Post(v.serialize());
 }
 
 void DownloadContext::OnPausedInfo(void* user_param) {
@@ -175,7 +192,7 @@ void DownloadContext::OnPausedInfo(void* user_param) {
   o["cmd"] = picojson::value("DownloadReplyPause");
   o["uid"] = picojson::value(args->download_uid);
   picojson::value v(o);
-  args->context->api_->PostMessage(v.serialize().c_str());
+  args->context->outbound_queue_.Post(v.serialize());
 }
 
 void DownloadContext::OnCanceledInfo(void* user_param) {
@@ -185,7 +202,7 @@ void DownloadContext::OnCanceledInfo(void* user_param) {
   o["cmd"] = picojson::value("DownloadReplyCancel");
   o["uid"] = picojson::value(args->download_uid);
   picojson::value v(o);
-  args->context->api_->PostMessage(v.serialize().c_str());
+  args->context->outbound_queue_.Post(v.serialize());
 }
 
 void DownloadContext::OnFailedInfo(void* user_param,
@@ -197,7 +214,7 @@ void DownloadContext::OnFailedInfo(void* user_param,
   o["uid"] = picojson::value(args->download_uid);
   o["errorCode"] = picojson::value(error);
   picojson::value v(o);
-  args->context->api_->PostMessage(v.serialize().c_str());
+  args->context->outbound_queue_.Post(v.serialize());
 }
 
 void DownloadContext::HandleStart(const picojson::value& msg) {
@@ -261,6 +278,18 @@ bool DownloadContext::HandleGeneral(const picojson::value& msg,
   return true;
 }
 
+void DownloadContext::HandlePause(const picojson::value& msg) {
+  HandleGeneral(msg, download_pause, "HandlePause");
+}
+
+void DownloadContext::HandleResume(const picojson::value& msg) {
+  HandleGeneral(msg, download_start, "HandleResume");
+}
+
+void DownloadContext::HandleCancel(const picojson::value& msg) {
+  HandleGeneral(msg, download_cancel, "HandleCancel");
+}
+
 void DownloadContext::HandleGetState(const picojson::value& msg) {
   std::string uid;
   int downloadID = -1;
@@ -279,7 +308,7 @@ void DownloadContext::HandleGetState(const picojson::value& msg) {
   o["state"] = picojson::value(EnumToPChar(state));
   o["error"] = picojson::value(retStr);
   picojson::value v(o);
-  api_->SetSyncReply(v.serialize().c_str());
+  api_->SetSyncReply(v);
 }
 
 void DownloadContext::HandleGetNetworkType(const picojson::value& msg) {
@@ -296,7 +325,7 @@ void DownloadContext::HandleGetNetworkType(const picojson::value& msg) {
   o["uid"] = picojson::value(args->download_uid);
   o["networkType"] = picojson::value(EnumToPChar(networkType));
   picojson::value v(o);
-  args->context->api_->PostMessage(v.serialize().c_str());
+  args->context->outbound_queue_.Post(v.serialize());
 }
 
 void DownloadContext::HandleGetMIMEType(const picojson::value& msg) {
@@ -318,7 +347,7 @@ void DownloadContext::HandleGetMIMEType(const picojson::value& msg) {
   }
   o["error"] = picojson::value(retStr);
   picojson::value v(o);
-  api_->SetSyncReply(v.serialize().c_str());
+  api_->SetSyncReply(v);
 
   if (mimeType)
     free(mimeType);
@@ -11,7 +11,9 @@
 #include <string>
 #include <sstream>
 
+#include "common/command_table.h"
 #include "common/extension_adapter.h"
+#include "common/outbound_queue.h"
 #include "common/utils.h"
 #include "web/download.h"
 
@@ -31,7 +33,16 @@ class DownloadContext {
   void HandleSyncMessage(const char* message);
 
  private:
+  typedef void (DownloadContext::*Handler)(const picojson::value& msg);
+
+  static void RegisterHandlers();
+  static common::CommandTable<Handler> async_handlers_;
+  static common::CommandTable<Handler> sync_handlers_;
+
   void HandleStart(const picojson::value& msg);
+  void HandlePause(const picojson::value& msg);
+  void HandleResume(const picojson::value& msg);
+  void HandleCancel(const picojson::value& msg);
   template <typename FnType>
   bool HandleGeneral(const picojson::value& msg,
                      FnType fn,
@@ -61,6 +72,7 @@ class DownloadContext {
                            const std::string& error);
 
   ContextAPI* api_;
+  common::OutboundQueue outbound_queue_;
 
   struct DownloadItem {
     std::string uid;
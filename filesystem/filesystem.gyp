@@ -6,10 +6,19 @@
     {
       'target_name': 'tizen_filesystem',
       'type': 'loadable_module',
+      'variables': {
+        'packages': [
+          'glib-2.0',
+        ],
+      },
+      'includes': [
+        '../common/pkg-config.gypi',
+      ],
       'sources': [
         'filesystem_api.js',
         'filesystem_context.cc',
         'filesystem_context.h',
+        '../common/task_runner.cc',
       ],
     },
   ],
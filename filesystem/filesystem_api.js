@@ -3,6 +3,8 @@
 // found in the LICENSE file.
 
 var _callbacks = {};
+var _progress_callbacks = {};
+var _watch_callbacks = {};
 var _next_reply_id = 0;
 
 var getNextReplyId = function() {
@@ -14,11 +16,26 @@ var postMessage = function(msg, callback) {
   _callbacks[reply_id] = callback;
   msg.reply_id = reply_id;
   extension.postMessage(JSON.stringify(msg));
+  return reply_id;
 };
 
 extension.setMessageListener(function(json) {
   var msg = JSON.parse(json);
   var reply_id = msg.reply_id;
+  if (msg.cmd === 'FileProgress') {
+    var onprogress = _progress_callbacks[reply_id];
+    if (typeof(onprogress) === 'function')
+      onprogress(msg.done, msg.total);
+    return;
+  }
+  if (msg.cmd === 'FileWatchChanges') {
+    var onchange = _watch_callbacks[msg.watch_id];
+    if (msg.removed)
+      delete _watch_callbacks[msg.watch_id];
+    if (typeof(onchange) === 'function')
+      onchange(msg.changes || null, !!msg.overflow, !!msg.removed);
+    return;
+  }
   var callback = _callbacks[reply_id];
   if (typeof(callback) === 'function') {
     callback(msg);
@@ -72,39 +89,35 @@ FileSystemManager.prototype.resolve = function(location, onsuccess,
 FileSystemManager.prototype.getStorage = function(label, onsuccess, onerror) {
   postMessage({
     cmd: 'FileSystemManagerGetStorage',
-    location: location,
-    mode: mode
+    label: label
   }, function(result) {
-    if (result.error != 0) {
-      if (onerror)
+    if (result.isError) {
+      if (typeof(onerror) === 'function')
         onerror(result);
-      else if (onsuccess)
-        onsuccess(new FileSystemStorage(result.label,
-            result.type, result.state));
+    } else if (typeof(onsuccess) === 'function') {
+      onsuccess(new FileSystemStorage(result.label, result.type,
+          result.state));
     }
   });
 };
 
 FileSystemManager.prototype.listStorages = function(onsuccess, onerror) {
   postMessage({
-    cmd: 'FileSystemManagerListStorages',
-    location: location,
-    mode: mode
+    cmd: 'FileSystemManagerListStorages'
   }, function(result) {
-    if (result.error != 0) {
-      if (onerror) {
+    if (result.isError) {
+      if (typeof(onerror) === 'function')
         onerror(result);
-      } else if (onsuccess) {
-        var storages = [];
+    } else if (typeof(onsuccess) === 'function') {
+      var storages = [];
 
-        for (var i = 0; i < result.storages.length; i++) {
-          var storage = results.storages[i];
-          storages.push(new FileSystemStorage(storage.label,
-              storage.type, storage.state));
-        }
-
-        onsuccess(storages);
+      for (var i = 0; i < result.storages.length; i++) {
+        var storage = result.storages[i];
+        storages.push(new FileSystemStorage(storage.label,
+            storage.type, storage.state));
       }
+
+      onsuccess(storages);
     }
   });
 };
@@ -138,6 +151,27 @@ function FileStream(fileDescriptor) {
   this.fileDescriptor = fileDescriptor;
 }
 
+// The position is kept by the extension. Reads and writes also take an
+// optional |position| to start at, an extension to the Tizen API that saves
+// a round trip for random access.
+Object.defineProperty(FileStream.prototype, 'position', {
+  get: function() {
+    var result = sendSyncMessage('FileStreamSeek', {
+      fileDescriptor: this.fileDescriptor
+    });
+    if (result.isError)
+      return -1;
+    return result.value;
+  },
+  set: function(position) {
+    sendSyncMessage('FileStreamSeek', {
+      fileDescriptor: this.fileDescriptor,
+      position: position
+    });
+  },
+  enumerable: true
+});
+
 FileStream.prototype.close = function() {
   sendSyncMessage('FileStreamClose', {
     fileDescriptor: this.fileDescriptor
@@ -145,57 +179,72 @@ FileStream.prototype.close = function() {
   this.fileDescriptor = -1;
 };
 
-FileStream.prototype.read = function(charCount) {
+FileStream.prototype.flush = function() {
+  return sendSyncMessage('FileStreamFlush', {
+    fileDescriptor: this.fileDescriptor
+  });
+};
+
+FileStream.prototype.read = function(charCount, position) {
   var result = sendSyncMessage('FileStreamRead', {
     fileDescriptor: this.fileDescriptor,
-    charCount: charCount
+    charCount: charCount,
+    position: position
   });
   if (result.isError)
     return '';
   return result.value;
 };
 
-FileStream.prototype.readBytes = function(byteCount) {
+FileStream.prototype.readBytes = function(byteCount, position) {
   return sendSyncMessage('FileStreamReadBytes', {
     fileDescriptor: this.fileDescriptor,
-    byteCount: byteCount
+    byteCount: byteCount,
+    position: position
   });
 };
 
-FileStream.prototype.readBase64 = function(byteCount) {
+FileStream.prototype.readBase64 = function(byteCount, position) {
   return sendSyncMessage('FileStreamReadBase64', {
     fileDescriptor: this.fileDescriptor,
-    byteCount: byteCount
+    byteCount: byteCount,
+    position: position
   });
 };
 
-FileStream.prototype.write = function(stringData) {
+FileStream.prototype.write = function(stringData, position) {
   return sendSyncMessage('FileStreamWrite', {
     fileDescriptor: this.fileDescriptor,
-    stringData: stringData
+    stringData: stringData,
+    position: position
   });
 };
 
-FileStream.prototype.writeBytes = function(byteData) {
+FileStream.prototype.writeBytes = function(byteData, position) {
   return sendSyncMessage('FileStreamWriteBytes', {
     fileDescriptor: this.fileDescriptor,
-    byteData: byteData
+    byteData: byteData,
+    position: position
   });
 };
 
-FileStream.prototype.writeBase64 = function(base64Data) {
+FileStream.prototype.writeBase64 = function(base64Data, position) {
   return sendSyncMessage('FileStreamWriteBase64', {
     fileDescriptor: this.fileDescriptor,
-    base64Data: base64Data
+    base64Data: base64Data,
+    position: position
   });
 };
 
-function File(path, parent) {
+// |status|, if given, is what FileStat would return for the file. Files
+// from a listing start with it cached and don't need to ask again right
+// away.
+function File(path, parent, status) {
   this.path = path;
   this.parent = parent;
 
-  var stat_cached = undefined;
-  var stat_last_time = undefined;
+  var stat_cached = status ? { value: status } : undefined;
+  var stat_last_time = status ? Date.now() : undefined;
 
   function getPathAndParent() {
     var _path = path.lastIndexOf('/');
@@ -317,6 +366,30 @@ File.prototype.toURI = function() {
   return null;
 };
 
+function filterToMessage(filter) {
+  if (!filter)
+    return undefined;
+  var seconds = function(date) {
+    return date instanceof Date ? date.getTime() / 1000 : undefined;
+  };
+  return {
+    name: filter.name,
+    startModified: seconds(filter.startModified),
+    endModified: seconds(filter.endModified),
+    startCreated: seconds(filter.startCreated),
+    endCreated: seconds(filter.endCreated)
+  };
+}
+
+function entriesToFiles(entries, parent) {
+  var file_list = [];
+  for (var i = 0; i < entries.length; i++) {
+    var entry = entries[i];
+    file_list.push(new File(entry.name, parent, entry));
+  }
+  return file_list;
+}
+
 File.prototype.listFiles = function(onsuccess, onerror, filter) {
   if (!(onsuccess instanceof Function))
     throw new tizen.WebAPIException(tizen.WebAPIException.TYPE_MISMATCH_ERR);
@@ -326,29 +399,177 @@ File.prototype.listFiles = function(onsuccess, onerror, filter) {
   postMessage({
     cmd: 'FileListFiles',
     path: this.path,
-    filter: filter ? filter.toString() : ''
+    stat: true,
+    filter: filterToMessage(filter)
   }, function(result) {
     if (result.isError) {
       if (!onerror || !(onerror instanceof Function))
         return;
       onerror(result);
     } else {
-      var file_list = [];
+      onsuccess(entriesToFiles(result.value, this));
+    }
+  }.bind(this));
+};
 
-      for (var i = 0; i < result.value.length; i++)
-        file_list.push(new File(result.value[i], this));
+// Extension to the Tizen API: resolves many |names| inside this directory
+// with a single call to the extension. Returns an array of File, in the same
+// order, whose attributes don't need further calls, with null for the names
+// that don't exist.
+File.prototype.statMany = function(names) {
+  if (!(names instanceof Array))
+    throw new tizen.WebAPIException(tizen.WebAPIException.TYPE_MISMATCH_ERR);
 
-      onsuccess(file_list);
+  var result = sendSyncMessage('FileStatMany', {
+    parent: this.path,
+    names: names
+  });
+  if (result.isError)
+    throw new tizen.WebAPIException(result.errorCode);
+
+  var stats = result.value;
+  var file_list = [];
+  for (var i = 0; i < names.length; i++) {
+    var flags = stats.flags[i];
+    if (stats.sizes[i] === null) {
+      file_list.push(null);
+      continue;
     }
-  }.bind(this));
+    file_list.push(new File(stats.names[i], this, {
+      size: stats.sizes[i],
+      modified: stats.modified[i],
+      created: stats.created[i],
+      isFile: !!(flags & 1),
+      isDirectory: !!(flags & 2),
+      readOnly: !!(flags & 4)
+    }));
+  }
+  return file_list;
+};
+
+// Extension to the Tizen API: lists the directory |pageSize| entries at a
+// time, so big directories don't have to be held in memory at once. |onpage|
+// gets each page as an array of File, and can return false to stop the
+// listing. |oncomplete| is called after the last page. Only the most recent
+// paged listings and searches are kept open, older ones that still have
+// pages to read fail with NotFoundError.
+File.prototype.listFilesPaged = function(pageSize, onpage, oncomplete,
+    onerror, filter) {
+  if (!(onpage instanceof Function))
+    throw new tizen.WebAPIException(tizen.WebAPIException.TYPE_MISMATCH_ERR);
+  if (typeof(filter) !== 'undefined' && !(filter instanceof FileFilter))
+    throw new tizen.WebAPIException(tizen.WebAPIException.TYPE_MISMATCH_ERR);
+
+  var onreply = function(result) {
+    if (result.isError) {
+      if (onerror instanceof Function)
+        onerror(result);
+      return;
+    }
+    var cursor = result.value.cursor;
+    var more = onpage(entriesToFiles(result.value.entries, this)) !== false;
+    if (cursor === undefined) {
+      if (oncomplete instanceof Function)
+        oncomplete();
+    } else if (more) {
+      postMessage({
+        cmd: 'FileListFilesNext',
+        cursor: cursor,
+        pageSize: pageSize
+      }, onreply);
+    } else {
+      sendSyncMessage('FileListFilesClose', { cursor: cursor });
+    }
+  }.bind(this);
+
+  postMessage({
+    cmd: 'FileListFiles',
+    path: this.path,
+    stat: true,
+    pageSize: pageSize,
+    filter: filterToMessage(filter)
+  }, onreply);
+};
+
+// Extension to the Tizen API: finds the files and directories anywhere under
+// this one that match |filter|, a FileFilter or an object with the same
+// fields plus |extensions| (an array like ['jpg', 'png']), |minSize| and
+// |maxSize|. The tree is walked by the extension and |onmatches| gets the
+// matches as arrays of File, up to |pageSize| at a time (all at once without
+// it), and can return false to stop the search. With |useIndex|, an index of
+// the tree is kept so that later searches only read the directories that
+// changed.
+File.prototype.search = function(filter, onmatches, oncomplete, onerror,
+    pageSize, useIndex) {
+  if (!(onmatches instanceof Function))
+    throw new tizen.WebAPIException(tizen.WebAPIException.TYPE_MISMATCH_ERR);
+
+  var message = filterToMessage(filter) || {};
+  if (filter) {
+    message.extensions = filter.extensions;
+    message.minSize = filter.minSize;
+    message.maxSize = filter.maxSize;
+  }
+
+  var toFiles = function(matches) {
+    var file_list = [];
+    for (var i = 0; i < matches.length; i++)
+      file_list.push(new File(matches[i].path, undefined, matches[i]));
+    return file_list;
+  };
+
+  var onreply = function(result) {
+    if (result.isError) {
+      if (onerror instanceof Function)
+        onerror(result);
+      return;
+    }
+    if (pageSize === undefined) {
+      onmatches(toFiles(result.value));
+      if (oncomplete instanceof Function)
+        oncomplete();
+      return;
+    }
+    var cursor = result.value.cursor;
+    var more = onmatches(toFiles(result.value.matches)) !== false;
+    if (cursor === undefined) {
+      if (oncomplete instanceof Function)
+        oncomplete();
+    } else if (more) {
+      postMessage({
+        cmd: 'FileSearchNext',
+        cursor: cursor,
+        pageSize: pageSize
+      }, onreply);
+    } else {
+      sendSyncMessage('FileSearchClose', { cursor: cursor });
+    }
+  };
+
+  postMessage({
+    cmd: 'FileSearch',
+    path: this.path,
+    filter: message,
+    pageSize: pageSize,
+    index: !!useIndex
+  }, onreply);
 };
 
-File.prototype.openStream = function(mode, onsuccess, onerror, encoding) {
+// |mapped| and |bufferSize| are extensions to the Tizen API. 'r' streams
+// opened with |mapped| are read from a memory mapping of the file, which saves
+// copies and system calls for big files. The file must not be truncated while
+// it's open. Writable streams opened with a |bufferSize| keep up to that many
+// bytes of writes in the extension before writing them out; call flush() to
+// write them earlier.
+File.prototype.openStream = function(mode, onsuccess, onerror, encoding,
+    mapped, bufferSize) {
   postMessage({
     cmd: 'FileOpenStream',
     filePath: this.path,
     mode: mode,
-    encoding: encoding
+    encoding: encoding,
+    mapped: mapped === true,
+    bufferSize: bufferSize
   }, function(result) {
     if (result.isError) {
       if (onerror)
@@ -361,8 +582,17 @@ File.prototype.openStream = function(mode, onsuccess, onerror, encoding) {
 
 File.prototype.readAsText = function(onsuccess, onerror, encoding) {
   var streamOpened = function(stream) {
-    onsuccess(stream.read());
+    var result = sendSyncMessage('FileStreamRead', {
+      fileDescriptor: stream.fileDescriptor,
+      readAll: true
+    });
     stream.close();
+    if (result.isError) {
+      if (onerror)
+        onerror(result);
+    } else {
+      onsuccess(result.value);
+    }
   };
   var streamError = function(error) {
     if (onerror)
@@ -373,35 +603,61 @@ File.prototype.readAsText = function(onsuccess, onerror, encoding) {
 };
 
 File.prototype.copyTo = function(originFilePath, destinationFilePath,
-    overwrite, onsuccess, onerror) {
-  var status = sendSyncMessage('FileCopyTo', {
+    overwrite, onsuccess, onerror, onprogress) {
+  var reply_id = postMessage({
+    cmd: 'FileCopyTo',
     originFilePath: originFilePath,
     destinationFilePath: destinationFilePath,
     overwrite: overwrite
+  }, function(status) {
+    delete _progress_callbacks[reply_id];
+    if (status.isError) {
+      if (onerror)
+        onerror(status);
+    } else if (onsuccess) {
+      onsuccess(status);
+    }
   });
 
-  if (status.isError) {
-    if (onerror)
-      onerror(status);
-  } else {
-    onsuccess(status);
-  }
+  if (typeof(onprogress) === 'function')
+    _progress_callbacks[reply_id] = onprogress;
+
+  // onprogress(done, total) and cancel() are extensions to the Tizen API.
+  // A canceled copy fails with ABORT_ERR.
+  return {
+    cancel: function() {
+      sendSyncMessage('FileCopyCancel', { reply_id: reply_id });
+    }
+  };
 };
 
 File.prototype.moveTo = function(originFilePath, destinationFilePath,
-    overwrite, onsuccess, onerror) {
-  var status = sendSyncMessage('FileMoveTo', {
+    overwrite, onsuccess, onerror, onprogress) {
+  var reply_id = postMessage({
+    cmd: 'FileMoveTo',
     originFilePath: originFilePath,
     destinationFilePath: destinationFilePath,
     overwrite: overwrite
+  }, function(status) {
+    delete _progress_callbacks[reply_id];
+    if (status.isError) {
+      if (onerror)
+        onerror(status);
+    } else if (onsuccess) {
+      onsuccess(status);
+    }
   });
 
-  if (status.isError) {
-    if (onerror)
-      onerror(status);
-  } else {
-    onsuccess(status);
-  }
+  // Progress is only reported when moving to another filesystem, which
+  // copies the file. Like copies, such moves can be canceled.
+  if (typeof(onprogress) === 'function')
+    _progress_callbacks[reply_id] = onprogress;
+
+  return {
+    cancel: function() {
+      sendSyncMessage('FileCopyCancel', { reply_id: reply_id });
+    }
+  };
 };
 
 File.prototype.createDirectory = function(relative) {
@@ -441,13 +697,41 @@ File.prototype.resolve = function(relative) {
   return new File(status.value);
 };
 
-File.prototype.deleteDirectory = function(directoryPath, recursive, onsuccess, onerror) {
-  postMessage({
+// Extension to the Tizen API: calls |onchange| with the entries of this
+// directory that were created, deleted or modified, as
+// { created: [names], deleted: [names], modified: [names] }. Changes are
+// batched, and an entry changed several times in a batch is listed once.
+// When changes were lost, |onchange| gets null and |overflow| is true, and
+// the directory should be listed again. |removed| is true on the last call,
+// once the directory itself is deleted or moved. Returns an id for unwatch().
+File.prototype.watch = function(onchange) {
+  if (!(onchange instanceof Function))
+    throw new tizen.WebAPIException(tizen.WebAPIException.TYPE_MISMATCH_ERR);
+
+  var status = sendSyncMessage('FileWatch', { path: this.path });
+  if (status.isError)
+    throw new tizen.WebAPIException(status.errorCode);
+
+  _watch_callbacks[status.value] = onchange;
+  return status.value;
+};
+
+File.prototype.unwatch = function(watchId) {
+  delete _watch_callbacks[watchId];
+  sendSyncMessage('FileUnwatch', { watchId: watchId });
+};
+
+// |onprogress| is an extension to the Tizen API. For recursive deletes, it's
+// called with the number of entries removed so far.
+File.prototype.deleteDirectory = function(directoryPath, recursive, onsuccess,
+    onerror, onprogress) {
+  var reply_id = postMessage({
     cmd: 'FileDeleteDirectory',
     directoryPath: directoryPath,
     path: this.path,
     recursive: !!recursive
   }, function(result) {
+    delete _progress_callbacks[reply_id];
     if (result.isError) {
       if (onerror) {
         var error = new tizen.WebAPIError(tizen.WebAPIException.UNKNOWN_ERR);
@@ -457,6 +741,33 @@ File.prototype.deleteDirectory = function(directoryPath, recursive, onsuccess, o
       onsuccess();
     }
   });
+
+  if (typeof(onprogress) === 'function')
+    _progress_callbacks[reply_id] = onprogress;
+};
+
+// Extension to the Tizen API: replaces |filePath| in this directory by the
+// string |data|, so that even after a crash it holds either its old or its
+// new contents, never part of them. |onsuccess| is called once the new
+// contents are on the storage. With |groupCommit|, writes made within a few
+// milliseconds of each other are synced together, which is much cheaper
+// than syncing each of them on flash storage, at the cost of that delay.
+File.prototype.writeAtomic = function(filePath, data, onsuccess, onerror,
+    groupCommit) {
+  postMessage({
+    cmd: 'FileWriteAtomic',
+    path: this.path,
+    filePath: filePath,
+    data: String(data),
+    groupCommit: !!groupCommit
+  }, function(result) {
+    if (result.isError) {
+      if (onerror)
+        onerror(result);
+    } else if (onsuccess) {
+      onsuccess();
+    }
+  });
 };
 
 File.prototype.deleteFile = function(filePath, onsuccess, onerror) {
@@ -4,19 +4,70 @@
 
 #include "filesystem/filesystem_context.h"
 
+#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
+#include <mntent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <vector>
+
+#include "common/base64.h"
+#include "common/perf_counters.h"
+#include "common/task_runner.h"
+
 DEFINE_XWALK_EXTENSION(FilesystemContext)
 
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
 namespace {
 const unsigned kDefaultFileMode = 0644;
 const std::string kDefaultPath = "/opt/usr/media";
 
+// A single copy_file_range() or sendfile() call moves at most this much.
+const size_t kCopyChunkSize = 8 * 1024 * 1024;
+// Used when the kernel can't copy between the two files by itself.
+const size_t kCopyBufferSize = 1024 * 1024;
+// Stream reads that don't give a count read this much.
+const size_t kDefaultReadSize = 64 * 1024;
+// Most a single stream read returns, short of reading everything.
+const size_t kMaxReadSize = 16 * 1024 * 1024;
+// Largest write buffer a stream can ask for.
+const size_t kMaxWriteBufferSize = 4 * 1024 * 1024;
+// Largest page of entries a listing can ask for.
+const double kMaxListPageSize = 65536;
+// Most paged listings and searches an instance keeps open. Past that, the
+// oldest one is closed.
+const size_t kMaxOpenCursors = 32;
+// How often the progress of running copies is posted, in milliseconds.
+const guint kCopyProgressInterval = 250;
+// How long group committed writes wait for others to share their syncs, in
+// milliseconds.
+const guint kGroupCommitInterval = 10;
+// How long changes to watched directories are collected before they're
+// posted, in milliseconds.
+const guint kWatchFlushInterval = 200;
+// A watch with more pending changes than this gets an overflow instead.
+const size_t kMaxWatchChanges = 65536;
+
 bool IsWritable(const struct stat& st) {
   if (st.st_mode & S_IWOTH)
     return true;
@@ -37,17 +88,201 @@ std::string JoinPath(const std::string& one, const std::string& another) {
   return one + "/" + another;
 }
 
+// Writes all of |data| at |offset|, or at the current offset of |fd| if it's
+// negative.
+bool WriteAll(int fd, const char* data, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t written = offset < 0
+        ? write(fd, data, size)
+        : pwrite(fd, data, size, offset);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+    if (offset >= 0)
+      offset += written;
+  }
+  return true;
+}
+
+// Defined with HandleFileWriteAtomic().
+void CommitAtomicWrites(std::vector<AtomicWrite>* writes);
+
 };  // namespace
 
+// The batches of atomic writes of an instance, committed one after the
+// other on the worker pool. It outlives the instance, so that the writes
+// left behind by it are committed after the batch still running.
+struct WriteChain {
+  WriteChain() : running(false) { pthread_mutex_init(&mutex, NULL); }
+  ~WriteChain() { pthread_mutex_destroy(&mutex); }
+
+  // Commits |batch|, then whatever was left to commit behind it. Runs on
+  // the worker pool, with |running| set.
+  void Run(std::vector<AtomicWrite>* batch) {
+    CommitAtomicWrites(batch);
+    pthread_mutex_lock(&mutex);
+    while (leftovers) {
+      std::shared_ptr<std::vector<AtomicWrite> > next;
+      next.swap(leftovers);
+      pthread_mutex_unlock(&mutex);
+      CommitAtomicWrites(next.get());
+      pthread_mutex_lock(&mutex);
+    }
+    running = false;
+    pthread_mutex_unlock(&mutex);
+  }
+
+  pthread_mutex_t mutex;
+  // Set from when a batch is posted until the chain is done with it.
+  bool running;
+  // Writes nobody waits for anymore, committed after the running batch.
+  std::shared_ptr<std::vector<AtomicWrite> > leftovers;
+};
+
+common::CommandTable<FilesystemContext::AsyncHandler>
+    FilesystemContext::async_handlers_;
+common::CommandTable<FilesystemContext::SyncHandler>
+    FilesystemContext::sync_handlers_;
+
 FilesystemContext::FilesystemContext(ContextAPI* api)
-  : api_(api) {}
+  : api_(api),
+    storages_loaded_(false),
+    mounts_fd_(-1),
+    mounts_source_(0),
+    copy_progress_timer_(0),
+    committing_writes_(false),
+    group_commit_timer_(0),
+    write_chain_(new WriteChain),
+    next_listing_cursor_(0),
+    next_watch_id_(0),
+    inotify_fd_(-1),
+    inotify_source_(0),
+    watch_flush_timer_(0) {
+  if (async_handlers_.empty())
+    RegisterHandlers();
+}
+
+// static
+void FilesystemContext::RegisterHandlers() {
+  async_handlers_.Register("FileSystemManagerResolve",
+        &FilesystemContext::HandleFileSystemManagerResolve);
+  async_handlers_.Register("FileSystemManagerGetStorage",
+        &FilesystemContext::HandleFileSystemManagerGetStorage);
+  async_handlers_.Register("FileSystemManagerListStorages",
+        &FilesystemContext::HandleFileSystemManagerListStorages);
+  async_handlers_.Register("FileOpenStream",
+        &FilesystemContext::HandleFileOpenStream);
+  async_handlers_.Register("FileDeleteDirectory",
+        &FilesystemContext::HandleFileDeleteDirectory);
+  async_handlers_.Register("FileDeleteFile",
+        &FilesystemContext::HandleFileDeleteFile);
+  async_handlers_.Register("FileListFiles",
+        &FilesystemContext::HandleFileListFiles);
+  async_handlers_.Register("FileListFilesNext",
+                           &FilesystemContext::HandleFileListFilesNext);
+  async_handlers_.Register("FileSearch",
+        &FilesystemContext::HandleFileSearch);
+  async_handlers_.Register("FileSearchNext",
+        &FilesystemContext::HandleFileSearchNext);
+  async_handlers_.Register("FileCopyTo",
+        &FilesystemContext::HandleFileCopyTo);
+  async_handlers_.Register("FileMoveTo",
+        &FilesystemContext::HandleFileMoveTo);
+  async_handlers_.Register("FileWriteAtomic",
+        &FilesystemContext::HandleFileWriteAtomic);
+
+  sync_handlers_.Register("FileSystemManagerGetMaxPathLength",
+        &FilesystemContext::HandleFileSystemManagerGetMaxPathLength);
+  sync_handlers_.Register("FileStreamClose",
+        &FilesystemContext::HandleFileStreamClose);
+  sync_handlers_.Register("FileStreamRead",
+        &FilesystemContext::HandleFileStreamRead);
+  sync_handlers_.Register("FileStreamReadBytes",
+        &FilesystemContext::HandleFileStreamReadBytes);
+  sync_handlers_.Register("FileStreamReadBase64",
+        &FilesystemContext::HandleFileStreamReadBase64);
+  sync_handlers_.Register("FileStreamWrite",
+        &FilesystemContext::HandleFileStreamWrite);
+  sync_handlers_.Register("FileStreamWriteBytes",
+        &FilesystemContext::HandleFileStreamWriteBytes);
+  sync_handlers_.Register("FileStreamWriteBase64",
+        &FilesystemContext::HandleFileStreamWriteBase64);
+  sync_handlers_.Register("FileStreamFlush",
+                          &FilesystemContext::HandleFileStreamFlush);
+  sync_handlers_.Register("FileStreamSeek",
+                          &FilesystemContext::HandleFileStreamSeek);
+  sync_handlers_.Register("FileCreateDirectory",
+        &FilesystemContext::HandleFileCreateDirectory);
+  sync_handlers_.Register("FileCreateFile",
+        &FilesystemContext::HandleFileCreateFile);
+  sync_handlers_.Register("FileResolve",
+        &FilesystemContext::HandleFileResolve);
+  sync_handlers_.Register("FileStat",
+        &FilesystemContext::HandleFileStat);
+  sync_handlers_.Register("FileStatMany",
+        &FilesystemContext::HandleFileStatMany);
+  sync_handlers_.Register("FileGetFullPath",
+        &FilesystemContext::HandleFileGetFullPath);
+  sync_handlers_.Register("FileListFilesClose",
+                          &FilesystemContext::HandleFileListFilesClose);
+  sync_handlers_.Register("FileSearchClose",
+        &FilesystemContext::HandleFileSearchClose);
+  sync_handlers_.Register("FileCopyCancel",
+        &FilesystemContext::HandleFileCopyCancel);
+  sync_handlers_.Register("FileWatch",
+        &FilesystemContext::HandleFileWatch);
+  sync_handlers_.Register("FileUnwatch",
+        &FilesystemContext::HandleFileUnwatch);
+}
 
 FilesystemContext::~FilesystemContext() {
-  std::set<int>::iterator it;
+  common::TaskRunner::GetDefault()->CancelTasks(this);
+
+  // Running copies would otherwise go on until the end.
+  for (CopyMap::iterator it = copies_.begin(); it != copies_.end(); ++it)
+    it->second->canceled = true;
+  if (copy_progress_timer_)
+    g_source_remove(copy_progress_timer_);
+
+  // Writes still waiting for their batch are committed all the same, only
+  // nobody hears about it.
+  if (group_commit_timer_)
+    g_source_remove(group_commit_timer_);
+  if (pending_writes_) {
+    std::shared_ptr<WriteChain> chain = write_chain_;
+    std::shared_ptr<WriteBatch> batch = pending_writes_;
+    pthread_mutex_lock(&chain->mutex);
+    if (chain->running) {
+      // The batch still running takes them on when it's done.
+      chain->leftovers = batch;
+      pthread_mutex_unlock(&chain->mutex);
+    } else {
+      chain->running = true;
+      pthread_mutex_unlock(&chain->mutex);
+      common::TaskRunner::GetDefault()->PostTask(NULL, [=]() {
+        chain->Run(batch.get());
+      });
+    }
+  }
+
+  StopInotify();
 
-  for (it = known_file_descriptors_.begin();
-        it != known_file_descriptors_.end(); it++)
-    close(*it);
+  if (mounts_source_)
+    g_source_remove(mounts_source_);
+  if (mounts_fd_ >= 0)
+    close(mounts_fd_);
+
+  for (StreamMap::iterator it = streams_.begin(); it != streams_.end(); ++it) {
+    Stream& stream = it->second;
+    if (stream.mapped_data)
+      munmap(const_cast<char*>(stream.mapped_data), stream.mapped_size);
+    FlushStream(it->first, stream);
+    close(it->first);
+  }
 }
 
 const char FilesystemContext::name[] = "tizen.filesystem";
@@ -59,72 +294,268 @@ const char* FilesystemContext::GetJavaScript() {
 }
 
 void FilesystemContext::HandleMessage(const char* message) {
-  picojson::value v;
+  picojson::object_view v;
 
   std::string err;
-  picojson::parse(v, message, message + strlen(message), &err);
+  {
+    common::perf::ScopedPhase phase(common::perf::kParse);
+    picojson::parse_view(v, message, message + strlen(message), &err);
+  }
   if (!err.empty()) {
     std::cout << "Ignoring message.\n";
     return;
   }
 
-  std::string cmd = v.get("cmd").to_str();
-  if (cmd == "FileSystemManagerResolve")
-    HandleFileSystemManagerResolve(v);
-  else if (cmd == "FileSystemManagerGetStorage")
-    HandleFileSystemManagerGetStorage(v);
-  else if (cmd == "FileSystemManagerListStorages")
-    HandleFileSystemManagerListStorages(v);
-  else if (cmd == "FileOpenStream")
-    HandleFileOpenStream(v);
-  else if (cmd == "FileDeleteDirectory")
-    HandleFileDeleteDirectory(v);
-  else if (cmd == "FileDeleteFile")
-    HandleFileDeleteFile(v);
-  else if (cmd == "FileListFiles")
-    HandleFileListFiles(v);
-  else if (cmd == "FileCopyTo")
-    HandleFileCopyTo(v);
-  else if (cmd == "FileMoveTo")
-    HandleFileMoveTo(v);
-  else
-    std::cout << "Ignoring unknown command: " << cmd;
+  const char* cmd;
+  size_t cmd_length;
+  AsyncHandler handler;
+  if (!v.get_raw_string("cmd", &cmd, &cmd_length)
+      || !async_handlers_.Lookup(cmd, cmd_length, &handler)) {
+    std::cout << "Ignoring unknown command: " << v.get("cmd").to_str();
+    return;
+  }
+
+  (this->*handler)(v);
+}
+
+void FilesystemContext::PostAsyncErrorReply(const picojson::object_view& msg,
+      WebApiAPIErrors error_code) {
+  PostAsyncErrorReply(msg.get("reply_id").get<double>(), error_code);
 }
 
-void FilesystemContext::PostAsyncErrorReply(const picojson::value& msg,
+void FilesystemContext::PostAsyncErrorReply(double reply_id,
       WebApiAPIErrors error_code) {
   picojson::value::object o;
   o["isError"] = picojson::value(true);
   o["errorCode"] = picojson::value(static_cast<double>(error_code));
-  o["reply_id"] = picojson::value(msg.get("reply_id").get<double>());
+  o["reply_id"] = picojson::value(reply_id);
 
-  picojson::value v(o);
-  api_->PostMessage(v.serialize().c_str());
+  api_->PostMessage(picojson::value(o));
+}
+
+void FilesystemContext::PostAsyncSuccessReply(const picojson::object_view& msg,
+      picojson::value::object& reply) {
+  PostAsyncSuccessReply(msg.get("reply_id").get<double>(), reply);
 }
 
-void FilesystemContext::PostAsyncSuccessReply(const picojson::value& msg,
+void FilesystemContext::PostAsyncSuccessReply(double reply_id,
       picojson::value::object& reply) {
   reply["isError"] = picojson::value(false);
-  reply["reply_id"] = picojson::value(msg.get("reply_id").get<double>());
+  reply["reply_id"] = picojson::value(reply_id);
 
-  picojson::value v(reply);
-  api_->PostMessage(v.serialize().c_str());
+  api_->PostMessage(picojson::value(reply));
 }
 
-void FilesystemContext::PostAsyncSuccessReply(const picojson::value& msg) {
+void FilesystemContext::PostAsyncSuccessReply(
+      const picojson::object_view& msg) {
   picojson::value::object reply;
   PostAsyncSuccessReply(msg, reply);
 }
 
-void FilesystemContext::PostAsyncSuccessReply(const picojson::value& msg,
+void FilesystemContext::PostAsyncSuccessReply(const picojson::object_view& msg,
       picojson::value& value) {
   picojson::value::object reply;
   reply["value"] = value;
   PostAsyncSuccessReply(msg, reply);
 }
 
+void FilesystemContext::RunBlockingTask(const picojson::object_view& msg,
+      const BlockingTask& task, const std::function<void()>& done) {
+  double reply_id = msg.get("reply_id").get<double>();
+  std::shared_ptr<WebApiAPIErrors> error(new WebApiAPIErrors(NO_ERROR));
+  std::shared_ptr<std::string> result(new std::string);
+
+  common::TaskRunner::GetDefault()->PostTaskAndReply(this,
+      [=]() {
+        std::string error_result;
+        common::JsonWriter writer(result.get());
+        common::JsonWriter error_writer(&error_result);
+        *error = task(&writer, &error_writer);
+        // What a failed task wrote to |result| may be partial, drop it.
+        if (*error != NO_ERROR)
+          result->swap(error_result);
+      },
+      [=]() {
+        copies_.erase(reply_id);
+        if (done)
+          done();
+        std::string* reply = api_->reply_buffer();
+        common::JsonWriter writer(reply);
+        writer.BeginObject();
+        writer.Key("isError").Bool(*error != NO_ERROR);
+        if (*error != NO_ERROR)
+          writer.Key("errorCode").Number(*error);
+        writer.Key("reply_id").Number(reply_id);
+        if (!result->empty())
+          writer.Key("value").Raw(*result);
+        writer.EndObject();
+        api_->PostMessage(reply->c_str());
+      });
+}
+
+namespace {
+
+// Mount points of removable storages: SD cards and USB drives on Tizen, and
+// media mounted by the desktop.
+const char* kRemovableMountPrefixes[] = {
+  "/opt/storage/sdcard",
+  "/opt/media/",
+  "/media/",
+  "/run/media/",
+};
+
+bool IsRemovableMount(const char* directory) {
+  for (size_t i = 0; i < G_N_ELEMENTS(kRemovableMountPrefixes); ++i) {
+    const char* prefix = kRemovableMountPrefixes[i];
+    if (!strncmp(directory, prefix, strlen(prefix)))
+      return true;
+  }
+  return false;
+}
+
+WebApiAPIErrors ResolvePath(const std::string& path, const std::string& mode,
+      bool confined, std::string* real_path) {
+  char* real_path_cstr = realpath(path.c_str(), NULL);
+  if (!real_path_cstr)
+    return errno == ENOENT || errno == ENOTDIR ? NOT_FOUND_ERR : IO_ERR;
+  *real_path = real_path_cstr;
+  free(real_path_cstr);
+
+  if (confined && real_path->find(kDefaultPath) != 0)
+    return INVALID_VALUES_ERR;
+
+  struct stat st;
+  if (stat(real_path->c_str(), &st) < 0)
+    return errno == ENOENT || errno == ENOTDIR ? NOT_FOUND_ERR : IO_ERR;
+  if (!IsWritable(st) && (mode == "w" || mode == "rw"))
+    return IO_ERR;
+  return NO_ERROR;
+}
+
+}  // namespace
+
+void FilesystemContext::LoadStorages() {
+  static const struct {
+    const char* label;
+    const char* directory;
+  } kVirtualRoots[] = {
+    { "documents", "Documents" },
+    { "images", "Images" },
+    { "music", "Sounds" },
+    { "videos", "Videos" },
+    { "downloads", "Downloads" },
+    { "ringtones", "Sounds" },
+  };
+
+  storages_.clear();
+  resolved_roots_.clear();
+
+  storages_["internal0"].path = kDefaultPath;
+  for (size_t i = 0; i < G_N_ELEMENTS(kVirtualRoots); ++i) {
+    storages_[kVirtualRoots[i].label].path =
+        JoinPath(kDefaultPath, kVirtualRoots[i].directory);
+  }
+  storages_["wgt-package"].path = "/tmp";  // FIXME
+  storages_["wgt-package"].read_only = true;
+  storages_["wgt-private"].path = "/tmp";  // FIXME
+  storages_["wgt-private-tmp"].path = "/tmp";  // FIXME
+
+  FILE* mounts = setmntent("/proc/self/mounts", "r");
+  if (mounts) {
+    int removable = 0;
+    struct mntent entry;
+    char buffer[4096];
+    while (getmntent_r(mounts, &entry, buffer, sizeof(buffer))) {
+      if (!IsRemovableMount(entry.mnt_dir))
+        continue;
+      char label[32];
+      snprintf(label, sizeof(label), "removable%d", ++removable);
+      Storage& storage = storages_[label];
+      storage.path = entry.mnt_dir;
+      storage.type = "EXTERNAL";
+      storage.read_only = hasmntopt(&entry, MNTOPT_RO) != NULL;
+      storage.confined = false;
+    }
+    endmntent(mounts);
+  }
+
+  // The kernel flags /proc/self/mounts with POLLPRI whenever something is
+  // mounted or unmounted in this namespace.
+  if (mounts_fd_ < 0) {
+    mounts_fd_ = open("/proc/self/mounts", O_RDONLY | O_CLOEXEC);
+    if (mounts_fd_ >= 0) {
+      GIOChannel* channel = g_io_channel_unix_new(mounts_fd_);
+      mounts_source_ = g_io_add_watch(channel,
+          static_cast<GIOCondition>(G_IO_PRI | G_IO_ERR), OnMountsChanged,
+          this);
+      g_io_channel_unref(channel);
+    }
+  }
+  // Without the watch there is no telling when the cache goes stale.
+  storages_loaded_ = mounts_source_ != 0;
+}
+
+// static
+gboolean FilesystemContext::OnMountsChanged(GIOChannel* channel,
+      GIOCondition condition, gpointer data) {
+  FilesystemContext* self = static_cast<FilesystemContext*>(data);
+  self->storages_loaded_ = false;
+  self->resolved_roots_.clear();
+  return TRUE;
+}
+
+const FilesystemContext::Storage* FilesystemContext::FindStorage(
+      const std::string& label) {
+  if (!storages_loaded_)
+    LoadStorages();
+  StorageMap::const_iterator it = storages_.find(label);
+  return it == storages_.end() ? NULL : &it->second;
+}
+
+// Locations are a storage label optionally followed by a path inside it, or
+// a file:// URI. The real paths of the storages themselves are cached, but
+// not those of paths inside them, which can come and go without the mount
+// table changing.
+WebApiAPIErrors FilesystemContext::ResolveLocation(const std::string& location,
+      const std::string& mode, std::string* real_path) {
+  if (location.find("file://") == 0) {
+    return ResolvePath(location.substr(sizeof("file://") - 1), mode, false,
+                       real_path);
+  }
+
+  size_t slash = location.find('/');
+  std::string label = location.substr(0, slash);
+  const Storage* storage = FindStorage(label);
+  if (!storage)
+    return INVALID_VALUES_ERR;
+  if (storage->read_only && (mode == "w" || mode == "rw"))
+    return INVALID_VALUES_ERR;
+
+  std::string key = label + " " + mode;
+  std::map<std::string, std::string>::const_iterator it =
+      resolved_roots_.find(key);
+  std::string root;
+  if (it != resolved_roots_.end()) {
+    root = it->second;
+  } else {
+    WebApiAPIErrors error = ResolvePath(storage->path, mode,
+                                        storage->confined, &root);
+    if (error != NO_ERROR)
+      return error;
+    if (storages_loaded_)
+      resolved_roots_[key] = root;
+  }
+
+  if (slash == std::string::npos) {
+    *real_path = root;
+    return NO_ERROR;
+  }
+  return ResolvePath(root + location.substr(slash), mode, storage->confined,
+                     real_path);
+}
+
 void FilesystemContext::HandleFileSystemManagerResolve(
-      const picojson::value& msg) {
+      const picojson::object_view& msg) {
   if (!msg.contains("location")) {
     PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
@@ -134,84 +565,61 @@ void FilesystemContext::HandleFileSystemManagerResolve(
     mode = "rw";
   else
     mode = msg.get("mode").to_str();
-  std::string location = msg.get("location").to_str();
-  std::string path;
-  bool check_if_inside_default = true;
-  if (location.find("documents") == 0) {
-    path = JoinPath(kDefaultPath, "Documents");
-  } else if (location.find("images") == 0) {
-    path = JoinPath(kDefaultPath, "Images");
-  } else if (location.find("music") == 0) {
-    path = JoinPath(kDefaultPath, "Sounds");
-  } else if (location.find("videos") == 0) {
-    path = JoinPath(kDefaultPath, "Videos");
-  } else if (location.find("downloads") == 0) {
-    path = JoinPath(kDefaultPath, "Downloads");
-  } else if (location.find("ringtones") == 0) {
-    path = JoinPath(kDefaultPath, "Sounds");
-  } else if (location.find("wgt-package") == 0) {
-    if (mode == "w" || mode == "rw") {
-      PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
-      return;
-    }
-    path = "/tmp";  // FIXME
-  } else if (location.find("wgt-private") == 0) {
-    path = "/tmp";  // FIXME
-  } else if (location.find("wgt-private-tmp") == 0) {
-    path = "/tmp";  // FIXME
-  } else if (location.find("file://") == 0) {
-    path = location.substr(sizeof("file://") - 1);
-    check_if_inside_default = false;
-  } else {
-    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
-    return;
-  }
 
-  char* real_path_cstr = realpath(path.c_str(), NULL);
-  if (!real_path_cstr) {
-    PostAsyncErrorReply(msg, IO_ERR);
+  std::string real_path;
+  WebApiAPIErrors error = ResolveLocation(msg.get("location").to_str(), mode,
+                                          &real_path);
+  if (error != NO_ERROR) {
+    PostAsyncErrorReply(msg, error);
     return;
   }
-  std::string real_path = std::string(real_path_cstr);
-  free(real_path_cstr);
 
-  if (check_if_inside_default && real_path.find(kDefaultPath) != 0) {
-    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
-    return;
-  }
+  picojson::value::object o;
+  o["realPath"] = picojson::value(real_path);
+  PostAsyncSuccessReply(msg, o);
+}
 
-  struct stat st;
-  if (stat(path.c_str(), &st) < 0) {
-    if (errno == ENOENT || errno == ENOTDIR)
-      PostAsyncErrorReply(msg, NOT_FOUND_ERR);
-    else
-      PostAsyncErrorReply(msg, IO_ERR);
+void FilesystemContext::HandleFileSystemManagerGetStorage(
+      const picojson::object_view& msg) {
+  if (!msg.contains("label")) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
   }
-
-  if (!IsWritable(st) && (mode == "w" || mode == "rw")) {
-    PostAsyncErrorReply(msg, IO_ERR);
+  std::string label = msg.get("label").to_str();
+  const Storage* storage = FindStorage(label);
+  if (!storage) {
+    PostAsyncErrorReply(msg, NOT_FOUND_ERR);
     return;
   }
 
   picojson::value::object o;
-  o["realPath"] = picojson::value(real_path);
+  o["label"] = picojson::value(label);
+  o["type"] = picojson::value(storage->type);
+  o["state"] = picojson::value("MOUNTED");
   PostAsyncSuccessReply(msg, o);
 }
 
-void FilesystemContext::HandleFileSystemManagerGetStorage(
-      const picojson::value& msg) {
-  // FIXME(leandro): This requires specific Tizen support.
-  PostAsyncErrorReply(msg, NOT_SUPPORTED_ERR);
-}
-
 void FilesystemContext::HandleFileSystemManagerListStorages(
-      const picojson::value& msg) {
-  // FIXME(leandro): This requires specific Tizen support.
-  PostAsyncErrorReply(msg, NOT_SUPPORTED_ERR);
+      const picojson::object_view& msg) {
+  if (!storages_loaded_)
+    LoadStorages();
+
+  picojson::value::array storages;
+  for (StorageMap::const_iterator it = storages_.begin();
+       it != storages_.end(); ++it) {
+    picojson::value::object o;
+    o["label"] = picojson::value(it->first);
+    o["type"] = picojson::value(it->second.type);
+    o["state"] = picojson::value("MOUNTED");
+    storages.push_back(picojson::value(o));
+  }
+
+  picojson::value::object o;
+  o["storages"] = picojson::value(storages);
+  PostAsyncSuccessReply(msg, o);
 }
 
-void FilesystemContext::HandleFileOpenStream(const picojson::value& msg) {
+void FilesystemContext::HandleFileOpenStream(const picojson::object_view& msg) {
   if (!msg.contains("mode")) {
     PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
@@ -220,7 +628,7 @@ void FilesystemContext::HandleFileOpenStream(const picojson::value& msg) {
   std::string mode = msg.get("mode").to_str();
   int mode_for_open = 0;
   if (mode == "a") {
-    mode_for_open = O_APPEND;
+    mode_for_open = O_APPEND | O_WRONLY;
   } else if (mode == "w") {
     mode_for_open = O_TRUNC | O_WRONLY | O_CREAT;
   } else if (mode == "rw") {
@@ -250,7 +658,34 @@ void FilesystemContext::HandleFileOpenStream(const picojson::value& msg) {
   if (fd < 0) {
     PostAsyncErrorReply(msg, IO_ERR);
   } else {
-    known_file_descriptors_.insert(fd);
+    Stream& stream = streams_[fd];
+    stream.append = mode == "a";
+    off_t position = lseek(fd, 0, stream.append ? SEEK_END : SEEK_CUR);
+    stream.seekable = position >= 0;
+    if (stream.seekable)
+      stream.position = position;
+
+    // Mapping is optional, plain reads are used if it fails. Empty files
+    // can't be mapped.
+    struct stat st;
+    if (mode == "r" && msg.get("mapped").evaluate_as_boolean()
+        && !fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        stream.mapped_data = static_cast<const char*>(data);
+        stream.mapped_size = st.st_size;
+      }
+    }
+
+    if (mode != "r" && msg.get("bufferSize").is<double>()) {
+      double buffer_size = msg.get("bufferSize").get<double>();
+      if (buffer_size > 0) {
+        stream.buffer_capacity = std::min(
+            buffer_size, static_cast<double>(kMaxWriteBufferSize));
+        stream.buffer.reserve(stream.buffer_capacity);
+      }
+    }
 
     picojson::value::object o;
     o["fileDescriptor"] = picojson::value(static_cast<double>(fd));
@@ -258,69 +693,258 @@ void FilesystemContext::HandleFileOpenStream(const picojson::value& msg) {
   }
 }
 
-static bool RecursiveDeleteDirectory(const std::string& path) {
-  DIR* dir = opendir(path.c_str());
-  if (!dir)
-    return false;
-  struct dirent entry, *buffer;
-  int fd = dirfd(dir);
-  if (fd < 0)
-    goto error;
+namespace {
 
-  while (!readdir_r(dir, &entry, &buffer)) {
-    struct stat st;
+// Directories are deleted by this many tasks at most, each taking whole
+// subdirectories of the top level one.
+const size_t kMaxDeleteTasks = common::TaskRunner::kDefaultMaxThreads;
 
-    if (!buffer)
-      break;
+// Counts of a recursive delete, shared by all the tasks working on it.
+struct DeleteCounts {
+  DeleteCounts() : removed(0), failed(0) {}
+  std::atomic<uint64_t> removed;
+  std::atomic<uint64_t> failed;
+};
+
+bool IsDirectoryEntry(int parent_fd, const struct dirent& entry) {
+  if (entry.d_type != DT_UNKNOWN)
+    return entry.d_type == DT_DIR;
+  // Not all filesystems fill d_type.
+  struct stat st;
+  return !fstatat(parent_fd, entry.d_name, &st, AT_SYMLINK_NOFOLLOW)
+      && S_ISDIR(st.st_mode);
+}
+
+void CountRemoved(DeleteCounts* counts, CopyProgress* progress) {
+  counts->removed++;
+  if (progress)
+    progress->done++;
+}
+
+// Deletes |name|, a directory inside |parent_fd|, with everything in it.
+// Walks the tree with a stack of open directories instead of recursing, and
+// only uses paths relative to them, so depth doesn't matter and symbolic
+// links are removed, never followed. Entries that can't be removed are
+// counted and skipped.
+void DeleteTree(int parent_fd, const std::string& name, DeleteCounts* counts,
+      CopyProgress* progress) {
+  struct Level {
+    DIR* directory;
+    std::string name;
+  };
+  std::vector<Level> stack;
+
+  int fd = openat(parent_fd, name.c_str(),
+                  O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  DIR* directory = fd < 0 ? NULL : fdopendir(fd);
+  if (!directory) {
+    if (fd >= 0)
+      close(fd);
+    counts->failed++;
+    return;
+  }
+  Level root = { directory, name };
+  stack.push_back(root);
+
+  struct dirent entry, *buffer;
+  while (!stack.empty()) {
+    Level& level = stack.back();
+    int level_fd = dirfd(level.directory);
+    if (readdir_r(level.directory, &entry, &buffer) || !buffer) {
+      std::string level_name = level.name;
+      closedir(level.directory);
+      stack.pop_back();
+      int dir_fd = stack.empty() ? parent_fd : dirfd(stack.back().directory);
+      if (unlinkat(dir_fd, level_name.c_str(), AT_REMOVEDIR) < 0)
+        counts->failed++;
+      else
+        CountRemoved(counts, progress);
+      continue;
+    }
     if (!strcmp(entry.d_name, ".") || !strcmp(entry.d_name, ".."))
       continue;
-    if (fstatat(fd, entry.d_name, &st, 0) < 0)
+
+    if (!IsDirectoryEntry(level_fd, entry)) {
+      if (unlinkat(level_fd, entry.d_name, 0) < 0)
+        counts->failed++;
+      else
+        CountRemoved(counts, progress);
       continue;
+    }
 
-    if (S_ISDIR(st.st_mode)) {
-      const std::string next_path = path + "/" + entry.d_name;
-      if (!RecursiveDeleteDirectory(next_path))
-        goto error;
-    } else if (unlinkat(fd, entry.d_name, 0) < 0) {
-      goto error;
+    fd = openat(level_fd, entry.d_name,
+                O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    directory = fd < 0 ? NULL : fdopendir(fd);
+    if (!directory) {
+      if (fd >= 0)
+        close(fd);
+      counts->failed++;
+      continue;
     }
+    Level next = { directory, entry.d_name };
+    stack.push_back(next);
   }
+}
 
-  closedir(dir);
-  return rmdir(path.c_str()) >= 0;
+// The subdirectories of the directory being deleted, handed out to the
+// tasks deleting it.
+class DeleteQueue {
+ public:
+  DeleteQueue(int fd, CopyProgress* progress)
+      : fd_(fd), running_(0), progress_(progress) {
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+  }
+  ~DeleteQueue() {
+    close(fd_);
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  int fd() const { return fd_; }
+  DeleteCounts* counts() { return &counts_; }
+  size_t size() const { return names_.size(); }
+
+  // Not thread safe, only used before the work is shared.
+  void Add(const char* name) { names_.push_back(name); }
+
+  // Deletes subdirectories until there are none left.
+  void Run() {
+    pthread_mutex_lock(&mutex_);
+    while (!names_.empty()) {
+      std::string name = names_.back();
+      names_.pop_back();
+      running_++;
+      pthread_mutex_unlock(&mutex_);
+
+      DeleteTree(fd_, name, &counts_, progress_);
+
+      pthread_mutex_lock(&mutex_);
+      if (!--running_)
+        pthread_cond_broadcast(&cond_);
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
 
- error:
-  closedir(dir);
-  return false;
+  // Returns once every subdirectory was deleted, or failed to.
+  void Wait() {
+    pthread_mutex_lock(&mutex_);
+    while (!names_.empty() || running_)
+      pthread_cond_wait(&cond_, &mutex_);
+    pthread_mutex_unlock(&mutex_);
+  }
+
+ private:
+  int fd_;
+  std::vector<std::string> names_;
+  size_t running_;
+  DeleteCounts counts_;
+  CopyProgress* progress_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+};
+
+// Deletes |path| and everything in it. Files at the top level are removed
+// right away, then its subdirectories are split between the calling task
+// and up to kMaxDeleteTasks - 1 more on the worker pool. Those may start
+// late or not at all (the pool is shared, and |owner| may cancel them), so
+// the calling task keeps taking subdirectories until none are left and
+// only then waits for the others.
+//
+// Returns false if anything couldn't be removed. |result|, or |error_result|
+// when returning false, gets the number of entries removed and of those that
+// failed.
+bool DeleteDirectoryTree(const std::string& path, const void* owner,
+      std::shared_ptr<CopyProgress> progress, common::JsonWriter* result,
+      common::JsonWriter* error_result) {
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  DIR* directory = fdopendir(dup(fd));
+  if (!directory) {
+    close(fd);
+    return false;
+  }
+
+  std::shared_ptr<DeleteQueue> queue(new DeleteQueue(fd, progress.get()));
+  DeleteCounts* counts = queue->counts();
+  struct dirent entry, *buffer;
+  while (!readdir_r(directory, &entry, &buffer) && buffer) {
+    if (!strcmp(entry.d_name, ".") || !strcmp(entry.d_name, ".."))
+      continue;
+    if (IsDirectoryEntry(fd, entry))
+      queue->Add(entry.d_name);
+    else if (unlinkat(fd, entry.d_name, 0) < 0)
+      counts->failed++;
+    else
+      CountRemoved(counts, progress.get());
+  }
+  closedir(directory);
+
+  // Helpers hold on to the queue and the progress, they may outlive this
+  // call.
+  size_t helpers = queue->size() > 1
+      ? std::min(queue->size(), kMaxDeleteTasks) - 1 : 0;
+  for (size_t i = 0; i < helpers; ++i) {
+    common::TaskRunner::GetDefault()->PostTask(owner, [queue, progress]() {
+      queue->Run();
+    });
+  }
+  queue->Run();
+  queue->Wait();
+
+  if (rmdir(path.c_str()) < 0)
+    counts->failed++;
+  else
+    CountRemoved(counts, progress.get());
+
+  common::JsonWriter* writer = counts->failed ? error_result : result;
+  writer->BeginObject();
+  writer->Key("removed").Number(counts->removed);
+  writer->Key("failed").Number(counts->failed);
+  writer->EndObject();
+  return !counts->failed;
 }
 
-void FilesystemContext::HandleFileDeleteDirectory(const picojson::value& msg) {
+}  // namespace
+
+// Recursive deletes report progress like copies, with the number of entries
+// removed so far as |done| and no |total|. If some entries can't be
+// removed, the rest is deleted anyway and the error reply has the counts.
+void FilesystemContext::HandleFileDeleteDirectory(
+      const picojson::object_view& msg) {
   bool recursive = msg.get("recursive").evaluate_as_boolean();
 
-  if (!msg.contains("path")) {
+  if (!msg.contains("path") || !msg.contains("directoryPath")) {
     PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
   }
-  std::string path = msg.get("path").to_str();
-  if (!IsValidPathComponent(path))  {
+  std::string root_path = msg.get("path").to_str();
+  std::string relative_path = msg.get("directoryPath").to_str();
+  std::string path = JoinPath(root_path, relative_path);
+  if (path.empty()) {
     PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
   }
 
-  if (recursive) {
-    if (!RecursiveDeleteDirectory(path)) {
-      PostAsyncErrorReply(msg, IO_ERR);
-      return;
-    }
-  } else if (rmdir(path.c_str()) < 0) {
-    PostAsyncErrorReply(msg, IO_ERR);
+  if (!recursive) {
+    RunBlockingTask(msg, [=](common::JsonWriter*, common::JsonWriter*) {
+      return rmdir(path.c_str()) < 0 ? IO_ERR : NO_ERROR;
+    });
     return;
   }
 
-  PostAsyncSuccessReply(msg);
+  std::shared_ptr<CopyProgress> progress =
+      StartCopy(msg.get("reply_id").get<double>());
+  const void* owner = this;
+  RunBlockingTask(msg, [=](common::JsonWriter* result,
+                           common::JsonWriter* error_result) {
+    return DeleteDirectoryTree(path, owner, progress, result, error_result)
+        ? NO_ERROR : IO_ERR;
+  });
 }
 
-void FilesystemContext::HandleFileDeleteFile(const picojson::value& msg) {
+void FilesystemContext::HandleFileDeleteFile(const picojson::object_view& msg) {
   if (!msg.contains("path") || !msg.contains("filePath")) {
     PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
@@ -353,7 +977,171 @@ void FilesystemContext::HandleFileDeleteFile(const picojson::value& msg) {
   }
 }
 
-void FilesystemContext::HandleFileListFiles(const picojson::value& msg) {
+// FileFilter: a case insensitive name pattern where '%' matches any run of
+// characters, and ranges of modification and creation times in seconds.
+struct EntryFilter {
+  EntryFilter()
+      : start_modified(-HUGE_VAL), end_modified(HUGE_VAL),
+        start_created(-HUGE_VAL), end_created(HUGE_VAL) {}
+
+  bool HasTimes() const {
+    return start_modified != -HUGE_VAL || end_modified != HUGE_VAL
+        || start_created != -HUGE_VAL || end_created != HUGE_VAL;
+  }
+  bool MatchesTimes(double modified, double created) const {
+    return modified >= start_modified && modified <= end_modified
+        && created >= start_created && created <= end_created;
+  }
+
+  std::string name_pattern;
+  double start_modified;
+  double end_modified;
+  double start_created;
+  double end_created;
+};
+
+struct DirectoryListing {
+  explicit DirectoryListing(const std::string& path)
+      : path(path), directory(NULL), with_stat(false), done(false),
+        busy(false) {}
+  ~DirectoryListing() {
+    if (directory)
+      closedir(directory);
+  }
+
+  std::string path;
+  // Opened when the first page is read.
+  DIR* directory;
+
+  // Entries are objects with the same fields as a FileStat reply and a
+  // "name", instead of plain names.
+  bool with_stat;
+  EntryFilter filter;
+
+  // Set by the worker once there is nothing left to read.
+  bool done;
+  // Only used on the main context, a page is being read.
+  bool busy;
+};
+
+namespace {
+
+bool MatchesNamePattern(const char* pattern, const char* name) {
+  // Backtracks to the last '%' on a mismatch.
+  const char* star = NULL;
+  const char* star_name = NULL;
+  while (*name) {
+    if (*pattern == '%') {
+      star = ++pattern;
+      star_name = name;
+    } else if (tolower(static_cast<unsigned char>(*pattern))
+               == tolower(static_cast<unsigned char>(*name))) {
+      pattern++;
+      name++;
+    } else if (star) {
+      pattern = star;
+      name = ++star_name;
+    } else {
+      return false;
+    }
+  }
+  while (*pattern == '%')
+    pattern++;
+  return !*pattern;
+}
+
+void ReadEntryFilter(const picojson::value& value, EntryFilter* filter) {
+  if (!value.is<picojson::object>())
+    return;
+  if (value.get("name").is<std::string>())
+    filter->name_pattern = value.get("name").get<std::string>();
+  if (value.get("startModified").is<double>())
+    filter->start_modified = value.get("startModified").get<double>();
+  if (value.get("endModified").is<double>())
+    filter->end_modified = value.get("endModified").get<double>();
+  if (value.get("startCreated").is<double>())
+    filter->start_created = value.get("startCreated").get<double>();
+  if (value.get("endCreated").is<double>())
+    filter->end_created = value.get("endCreated").get<double>();
+}
+
+void ReadListingOptions(const picojson::object_view& msg,
+      DirectoryListing* listing) {
+  listing->with_stat = msg.get("stat").evaluate_as_boolean();
+  ReadEntryFilter(msg.get("filter"), &listing->filter);
+}
+
+// Writes up to |page_size| entries of |listing| as an array. Runs on the
+// worker pool.
+WebApiAPIErrors ReadDirectoryPage(DirectoryListing* listing, size_t page_size,
+      common::JsonWriter* entries) {
+  if (!listing->directory) {
+    listing->directory = opendir(listing->path.c_str());
+    if (!listing->directory) {
+      listing->done = true;
+      return IO_ERR;
+    }
+  }
+
+  const EntryFilter& filter = listing->filter;
+  bool filter_times = filter.HasTimes();
+  int fd = dirfd(listing->directory);
+
+  entries->BeginArray();
+  size_t count = 0;
+  struct dirent entry, *buffer;
+  while (count < page_size) {
+    if (readdir_r(listing->directory, &entry, &buffer) || !buffer) {
+      listing->done = true;
+      break;
+    }
+    if (!strcmp(entry.d_name, ".") || !strcmp(entry.d_name, ".."))
+      continue;
+    if (!filter.name_pattern.empty()
+        && !MatchesNamePattern(filter.name_pattern.c_str(), entry.d_name))
+      continue;
+
+    if (!listing->with_stat && !filter_times) {
+      entries->String(entry.d_name);
+      count++;
+      continue;
+    }
+
+    // Entries removed since readdir() are skipped.
+    struct stat st;
+    if (fstatat(fd, entry.d_name, &st, 0) < 0)
+      continue;
+    if (!filter.MatchesTimes(st.st_mtime, st.st_ctime))
+      continue;
+
+    if (!listing->with_stat) {
+      entries->String(entry.d_name);
+    } else {
+      entries->BeginObject();
+      entries->Key("name").String(entry.d_name);
+      entries->Key("size").Number(st.st_size);
+      entries->Key("modified").Number(st.st_mtime);
+      entries->Key("created").Number(st.st_ctime);
+      entries->Key("readOnly").Bool(!IsWritable(st));
+      entries->Key("isFile").Bool(S_ISREG(st.st_mode));
+      entries->Key("isDirectory").Bool(S_ISDIR(st.st_mode));
+      entries->EndObject();
+    }
+    count++;
+  }
+  entries->EndArray();
+  return NO_ERROR;
+}
+
+}  // namespace
+
+// Without "pageSize", the reply value is the array of entries. With it, the
+// value is {"entries": [...], "cursor": n}, and FileListFilesNext with that
+// cursor gets the next page. The cursor is left out of the last page.
+// Listings that are not read until the end are dropped with
+// FileListFilesClose, or once kMaxOpenCursors newer listings and searches
+// were started.
+void FilesystemContext::HandleFileListFiles(const picojson::object_view& msg) {
   if (!msg.contains("path")) {
     PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
@@ -364,61 +1152,689 @@ void FilesystemContext::HandleFileListFiles(const picojson::value& msg) {
     return;
   }
 
-  DIR* directory = opendir(path.c_str());
-  if (!directory) {
-    PostAsyncErrorReply(msg, IO_ERR);
+  std::shared_ptr<DirectoryListing> listing(new DirectoryListing(path));
+  ReadListingOptions(msg, listing.get());
+
+  const picojson::value page_size = msg.get("pageSize");
+  if (!page_size.is<double>()) {
+    RunBlockingTask(msg, [=](common::JsonWriter* result, common::JsonWriter*) {
+      return ReadDirectoryPage(listing.get(),
+                               std::numeric_limits<size_t>::max(), result);
+    });
+    return;
+  }
+  if (page_size.get<double>() < 1) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
   }
 
-  picojson::value::array a;
+  CloseOldCursors();
+  double cursor = next_listing_cursor_++;
+  listings_[cursor] = listing;
+  ReadListingPage(msg, cursor, page_size.get<double>());
+}
 
-  struct dirent entry, *buffer;
-  while (!readdir_r(directory, &entry, &buffer)) {
-    if (!buffer)
-      break;
-    if (!strcmp(entry.d_name, ".") || !strcmp(entry.d_name, ".."))
-      continue;
+// Makes room for one more cursor. Abandoned listings and searches would
+// otherwise keep their directories open until the instance goes away.
+void FilesystemContext::CloseOldCursors() {
+  while (listings_.size() + searches_.size() >= kMaxOpenCursors) {
+    // Cursors only grow, so the first of each map is its oldest.
+    if (searches_.empty() || (!listings_.empty()
+        && listings_.begin()->first < searches_.begin()->first))
+      listings_.erase(listings_.begin());
+    else
+      searches_.erase(searches_.begin());
+  }
+}
 
-    a.push_back(picojson::value(entry.d_name));
+void FilesystemContext::HandleFileListFilesNext(
+      const picojson::object_view& msg) {
+  const picojson::value cursor = msg.get("cursor");
+  const picojson::value page_size = msg.get("pageSize");
+  if (!cursor.is<double>() || !page_size.is<double>()
+      || page_size.get<double>() < 1) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
+    return;
   }
 
-  closedir(directory);
+  ListingMap::iterator it = listings_.find(cursor.get<double>());
+  if (it == listings_.end()) {
+    PostAsyncErrorReply(msg, NOT_FOUND_ERR);
+    return;
+  }
+  // Pages of a listing are read one after the other.
+  if (it->second->busy) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
+    return;
+  }
+  ReadListingPage(msg, cursor.get<double>(), page_size.get<double>());
+}
 
-  picojson::value v(a);
-  PostAsyncSuccessReply(msg, v);
+void FilesystemContext::ReadListingPage(const picojson::object_view& msg,
+      double cursor, double page_size) {
+  std::shared_ptr<DirectoryListing> listing = listings_[cursor];
+  listing->busy = true;
+  size_t count = std::min(page_size, kMaxListPageSize);
+
+  RunBlockingTask(msg, [=](common::JsonWriter* result, common::JsonWriter*) {
+    std::string page;
+    common::JsonWriter page_writer(&page);
+    WebApiAPIErrors error =
+        ReadDirectoryPage(listing.get(), count, &page_writer);
+    if (error != NO_ERROR)
+      return error;
+    result->BeginObject();
+    result->Key("entries").Raw(page);
+    if (!listing->done)
+      result->Key("cursor").Number(cursor);
+    result->EndObject();
+    return NO_ERROR;
+  }, [=]() {
+    listing->busy = false;
+    if (listing->done)
+      listings_.erase(cursor);
+  });
 }
 
+void FilesystemContext::HandleFileListFilesClose(
+      const picojson::object_view& msg, std::string& reply) {
+  const picojson::value cursor = msg.get("cursor");
+  if (!cursor.is<double>()) {
+    SetSyncError(reply, INVALID_VALUES_ERR);
+    return;
+  }
 
-bool FilesystemContext::CopyAndRenameSanityChecks(const picojson::value& msg,
-      const std::string& from, const std::string& to, bool overwrite) {
-  struct stat destination_st;
-  bool destination_exists = true;
-  if (stat(to.c_str(), &destination_st) < 0) {
-    if (errno == ENOENT) {
-      destination_exists = false;
-    } else {
-      PostAsyncErrorReply(msg, IO_ERR);
+  // A page still being read keeps the directory open until it's done.
+  listings_.erase(cursor.get<double>());
+  SetSyncSuccess(reply);
+}
+
+// One entry of a searched tree, read from its directory or from the index.
+struct SearchEntry {
+  std::string name;
+  uint64_t mode;
+  // Symbolic links carry the status of their target, but the search doesn't
+  // follow them into directories.
+  bool link;
+  bool read_only;
+  uint64_t size;
+  int64_t modified;
+  int64_t created;
+};
+
+// What is known about the tree under a search root, by directory relative to
+// the root ("" for the root itself).
+struct SearchIndex {
+  struct Directory {
+    Directory() : modified(0) {}
+    // Modification time of the directory itself, in nanoseconds. 0 means
+    // the entries have to be read again.
+    int64_t modified;
+    std::vector<SearchEntry> entries;
+  };
+  typedef std::map<std::string, Directory> DirectoryMap;
+  DirectoryMap directories;
+};
+
+// An open directory of a searched tree. Its subdirectories are opened
+// relative to it, so paths don't get longer with depth.
+struct SearchDirectory {
+  explicit SearchDirectory(int fd) : fd(fd) {}
+  ~SearchDirectory() { close(fd); }
+  int fd;
+};
+
+struct FileSearch {
+  explicit FileSearch(const std::string& root)
+      : root(root), root_fd(-1), min_size(-HUGE_VAL), max_size(HUGE_VAL),
+        indexed(false), position(0), use_index(false), index_changed(false), started(0),
+        done(false), busy(false) {}
+  ~FileSearch() {
+    if (root_fd >= 0)
+      close(root_fd);
+  }
+
+  std::string root;
+  // Opened when the first page is read. Directories of the tree are opened
+  // relative to it.
+  int root_fd;
+
+  EntryFilter filter;
+  // Lower case, without the dot.
+  std::vector<std::string> extensions;
+  // Only regular files match when either is given.
+  double min_size;
+  double max_size;
+
+  // Directories left to read, walked depth first. Each keeps its parent
+  // open until it was read.
+  struct Pending {
+    std::shared_ptr<SearchDirectory> parent;
+    std::string name;
+    // Relative to |root|.
+    std::string path;
+  };
+  std::vector<Pending> pending;
+  // The directory being matched, and how far. Entries read from the index
+  // only have their name and type checked, the rest is read again when
+  // they get that far, see MatchesSearch().
+  std::string directory;
+  std::shared_ptr<SearchDirectory> opened;
+  bool indexed;
+  std::vector<SearchEntry> entries;
+  size_t position;
+
+  // With "index", directories that didn't change since |index| was saved
+  // aren't read again. What the walk saw goes into |updated|, which replaces
+  // the saved index once the whole tree was walked.
+  bool use_index;
+  std::string index_file;
+  SearchIndex index;
+  SearchIndex updated;
+  bool index_changed;
+  time_t started;
+
+  // Set by the worker once the whole tree was walked.
+  bool done;
+  // Only used on the main context, a page is being read.
+  bool busy;
+};
+
+namespace {
+
+const char kSearchIndexMagic[] = "TZFSIDX1";
+
+int64_t ModificationTime(const struct stat& st) {
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000
+      + st.st_mtim.tv_nsec;
+}
+
+// Returns the file that keeps the index of the tree under |root|, or an
+// empty string without a home directory.
+std::string GetSearchIndexFile(const std::string& root) {
+  const char* home = getenv("HOME");
+  if (!home || !*home)
+    return std::string();
+  std::string directory = std::string(home) + "/.cache";
+  mkdir(directory.c_str(), 0700);
+  directory += "/tizen-filesystem-index";
+  mkdir(directory.c_str(), 0700);
+
+  std::string name;
+  for (size_t i = 0; i < root.size(); ++i) {
+    if (root[i] == '%')
+      name += "%25";
+    else if (root[i] == '/')
+      name += "%2F";
+    else
+      name += root[i];
+  }
+  return directory + "/" + name;
+}
+
+// The index is a magic string followed by 64 bit numbers in host order and
+// strings prefixed by their size. It's a cache, anything unexpected in it
+// just means the tree is read again.
+void AppendIndexNumber(std::string* out, uint64_t value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendIndexString(std::string* out, const std::string& value) {
+  AppendIndexNumber(out, value.size());
+  out->append(value);
+}
+
+class IndexReader {
+ public:
+  IndexReader(const std::string& data, size_t offset)
+      : data_(data), offset_(offset) {}
+
+  bool Number(uint64_t* value) {
+    if (data_.size() - offset_ < sizeof(*value))
+      return false;
+    memcpy(value, data_.data() + offset_, sizeof(*value));
+    offset_ += sizeof(*value);
+    return true;
+  }
+
+  bool String(std::string* value) {
+    uint64_t size;
+    if (!Number(&size) || data_.size() - offset_ < size)
       return false;
+    value->assign(data_, offset_, size);
+    offset_ += size;
+    return true;
+  }
+
+ private:
+  const std::string& data_;
+  size_t offset_;
+};
+
+bool LoadSearchIndex(const std::string& file, SearchIndex* index) {
+  int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  std::string data;
+  struct stat st;
+  if (!fstat(fd, &st)) {
+    data.resize(st.st_size);
+    size_t size = 0;
+    while (size < data.size()) {
+      ssize_t count = read(fd, &data[size], data.size() - size);
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count <= 0)
+        break;
+      size += count;
     }
+    data.resize(size);
   }
+  close(fd);
 
-  if (overwrite && !IsWritable(destination_st)) {
-    PostAsyncErrorReply(msg, IO_ERR);
+  size_t magic_size = sizeof(kSearchIndexMagic) - 1;
+  if (data.compare(0, magic_size, kSearchIndexMagic))
+    return false;
+  IndexReader reader(data, magic_size);
+  uint64_t directories;
+  if (!reader.Number(&directories))
     return false;
+  for (uint64_t i = 0; i < directories; ++i) {
+    std::string path;
+    uint64_t modified, count;
+    if (!reader.String(&path) || !reader.Number(&modified)
+        || !reader.Number(&count))
+      return false;
+    SearchIndex::Directory& directory = index->directories[path];
+    directory.modified = modified;
+    for (uint64_t j = 0; j < count; ++j) {
+      SearchEntry entry;
+      uint64_t flags, size, entry_modified, created;
+      if (!reader.String(&entry.name) || !reader.Number(&entry.mode)
+          || !reader.Number(&flags) || !reader.Number(&size)
+          || !reader.Number(&entry_modified) || !reader.Number(&created))
+        return false;
+      entry.link = flags & 1;
+      entry.read_only = flags & 2;
+      entry.size = size;
+      entry.modified = entry_modified;
+      entry.created = created;
+      directory.entries.push_back(entry);
+    }
   }
-  if (!overwrite && destination_exists) {
-    PostAsyncErrorReply(msg, IO_ERR);
+  return true;
+}
+
+// Written to a temporary file renamed over the old index, so that another
+// search never reads half of it.
+bool SaveSearchIndex(const std::string& file, const SearchIndex& index) {
+  std::string data(kSearchIndexMagic);
+  AppendIndexNumber(&data, index.directories.size());
+  for (SearchIndex::DirectoryMap::const_iterator it =
+           index.directories.begin();
+       it != index.directories.end(); ++it) {
+    const SearchIndex::Directory& directory = it->second;
+    AppendIndexString(&data, it->first);
+    AppendIndexNumber(&data, directory.modified);
+    AppendIndexNumber(&data, directory.entries.size());
+    for (size_t i = 0; i < directory.entries.size(); ++i) {
+      const SearchEntry& entry = directory.entries[i];
+      AppendIndexString(&data, entry.name);
+      AppendIndexNumber(&data, entry.mode);
+      AppendIndexNumber(&data, (entry.link ? 1 : 0) | (entry.read_only ? 2 : 0));
+      AppendIndexNumber(&data, entry.size);
+      AppendIndexNumber(&data, entry.modified);
+      AppendIndexNumber(&data, entry.created);
+    }
+  }
+
+  std::string temporary = file + ".XXXXXX";
+  int fd = mkstemp(&temporary[0]);
+  if (fd < 0)
+    return false;
+  bool saved = WriteAll(fd, data.data(), data.size(), -1);
+  close(fd);
+  if (saved && rename(temporary.c_str(), file.c_str()) < 0)
+    saved = false;
+  if (!saved)
+    unlink(temporary.c_str());
+  return saved;
+}
+
+// Reads the status of the entry |name| of the directory |fd| into |entry|.
+// Returns false if it's gone.
+bool StatSearchEntry(int fd, const char* name, SearchEntry* entry) {
+  struct stat st;
+  if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+    return false;
+  entry->link = S_ISLNK(st.st_mode);
+  if (entry->link && fstatat(fd, name, &st, 0) < 0)
     return false;
+  entry->mode = st.st_mode;
+  entry->read_only = !IsWritable(st);
+  entry->size = st.st_size;
+  entry->modified = st.st_mtime;
+  entry->created = st.st_ctime;
+  return true;
+}
+
+// Reads the entries of |pending| from the index if it didn't change since,
+// or from the directory itself, and returns the open directory. Sets
+// |indexed| if they came from the index. Directories that can't be read are
+// searched as if they were empty.
+std::shared_ptr<SearchDirectory> ReadSearchDirectory(FileSearch* search,
+      const FileSearch::Pending& pending, std::vector<SearchEntry>* entries,
+      bool* indexed) {
+  entries->clear();
+  *indexed = false;
+  const std::string& directory = pending.path;
+  int fd = pending.parent
+      ? openat(pending.parent->fd, pending.name.c_str(),
+               O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+      : dup(search->root_fd);
+  if (fd < 0)
+    return std::shared_ptr<SearchDirectory>();
+  std::shared_ptr<SearchDirectory> opened(new SearchDirectory(fd));
+
+  struct stat directory_st;
+  if (fstat(fd, &directory_st) < 0)
+    return opened;
+  int64_t modified = ModificationTime(directory_st);
+
+  if (search->use_index) {
+    SearchIndex::DirectoryMap::iterator it =
+        search->index.directories.find(directory);
+    if (it != search->index.directories.end()
+        && it->second.modified == modified && modified) {
+      *entries = it->second.entries;
+      search->updated.directories[directory].entries.swap(it->second.entries);
+      search->updated.directories[directory].modified = modified;
+      search->index.directories.erase(it);
+      *indexed = true;
+      return opened;
+    }
   }
 
-  if (access(from.c_str(), F_OK)) {
-    PostAsyncErrorReply(msg, NOT_FOUND_ERR);
+  int dir_fd = dup(fd);
+  DIR* dir = dir_fd < 0 ? NULL : fdopendir(dir_fd);
+  if (!dir) {
+    if (dir_fd >= 0)
+      close(dir_fd);
+    return opened;
+  }
+  struct dirent entry, *buffer;
+  while (!readdir_r(dir, &entry, &buffer) && buffer) {
+    if (!strcmp(entry.d_name, ".") || !strcmp(entry.d_name, ".."))
+      continue;
+    // Entries removed since readdir() are skipped.
+    SearchEntry result;
+    if (!StatSearchEntry(fd, entry.d_name, &result))
+      continue;
+    result.name = entry.d_name;
+    entries->push_back(result);
+  }
+  closedir(dir);
+
+  if (search->use_index) {
+    SearchIndex::Directory& indexed = search->updated.directories[directory];
+    indexed.entries = *entries;
+    // A directory changed again within the same tick wouldn't look changed
+    // to the next search. Those that were modified right before the walk
+    // started are read again next time.
+    indexed.modified =
+        directory_st.st_mtim.tv_sec < search->started - 1 ? modified : 0;
+    search->index_changed = true;
+  }
+  return opened;
+}
+
+bool MatchesSearchName(const FileSearch& search, const std::string& name) {
+  const EntryFilter& filter = search.filter;
+  if (!filter.name_pattern.empty()
+      && !MatchesNamePattern(filter.name_pattern.c_str(), name.c_str()))
     return false;
+
+  if (search.extensions.empty())
+    return true;
+  size_t dot = name.rfind('.');
+  if (dot == std::string::npos)
+    return false;
+  const char* extension = name.c_str() + dot + 1;
+  for (size_t i = 0; i < search.extensions.size(); ++i) {
+    if (!strcasecmp(extension, search.extensions[i].c_str()))
+      return true;
   }
+  return false;
+}
+
+// Checks |entry| of the directory being matched against the filter. Files
+// modified in place don't change their directory, so an entry from the
+// index has its status read again once its name matches.
+bool MatchesSearch(FileSearch* search, SearchEntry* entry) {
+  if (!MatchesSearchName(*search, entry->name))
+    return false;
+  if (search->indexed
+      && !StatSearchEntry(search->opened->fd, entry->name.c_str(), entry))
+    return false;
 
+  if (!search->filter.MatchesTimes(entry->modified, entry->created))
+    return false;
+  if (search->min_size != -HUGE_VAL || search->max_size != HUGE_VAL) {
+    if (!S_ISREG(entry->mode))
+      return false;
+    if (entry->size < search->min_size || entry->size > search->max_size)
+      return false;
+  }
   return true;
 }
 
+void ReadSearchOptions(const picojson::object_view& msg, FileSearch* search) {
+  const picojson::value filter = msg.get("filter");
+  ReadEntryFilter(filter, &search->filter);
+  if (filter.is<picojson::object>()) {
+    if (filter.get("minSize").is<double>())
+      search->min_size = filter.get("minSize").get<double>();
+    if (filter.get("maxSize").is<double>())
+      search->max_size = filter.get("maxSize").get<double>();
+    const picojson::value extensions = filter.get("extensions");
+    if (extensions.is<picojson::array>()) {
+      const picojson::array& array = extensions.get<picojson::array>();
+      for (size_t i = 0; i < array.size(); ++i) {
+        if (!array[i].is<std::string>())
+          continue;
+        std::string extension = array[i].get<std::string>();
+        if (!extension.empty() && extension[0] == '.')
+          extension.erase(0, 1);
+        search->extensions.push_back(extension);
+      }
+    }
+  }
+
+  search->use_index = msg.get("index").evaluate_as_boolean();
+}
+
+// Writes up to |page_size| matches of |search| as an array, walking the tree
+// as far as needed. Runs on the worker pool, but as a single task: matches
+// come in walk order and a page stops as soon as it's full, so there is
+// nothing to hand to other tasks without reading ahead of the app.
+WebApiAPIErrors FindSearchMatches(FileSearch* search, size_t page_size,
+      common::JsonWriter* matches) {
+  if (search->root_fd < 0) {
+    search->root_fd = open(search->root.c_str(),
+                           O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (search->root_fd < 0) {
+      search->done = true;
+      return errno == ENOENT ? NOT_FOUND_ERR : IO_ERR;
+    }
+    search->started = time(NULL);
+    if (search->use_index) {
+      search->index_file = GetSearchIndexFile(search->root);
+      if (search->index_file.empty())
+        search->use_index = false;
+      else if (!LoadSearchIndex(search->index_file, &search->index))
+        search->index.directories.clear();
+    }
+    search->pending.push_back(FileSearch::Pending());
+  }
+
+  matches->BeginArray();
+  size_t count = 0;
+  while (count < page_size) {
+    if (search->position == search->entries.size()) {
+      if (search->pending.empty()) {
+        search->done = true;
+        break;
+      }
+      FileSearch::Pending next = search->pending.back();
+      search->pending.pop_back();
+      search->directory = next.path;
+      search->opened = ReadSearchDirectory(search, next, &search->entries,
+                                           &search->indexed);
+      search->position = 0;
+
+      // Pushed backwards so that they're walked in order.
+      for (size_t i = search->entries.size(); i-- > 0; ) {
+        const SearchEntry& entry = search->entries[i];
+        if (!S_ISDIR(entry.mode) || entry.link)
+          continue;
+        FileSearch::Pending subdirectory;
+        subdirectory.parent = search->opened;
+        subdirectory.name = entry.name;
+        subdirectory.path = search->directory.empty()
+            ? entry.name
+            : search->directory + "/" + entry.name;
+        search->pending.push_back(subdirectory);
+      }
+      continue;
+    }
+
+    SearchEntry& entry = search->entries[search->position++];
+    if (!MatchesSearch(search, &entry))
+      continue;
+
+    matches->BeginObject();
+    matches->Key("path").String(search->directory.empty()
+        ? search->root + "/" + entry.name
+        : search->root + "/" + search->directory + "/" + entry.name);
+    matches->Key("name").String(entry.name);
+    matches->Key("size").Number(entry.size);
+    matches->Key("modified").Number(entry.modified);
+    matches->Key("created").Number(entry.created);
+    matches->Key("readOnly").Bool(entry.read_only);
+    matches->Key("isFile").Bool(S_ISREG(entry.mode));
+    matches->Key("isDirectory").Bool(S_ISDIR(entry.mode));
+    matches->EndObject();
+    count++;
+  }
+  matches->EndArray();
+
+  // Directories left in |index| are gone.
+  if (search->done && search->use_index
+      && (search->index_changed || !search->index.directories.empty()))
+    SaveSearchIndex(search->index_file, search->updated);
+  return NO_ERROR;
+}
+
+}  // namespace
+
+// Finds the entries under the directory in "path" that match "filter" (a
+// FileFilter, plus "extensions", "minSize" and "maxSize"), walking the whole
+// tree. Matches come in pages of "pageSize" like paged listings, or all at
+// once without it. With "index", the entries of the tree are kept in an
+// index, and later searches only read directories that changed since. The
+// status of the entries whose name matches is still read again.
+void FilesystemContext::HandleFileSearch(const picojson::object_view& msg) {
+  if (!msg.contains("path")) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
+    return;
+  }
+  std::string path = msg.get("path").to_str();
+  if (path.empty()) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
+    return;
+  }
+
+  std::shared_ptr<FileSearch> search(new FileSearch(path));
+  ReadSearchOptions(msg, search.get());
+
+  const picojson::value page_size = msg.get("pageSize");
+  if (!page_size.is<double>()) {
+    RunBlockingTask(msg, [=](common::JsonWriter* result, common::JsonWriter*) {
+      return FindSearchMatches(search.get(),
+                               std::numeric_limits<size_t>::max(), result);
+    });
+    return;
+  }
+  if (page_size.get<double>() < 1) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
+    return;
+  }
+
+  CloseOldCursors();
+  double cursor = next_listing_cursor_++;
+  searches_[cursor] = search;
+  ReadSearchPage(msg, cursor, page_size.get<double>());
+}
+
+void FilesystemContext::HandleFileSearchNext(
+      const picojson::object_view& msg) {
+  const picojson::value cursor = msg.get("cursor");
+  const picojson::value page_size = msg.get("pageSize");
+  if (!cursor.is<double>() || !page_size.is<double>()
+      || page_size.get<double>() < 1) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
+    return;
+  }
+  SearchMap::iterator it = searches_.find(cursor.get<double>());
+  if (it == searches_.end()) {
+    PostAsyncErrorReply(msg, NOT_FOUND_ERR);
+    return;
+  }
+  if (it->second->busy) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
+    return;
+  }
+  ReadSearchPage(msg, cursor.get<double>(), page_size.get<double>());
+}
+
+void FilesystemContext::ReadSearchPage(const picojson::object_view& msg,
+      double cursor, double page_size) {
+  std::shared_ptr<FileSearch> search = searches_[cursor];
+  search->busy = true;
+  size_t count = std::min(page_size, kMaxListPageSize);
+
+  RunBlockingTask(msg, [=](common::JsonWriter* result, common::JsonWriter*) {
+    std::string page;
+    common::JsonWriter page_writer(&page);
+    WebApiAPIErrors error =
+        FindSearchMatches(search.get(), count, &page_writer);
+    if (error != NO_ERROR)
+      return error;
+    result->BeginObject();
+    result->Key("matches").Raw(page);
+    if (!search->done)
+      result->Key("cursor").Number(cursor);
+    result->EndObject();
+    return NO_ERROR;
+  }, [=]() {
+    search->busy = false;
+    if (search->done)
+      searches_.erase(cursor);
+  });
+}
+
+void FilesystemContext::HandleFileSearchClose(
+      const picojson::object_view& msg, std::string& reply) {
+  const picojson::value cursor = msg.get("cursor");
+  if (!cursor.is<double>()) {
+    SetSyncError(reply, INVALID_VALUES_ERR);
+    return;
+  }
+
+  searches_.erase(cursor.get<double>());
+  SetSyncSuccess(reply);
+}
+
 namespace {
 
 class PosixFile {
@@ -427,6 +1843,12 @@ class PosixFile {
   int mode_;
   std::string path_;
   bool unlink_when_done_;
+
+  PosixFile(int fd, const std::string& path, int mode)
+      : fd_(fd)
+      , mode_(mode)
+      , path_(path)
+      , unlink_when_done_(fd >= 0) {}
  public:
   PosixFile(const std::string& path, int mode)
       : fd_(open(path.c_str(), mode, kDefaultFileMode))
@@ -435,14 +1857,33 @@ class PosixFile {
       , unlink_when_done_(mode & O_CREAT) {}
   ~PosixFile();
 
+  // Creates and opens for writing a new file with a unique name made from
+  // |path|, in the same directory. It's unlinked when done by default.
+  static PosixFile* CreateTemporary(const std::string& path);
+
   bool is_valid() { return fd_ >= 0; }
 
   void UnlinkWhenDone(bool setting) { unlink_when_done_ = setting; }
+  int fd() const { return fd_; }
+  const std::string& path() const { return path_; }
 
   ssize_t Read(char* buffer, size_t count);
   ssize_t Write(char* buffer, size_t count);
 };
 
+// static
+PosixFile* PosixFile::CreateTemporary(const std::string& path) {
+  size_t slash = path.rfind('/');
+  std::string name_template = slash == std::string::npos
+      ? "." + path + ".XXXXXX"
+      : path.substr(0, slash + 1) + "." + path.substr(slash + 1) + ".XXXXXX";
+
+  std::vector<char> name(name_template.begin(), name_template.end());
+  name.push_back('\0');
+  int fd = mkstemp(&name[0]);
+  return new PosixFile(fd, &name[0], O_RDWR | O_CREAT);
+}
+
 PosixFile::~PosixFile() {
   if (fd_ < 0)
     return;
@@ -482,9 +1923,232 @@ ssize_t PosixFile::Write(char* buffer, size_t count) {
   }
 }
 
+ssize_t CopyFileRange(int from, int to, size_t count) {
+#if defined(__NR_copy_file_range)
+  return syscall(__NR_copy_file_range, from, NULL, to, NULL, count, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// Copies one buffer worth of data, returns what was read.
+ssize_t CopyThroughBuffer(PosixFile& origin, PosixFile& destination,
+      std::vector<char>& buffer) {
+  if (buffer.empty())
+    buffer.resize(kCopyBufferSize);
+
+  ssize_t read_bytes = origin.Read(&buffer[0], buffer.size());
+  for (ssize_t done = 0; done < read_bytes; ) {
+    ssize_t written_bytes = destination.Write(&buffer[0] + done,
+                                              read_bytes - done);
+    if (written_bytes < 0)
+      return -1;
+    done += written_bytes;
+  }
+  return read_bytes;
+}
+
+enum CopyMethod {
+  COPY_CLONE,
+  COPY_FILE_RANGE,
+  COPY_SENDFILE,
+  COPY_BUFFER
+};
+
+// Copies the rest of |origin| to |destination|, letting the kernel do the
+// work when it can: a reflink shares the extents on filesystems that support
+// it, copy_file_range() can do server side or in-kernel copies and sendfile()
+// at least avoids copying through user space. Each step continues at the
+// current file offsets, so falling back in the middle of a copy is fine.
+//
+// If |progress| is given, it's updated after every step and the copy stops
+// with ECANCELED once it's canceled.
+bool CopyFileContents(PosixFile& origin, PosixFile& destination,
+      CopyProgress* progress) {
+  posix_fadvise(origin.fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  struct stat st;
+  if (progress && !fstat(origin.fd(), &st))
+    progress->total = st.st_size;
+
+  std::vector<char> buffer;
+  CopyMethod method = COPY_CLONE;
+  while (true) {
+    if (progress && progress->canceled) {
+      errno = ECANCELED;
+      return false;
+    }
+
+    ssize_t copied = -1;
+    switch (method) {
+      case COPY_CLONE:
+        copied = ioctl(destination.fd(), FICLONE, origin.fd());
+        if (!copied) {
+          if (progress)
+            progress->done = progress->total.load();
+          return true;
+        }
+        break;
+      case COPY_FILE_RANGE:
+        copied = CopyFileRange(origin.fd(), destination.fd(), kCopyChunkSize);
+        break;
+      case COPY_SENDFILE:
+        copied = sendfile(destination.fd(), origin.fd(), NULL, kCopyChunkSize);
+        break;
+      case COPY_BUFFER:
+        copied = CopyThroughBuffer(origin, destination, buffer);
+        break;
+    }
+
+    if (!copied)
+      return true;
+    if (copied > 0) {
+      if (progress)
+        progress->done += copied;
+      continue;
+    }
+    if (errno == EINTR)
+      continue;
+    if (method == COPY_BUFFER)
+      return false;
+    // Not supported for this kernel, filesystem or pair of files.
+    if (method == COPY_CLONE || errno == ENOSYS || errno == EXDEV
+        || errno == EINVAL || errno == EOPNOTSUPP || errno == ENOTTY)
+      method = static_cast<CopyMethod>(method + 1);
+    else
+      return false;
+  }
+}
+
+WebApiAPIErrors CopyAndRenameSanityChecks(const std::string& from,
+      const std::string& to, bool overwrite) {
+  struct stat destination_st;
+  bool destination_exists = true;
+  if (stat(to.c_str(), &destination_st) < 0) {
+    if (errno != ENOENT)
+      return IO_ERR;
+    destination_exists = false;
+  }
+
+  if (overwrite && destination_exists && !IsWritable(destination_st))
+    return IO_ERR;
+  if (!overwrite && destination_exists)
+    return IO_ERR;
+
+  if (access(from.c_str(), F_OK))
+    return NOT_FOUND_ERR;
+
+  return NO_ERROR;
+}
+
+// The copy goes to a temporary file next to the destination, renamed into
+// place once complete, so a failed or canceled copy leaves an existing
+// destination untouched.
+WebApiAPIErrors CopyFile(const std::string& origin_path,
+      const std::string& destination_path, bool overwrite,
+      CopyProgress* progress) {
+  if (progress && progress->canceled)
+    return ABORT_ERR;
+
+  WebApiAPIErrors error =
+      CopyAndRenameSanityChecks(origin_path, destination_path, overwrite);
+  if (error != NO_ERROR)
+    return error;
+
+  PosixFile origin(origin_path, O_RDONLY);
+  if (!origin.is_valid())
+    return IO_ERR;
+
+  std::unique_ptr<PosixFile> temporary(
+      PosixFile::CreateTemporary(destination_path));
+  if (!temporary->is_valid())
+    return IO_ERR;
+
+  if (!CopyFileContents(origin, *temporary, progress))
+    return errno == ECANCELED ? ABORT_ERR : IO_ERR;
+
+  // The copy keeps the permissions of the file it replaces.
+  struct stat st;
+  fchmod(temporary->fd(), stat(destination_path.c_str(), &st) < 0
+      ? kDefaultFileMode : st.st_mode & 07777);
+  if (rename(temporary->path().c_str(), destination_path.c_str()) < 0)
+    return IO_ERR;
+  temporary->UnlinkWhenDone(false);
+  return NO_ERROR;
+}
+
+std::string DirectoryName(const std::string& path) {
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos)
+    return ".";
+  if (slash == 0)
+    return "/";
+  return path.substr(0, slash);
+}
+
+bool SyncDirectory(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    return false;
+  bool synced = !fsync(fd);
+  close(fd);
+  return synced;
+}
+
+// rename() only works within a filesystem. Across filesystems (e.g. from the
+// internal storage to a SD card), the file is copied to a temporary file next
+// to the destination, which is synced and renamed into place so that the
+// destination never shows up half written. Only then the origin is removed.
+WebApiAPIErrors MoveFile(const std::string& origin_path,
+      const std::string& destination_path, bool overwrite,
+      CopyProgress* progress) {
+  WebApiAPIErrors error =
+      CopyAndRenameSanityChecks(origin_path, destination_path, overwrite);
+  if (error != NO_ERROR)
+    return error;
+
+  if (!rename(origin_path.c_str(), destination_path.c_str()))
+    return NO_ERROR;
+  if (errno != EXDEV)
+    return IO_ERR;
+
+  // Copying directories across filesystems is not supported.
+  struct stat st;
+  if (stat(origin_path.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+    return IO_ERR;
+  // Fail before copying anything if the origin couldn't be removed.
+  if (access(DirectoryName(origin_path).c_str(), W_OK))
+    return IO_ERR;
+
+  PosixFile origin(origin_path, O_RDONLY);
+  if (!origin.is_valid())
+    return IO_ERR;
+
+  std::unique_ptr<PosixFile> temporary(
+      PosixFile::CreateTemporary(destination_path));
+  if (!temporary->is_valid())
+    return IO_ERR;
+
+  if (!CopyFileContents(origin, *temporary, progress))
+    return errno == ECANCELED ? ABORT_ERR : IO_ERR;
+
+  fchmod(temporary->fd(), st.st_mode & 07777);
+  if (fsync(temporary->fd()) < 0)
+    return IO_ERR;
+  if (rename(temporary->path().c_str(), destination_path.c_str()) < 0)
+    return IO_ERR;
+  temporary->UnlinkWhenDone(false);
+  SyncDirectory(DirectoryName(destination_path));
+
+  if (unlink(origin_path.c_str()) < 0)
+    return IO_ERR;
+  return NO_ERROR;
+}
+
 }  // namespace
 
-void FilesystemContext::HandleFileCopyTo(const picojson::value& msg) {
+void FilesystemContext::HandleFileCopyTo(const picojson::object_view& msg) {
   if (!msg.contains("originFilePath")) {
     PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
@@ -498,108 +2162,245 @@ void FilesystemContext::HandleFileCopyTo(const picojson::value& msg) {
   std::string destination_path = msg.get("destinationFilePath").to_str();
   bool overwrite = msg.get("overwrite").evaluate_as_boolean();
 
-  if (!CopyAndRenameSanityChecks(msg, origin_path, destination_path, overwrite))
-    return;
+  std::shared_ptr<CopyProgress> progress =
+      StartCopy(msg.get("reply_id").get<double>());
+  RunBlockingTask(msg, [=](common::JsonWriter*, common::JsonWriter*) {
+    return CopyFile(origin_path, destination_path, overwrite, progress.get());
+  });
+}
 
-  PosixFile origin(origin_path, O_RDONLY);
-  if (!origin.is_valid()) {
-    PostAsyncErrorReply(msg, IO_ERR);
-    return;
+std::shared_ptr<CopyProgress> FilesystemContext::StartCopy(double reply_id) {
+  std::shared_ptr<CopyProgress> progress(new CopyProgress);
+  copies_[reply_id] = progress;
+  if (!copy_progress_timer_) {
+    copy_progress_timer_ =
+        g_timeout_add(kCopyProgressInterval, OnCopyProgressTimer, this);
   }
+  return progress;
+}
 
-  PosixFile destination(destination_path, O_WRONLY | O_CREAT | O_TRUNC);
-  if (!destination.is_valid()) {
-    PostAsyncErrorReply(msg, IO_ERR);
+// static
+gboolean FilesystemContext::OnCopyProgressTimer(gpointer data) {
+  FilesystemContext* self = static_cast<FilesystemContext*>(data);
+  if (self->copies_.empty()) {
+    self->copy_progress_timer_ = 0;
+    return FALSE;
+  }
+
+  for (CopyMap::iterator it = self->copies_.begin();
+       it != self->copies_.end(); ++it) {
+    CopyProgress& progress = *it->second;
+    uint64_t done = progress.done;
+    if (done == progress.reported)
+      continue;
+    progress.reported = done;
+
+    std::string* message = self->api_->reply_buffer();
+    common::JsonWriter writer(message);
+    writer.BeginObject();
+    writer.Key("cmd").String("FileProgress");
+    writer.Key("reply_id").Number(it->first);
+    writer.Key("done").Number(done);
+    writer.Key("total").Number(progress.total);
+    writer.EndObject();
+    self->api_->PostMessage(message->c_str());
+  }
+  return TRUE;
+}
+
+void FilesystemContext::HandleFileMoveTo(const picojson::object_view& msg) {
+  if (!msg.contains("originFilePath")) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
+    return;
+  }
+  if (!msg.contains("destinationFilePath")) {
+    PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
   }
+  std::string origin_path = msg.get("originFilePath").to_str();
+  std::string destination_path = msg.get("destinationFilePath").to_str();
+  bool overwrite = msg.get("overwrite").evaluate_as_boolean();
 
-  while (true) {
-    char buffer[512];
-    ssize_t read_bytes = origin.Read(buffer, 512);
-    if (!read_bytes)
-      break;
-    if (read_bytes < 0) {
-      PostAsyncErrorReply(msg, IO_ERR);
-      return;
+  // Usually just a rename(), but it may need to copy the whole file.
+  std::shared_ptr<CopyProgress> progress =
+      StartCopy(msg.get("reply_id").get<double>());
+  RunBlockingTask(msg, [=](common::JsonWriter*, common::JsonWriter*) {
+    return MoveFile(origin_path, destination_path, overwrite, progress.get());
+  });
+}
+
+namespace {
+
+// Replaces each file of |writes|, in order, by its new contents, so that
+// after a crash it holds either its old or its new contents. All of the
+// files are written and flushed before the first rename, and each directory
+// is synced once after all of them, so a batch costs about as much as a
+// single write.
+void CommitAtomicWrites(std::vector<AtomicWrite>* writes) {
+  std::vector<std::unique_ptr<PosixFile> > temporaries;
+  for (size_t i = 0; i < writes->size(); ++i) {
+    AtomicWrite& write = (*writes)[i];
+    temporaries.push_back(std::unique_ptr<PosixFile>(
+        PosixFile::CreateTemporary(write.path)));
+    PosixFile& temporary = *temporaries.back();
+    if (!temporary.is_valid()) {
+      write.error = errno == ENOENT ? NOT_FOUND_ERR : IO_ERR;
+      continue;
     }
 
-    if (destination.Write(buffer, read_bytes) < 0) {
-      PostAsyncErrorReply(msg, IO_ERR);
-      return;
+    // The new file keeps the permissions of the one it replaces.
+    struct stat st;
+    fchmod(temporary.fd(), stat(write.path.c_str(), &st) < 0
+        ? kDefaultFileMode : st.st_mode & 07777);
+    if (!WriteAll(temporary.fd(), write.data.data(), write.data.size(), -1)) {
+      write.error = IO_ERR;
+      continue;
+    }
+    // Starts the writeback of every file of the batch before waiting on any,
+    // so that they go to the device together.
+    sync_file_range(temporary.fd(), 0, 0, SYNC_FILE_RANGE_WRITE);
+  }
+
+  for (size_t i = 0; i < writes->size(); ++i) {
+    AtomicWrite& write = (*writes)[i];
+    if (write.error == NO_ERROR && fdatasync(temporaries[i]->fd()) < 0)
+      write.error = IO_ERR;
+  }
+
+  std::map<std::string, bool> directories;
+  for (size_t i = 0; i < writes->size(); ++i) {
+    AtomicWrite& write = (*writes)[i];
+    if (write.error != NO_ERROR)
+      continue;
+    if (rename(temporaries[i]->path().c_str(), write.path.c_str()) < 0) {
+      write.error = IO_ERR;
+      continue;
     }
+    temporaries[i]->UnlinkWhenDone(false);
+    directories[DirectoryName(write.path)] = false;
   }
 
-  destination.UnlinkWhenDone(false);
-  PostAsyncSuccessReply(msg);
+  for (std::map<std::string, bool>::iterator it = directories.begin();
+       it != directories.end(); ++it)
+    it->second = SyncDirectory(it->first);
+  for (size_t i = 0; i < writes->size(); ++i) {
+    AtomicWrite& write = (*writes)[i];
+    if (write.error == NO_ERROR && !directories[DirectoryName(write.path)])
+      write.error = IO_ERR;
+  }
 }
 
-void FilesystemContext::HandleFileMoveTo(const picojson::value& msg) {
-  if (!msg.contains("originFilePath")) {
+}  // namespace
+
+// Replaces the file "filePath" in the directory "path" by "data", through a
+// temporary file that is synced and renamed over it, so that it never shows
+// up half written. With "groupCommit", writes that come in close together
+// are committed as one batch and share their syncs. Either way, writes are
+// committed in the order they came in.
+void FilesystemContext::HandleFileWriteAtomic(
+      const picojson::object_view& msg) {
+  if (!msg.contains("path") || !msg.contains("filePath")
+      || !msg.contains("data")) {
     PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
   }
-  if (!msg.contains("destinationFilePath")) {
+  std::string full_path = JoinPath(msg.get("path").to_str(),
+                                   msg.get("filePath").to_str());
+  if (full_path.empty()) {
     PostAsyncErrorReply(msg, INVALID_VALUES_ERR);
     return;
   }
-  std::string origin_path = msg.get("originFilePath").to_str();
-  std::string destination_path = msg.get("destinationFilePath").to_str();
-  bool overwrite = msg.get("overwrite").evaluate_as_boolean();
 
-  if (!CopyAndRenameSanityChecks(msg, origin_path, destination_path, overwrite))
-    return;
+  AtomicWrite write;
+  write.reply_id = msg.get("reply_id").get<double>();
+  write.path = full_path;
+  write.data = msg.get("data").to_str();
 
-  if (rename(origin_path.c_str(), destination_path.c_str()) < 0) {
-    PostAsyncErrorReply(msg, IO_ERR);
+  if (!pending_writes_)
+    pending_writes_.reset(new WriteBatch);
+  pending_writes_->push_back(write);
+  if (committing_writes_)
     return;
+
+  // Without "groupCommit" the batch doesn't wait for more writes.
+  if (!msg.get("groupCommit").evaluate_as_boolean()) {
+    if (group_commit_timer_) {
+      g_source_remove(group_commit_timer_);
+      group_commit_timer_ = 0;
+    }
+    CommitWriteBatch();
+  } else if (!group_commit_timer_) {
+    group_commit_timer_ =
+        g_timeout_add(kGroupCommitInterval, OnGroupCommitTimer, this);
   }
+}
+
+// static
+gboolean FilesystemContext::OnGroupCommitTimer(gpointer data) {
+  FilesystemContext* self = static_cast<FilesystemContext*>(data);
+  self->group_commit_timer_ = 0;
+  self->CommitWriteBatch();
+  return FALSE;
+}
 
-  PostAsyncSuccessReply(msg);
+void FilesystemContext::CommitWriteBatch() {
+  std::shared_ptr<WriteBatch> batch;
+  batch.swap(pending_writes_);
+  committing_writes_ = true;
+
+  std::shared_ptr<WriteChain> chain = write_chain_;
+  pthread_mutex_lock(&chain->mutex);
+  chain->running = true;
+  pthread_mutex_unlock(&chain->mutex);
+
+  common::TaskRunner::GetDefault()->PostUncancelableTaskAndReply(this,
+      [=]() {
+        chain->Run(batch.get());
+      },
+      [=]() {
+        for (size_t i = 0; i < batch->size(); ++i) {
+          const AtomicWrite& write = (*batch)[i];
+          if (write.error != NO_ERROR) {
+            PostAsyncErrorReply(write.reply_id, write.error);
+          } else {
+            picojson::value::object reply;
+            PostAsyncSuccessReply(write.reply_id, reply);
+          }
+        }
+        committing_writes_ = false;
+        // Writes that came in meanwhile already waited for this batch.
+        if (pending_writes_)
+          CommitWriteBatch();
+      });
 }
 
 void FilesystemContext::HandleSyncMessage(const char* message) {
-  picojson::value v;
+  picojson::object_view v;
 
   std::string err;
-  picojson::parse(v, message, message + strlen(message), &err);
+  {
+    common::perf::ScopedPhase phase(common::perf::kParse);
+    picojson::parse_view(v, message, message + strlen(message), &err);
+  }
   if (!err.empty()) {
     std::cout << "Ignoring sync message.\n";
     return;
   }
 
-  std::string cmd = v.get("cmd").to_str();
-  std::string reply;
-  if (cmd == "FileSystemManagerGetMaxPathLength")
-    HandleFileSystemManagerGetMaxPathLength(v, reply);
-  else if (cmd == "FileStreamClose")
-    HandleFileStreamClose(v, reply);
-  else if (cmd == "FileStreamRead")
-    HandleFileStreamRead(v, reply);
-  else if (cmd == "FileStreamReadBytes")
-    HandleFileStreamReadBytes(v, reply);
-  else if (cmd == "FileStreamReadBase64")
-    HandleFileStreamReadBase64(v, reply);
-  else if (cmd == "FileStreamWrite")
-    HandleFileStreamWrite(v, reply);
-  else if (cmd == "FileStreamWriteBytes")
-    HandleFileStreamWriteBytes(v, reply);
-  else if (cmd == "FileStreamWriteBase64")
-    HandleFileStreamWriteBase64(v, reply);
-  else if (cmd == "FileCreateDirectory")
-    HandleFileCreateDirectory(v, reply);
-  else if (cmd == "FileCreateFile")
-    HandleFileCreateFile(v, reply);
-  else if (cmd == "FileResolve")
-    HandleFileResolve(v, reply);
-  else if (cmd == "FileStat")
-    HandleFileStat(v, reply);
-  else if (cmd == "FileGetFullPath")
-    HandleFileGetFullPath(v, reply);
-  else
-    std::cout << "Ignoring unknown command: " << cmd;
+  const char* cmd;
+  size_t cmd_length;
+  SyncHandler handler;
+  if (!v.get_raw_string("cmd", &cmd, &cmd_length)
+      || !sync_handlers_.Lookup(cmd, cmd_length, &handler)) {
+    std::cout << "Ignoring unknown command: " << v.get("cmd").to_str();
+    return;
+  }
 
-  if (!reply.empty())
-    api_->SetSyncReply(reply.c_str());
+  sync_reply_.clear();
+  (this->*handler)(v, sync_reply_);
+
+  if (!sync_reply_.empty())
+    api_->SetSyncReply(sync_reply_.c_str());
 }
 
 static std::string to_string(int value) {
@@ -610,7 +2411,7 @@ static std::string to_string(int value) {
 }
 
 void FilesystemContext::HandleFileSystemManagerGetMaxPathLength(
-      const picojson::value& msg, std::string& reply) {
+      const picojson::object_view& msg, std::string& reply) {
   int max_path = pathconf("/", _PC_PATH_MAX);
   if (max_path < 0)
     max_path = PATH_MAX;
@@ -619,8 +2420,35 @@ void FilesystemContext::HandleFileSystemManagerGetMaxPathLength(
   SetSyncSuccess(reply, max_path_len_str);
 }
 
-bool FilesystemContext::IsKnownFileDescriptor(int fd) {
-  return known_file_descriptors_.find(fd) != known_file_descriptors_.end();
+WebApiAPIErrors FilesystemContext::GetStream(const picojson::object_view& msg,
+      int* fd, Stream** stream) {
+  if (!msg.contains("fileDescriptor"))
+    return INVALID_VALUES_ERR;
+  *fd = msg.get("fileDescriptor").get<double>();
+
+  StreamMap::iterator it = streams_.find(*fd);
+  if (it == streams_.end())
+    return IO_ERR;
+  *stream = &it->second;
+  return NO_ERROR;
+}
+
+WebApiAPIErrors FilesystemContext::SeekStream(
+      const picojson::object_view& msg, int fd, Stream& stream) {
+  const picojson::value position = msg.get("position");
+  if (!position.is<double>())
+    return NO_ERROR;
+  if (position.get<double>() < 0)
+    return INVALID_VALUES_ERR;
+  if (!stream.seekable)
+    return NOT_SUPPORTED_ERR;
+
+  // Buffered writes belong at the old position.
+  WebApiAPIErrors error = FlushStream(fd, stream);
+  if (error != NO_ERROR)
+    return error;
+  stream.position = position.get<double>();
+  return NO_ERROR;
 }
 
 void FilesystemContext::SetSyncError(std::string& output,
@@ -630,18 +2458,26 @@ void FilesystemContext::SetSyncError(std::string& output,
   o["isError"] = picojson::value(true);
   o["errorCode"] = picojson::value(static_cast<double>(error_type));
   picojson::value v(o);
-  output = v.serialize();
+  common::perf::ScopedPhase phase(common::perf::kSerialize);
+  output.clear();
+  v.serialize(&output);
 }
 
 void FilesystemContext::SetSyncSuccess(std::string& reply,
       std::string& output) {
-  picojson::value::object o;
-
-  o["isError"] = picojson::value(false);
-  o["value"] = picojson::value(output);
+  SetSyncSuccess(reply, output.data(), output.size());
+}
 
-  picojson::value v(o);
-  reply = v.serialize();
+void FilesystemContext::SetSyncSuccess(std::string& reply, const char* output,
+      size_t size) {
+  // Written directly, |output| can be a whole file.
+  common::perf::ScopedPhase phase(common::perf::kSerialize);
+  reply.clear();
+  common::JsonWriter writer(&reply);
+  writer.BeginObject();
+  writer.Key("isError").Bool(false);
+  writer.Key("value").String(output, size);
+  writer.EndObject();
 }
 
 void FilesystemContext::SetSyncSuccess(std::string& reply) {
@@ -650,7 +2486,9 @@ void FilesystemContext::SetSyncSuccess(std::string& reply) {
   o["isError"] = picojson::value(false);
 
   picojson::value v(o);
-  reply = v.serialize();
+  common::perf::ScopedPhase phase(common::perf::kSerialize);
+  reply.clear();
+  v.serialize(&reply);
 }
 
 void FilesystemContext::SetSyncSuccess(std::string& reply,
@@ -661,10 +2499,12 @@ void FilesystemContext::SetSyncSuccess(std::string& reply,
   o["value"] = output;
 
   picojson::value v(o);
-  reply = v.serialize();
+  common::perf::ScopedPhase phase(common::perf::kSerialize);
+  reply.clear();
+  v.serialize(&reply);
 }
 
-void FilesystemContext::HandleFileStreamClose(const picojson::value& msg,
+void FilesystemContext::HandleFileStreamClose(const picojson::object_view& msg,
       std::string& reply) {
   if (!msg.contains("fileDescriptor")) {
     SetSyncError(reply, INVALID_VALUES_ERR);
@@ -672,190 +2512,281 @@ void FilesystemContext::HandleFileStreamClose(const picojson::value& msg,
   }
   int fd = msg.get("fileDescriptor").get<double>();
 
-  if (IsKnownFileDescriptor(fd)) {
+  WebApiAPIErrors error = NO_ERROR;
+  StreamMap::iterator it = streams_.find(fd);
+  if (it != streams_.end()) {
+    Stream& stream = it->second;
+    if (stream.mapped_data)
+      munmap(const_cast<char*>(stream.mapped_data), stream.mapped_size);
+    // The stream is closed even if what was buffered can't be written.
+    error = FlushStream(fd, stream);
     close(fd);
-    known_file_descriptors_.erase(fd);
+    streams_.erase(it);
   }
 
-  SetSyncSuccess(reply);
-}
-
-void FilesystemContext::HandleFileStreamRead(const picojson::value& msg,
-      std::string& reply) {
-  if (!msg.contains("fileDescriptor")) {
-    SetSyncError(reply, INVALID_VALUES_ERR);
+  if (error != NO_ERROR) {
+    SetSyncError(reply, error);
     return;
   }
-  int fd = msg.get("fileDescriptor").get<double>();
+  SetSyncSuccess(reply);
+}
 
-  if (!IsKnownFileDescriptor(fd)) {
-    SetSyncError(reply, IO_ERR);
-    return;
-  }
+WebApiAPIErrors FilesystemContext::ReadStream(const picojson::object_view& msg,
+      std::string* buffer, const char** data, size_t* size) {
+  int fd;
+  Stream* stream;
+  WebApiAPIErrors error = GetStream(msg, &fd, &stream);
+  if (error != NO_ERROR)
+    return error;
+
+  bool read_all = msg.get("readAll").evaluate_as_boolean();
+  double requested = kDefaultReadSize;
+  if (msg.contains("charCount"))
+    requested = msg.get("charCount").get<double>();
+  else if (msg.contains("byteCount"))
+    requested = msg.get("byteCount").get<double>();
+  // Also rejects NaN and infinity.
+  if (!(requested >= 0 &&
+        requested < std::numeric_limits<size_t>::max()))
+    return INVALID_VALUES_ERR;
+  size_t count = std::min(static_cast<size_t>(requested), kMaxReadSize);
+
+  error = SeekStream(msg, fd, *stream);
+  if (error != NO_ERROR)
+    return error;
+  // Buffered writes go first, so reads see them.
+  error = FlushStream(fd, *stream);
+  if (error != NO_ERROR)
+    return error;
+
+  if (stream->mapped_data) {
+    size_t left = stream->position < stream->mapped_size
+        ? stream->mapped_size - stream->position : 0;
+    if (read_all || left < count)
+      count = left;
+    *data = stream->mapped_data + (stream->mapped_size - left);
+    *size = count;
+    stream->position += count;
+    return NO_ERROR;
+  }
+
+  // Don't allocate more than what is left in the file, and size the buffer
+  // right away when reading everything. Pipes and the like only get a bigger
+  // buffer as data actually arrives.
+  size_t initial_size = std::min(count, kDefaultReadSize);
+  struct stat st;
+  if ((read_all || count > kDefaultReadSize) && !fstat(fd, &st)
+      && S_ISREG(st.st_mode)) {
+    uint64_t file_size = st.st_size;
+    size_t left = stream->position < file_size
+        ? file_size - stream->position : 0;
+    if (read_all || left < count)
+      count = left;
+    initial_size = count;
+  }
+
+  buffer->resize(initial_size);
+  size_t done = 0;
+  while (true) {
+    if (done == buffer->size()) {
+      // The file may have grown since fstat(), or isn't a regular file.
+      if (!read_all && done == count)
+        break;
+      size_t grown = std::max(buffer->size() * 2, kDefaultReadSize);
+      buffer->resize(read_all ? grown : std::min(grown, count));
+    }
 
-  unsigned char_count;
-  const unsigned kMaxSize = 64 * 1024;
-  if (!msg.contains("charCount")) {
-    char_count = kMaxSize;
-  } else {
-    char_count = msg.get("charCount").get<double>();
-    if (char_count > kMaxSize) {
-      SetSyncError(reply, IO_ERR);
-      return;
+    char* destination = &(*buffer)[done];
+    size_t length = buffer->size() - done;
+    ssize_t read_bytes = stream->seekable
+        ? pread(fd, destination, length, stream->position + done)
+        : read(fd, destination, length);
+    if (read_bytes < 0) {
+      if (errno == EINTR)
+        continue;
+      return IO_ERR;
     }
+    if (!read_bytes)
+      break;
+    done += read_bytes;
   }
+  stream->position += done;
+  buffer->resize(done);
+  *data = buffer->data();
+  *size = done;
+  return NO_ERROR;
+}
 
-  char buffer[kMaxSize];
-  size_t read_bytes = read(fd, buffer, char_count);
-  if (read_bytes < 0) {
-    SetSyncError(reply, IO_ERR);
+void FilesystemContext::HandleFileStreamRead(const picojson::object_view& msg,
+      std::string& reply) {
+  std::string buffer;
+  const char* data;
+  size_t size;
+  WebApiAPIErrors error = ReadStream(msg, &buffer, &data, &size);
+  if (error != NO_ERROR) {
+    SetSyncError(reply, error);
     return;
   }
-
-  std::string buffer_as_string = std::string(buffer, read_bytes);
-  SetSyncSuccess(reply, buffer_as_string);
+  SetSyncSuccess(reply, data, size);
 }
 
-void FilesystemContext::HandleFileStreamReadBytes(const picojson::value& msg,
-      std::string& reply) {
+void FilesystemContext::HandleFileStreamReadBytes(
+      const picojson::object_view& msg, std::string& reply) {
   HandleFileStreamRead(msg, reply);
 }
 
-namespace {
-namespace base64 {
-
-static const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmn" \
-      "opqrstuvwxyz0123456789+/";
-
-std::string ConvertTo(std::string input) {
-  std::string encoded;
-  size_t input_len = input.length();
-
-  for (size_t i = 0; i < input_len;) {
-    unsigned triple = input[i];
-    i++;
-
-    triple <<= 8;
-    if (i < input_len)
-      triple |= input[i];
-    i++;
-
-    triple <<= 8;
-    if (i < input_len)
-      triple |= input[i];
-    i++;
-
-    encoded.push_back(chars[(triple & 0xfc0000) >> 18]);
-    encoded.push_back(chars[(triple & 0x3f000) >> 12]);
-    encoded.push_back((i > input_len + 1) ? '=' : chars[(triple & 0xfc0) >> 6]);
-    encoded.push_back((i > input_len) ? '=' : chars[triple & 0x3f]);
-  }
-
-  return encoded;
-}
-
-int DecodeOne(char c) {
-  if (c < '0') {
-    if (c == '+')
-      return 62;
-    if (c == '/')
-      return 63;
-    return -1;
+void FilesystemContext::HandleFileStreamReadBase64(
+      const picojson::object_view& msg, std::string& reply) {
+  std::string buffer;
+  const char* data;
+  size_t size;
+  WebApiAPIErrors error = ReadStream(msg, &buffer, &data, &size);
+  if (error != NO_ERROR) {
+    SetSyncError(reply, error);
+    return;
   }
-  if (c <= '9')
-    return c - '0' + 52;
-  if (c >= 'A' && c <= 'Z')
-    return c - 'A';
-  if (c >= 'a' && c <= 'z')
-    return c - 'a' + 26;
-  return -1;
+  std::string base64_contents;
+  common::base64::Encode(data, size, &base64_contents);
+  SetSyncSuccess(reply, base64_contents);
 }
 
-std::string ConvertFrom(std::string input) {
-  std::string decoded;
-  size_t input_len = input.length();
-
-  if (input_len % 4)
-    return input;
-
-  for (size_t i = 0; i < input_len;) {
-    int c0 = DecodeOne(input[i++]);
-    int c1 = DecodeOne(input[i++]);
-
-    if (c0 < 0 || c1 < 0)
-      return input;
-
-    int c2 = DecodeOne(input[i++]);
-    int c3 = DecodeOne(input[i++]);
-
-    if (c2 < 0 && c3 < 0)
-      return input;
-
-    decoded.push_back(c0 << 2 | c1 >> 4);
-    if (c2 < 0)
-      decoded.push_back(((c1 & 15) << 4) | (c2 >> 2));
-    if (c3 < 0)
-      decoded.push_back(((c2 & 3) << 6) | c3);
-    i += 3;
+WebApiAPIErrors FilesystemContext::WriteStream(
+      const picojson::object_view& msg, const char* data, size_t size) {
+  int fd;
+  Stream* stream;
+  WebApiAPIErrors error = GetStream(msg, &fd, &stream);
+  if (error != NO_ERROR)
+    return error;
+  error = SeekStream(msg, fd, *stream);
+  if (error != NO_ERROR)
+    return error;
+
+  if (stream->buffer_capacity) {
+    if (stream->buffer.size() + size > stream->buffer_capacity) {
+      error = FlushStream(fd, *stream);
+      if (error != NO_ERROR)
+        return error;
+    }
+    // Writes bigger than the buffer aren't worth buffering.
+    if (size < stream->buffer_capacity) {
+      if (stream->buffer.empty())
+        stream->buffer_position = stream->position;
+      stream->buffer.append(data, size);
+      stream->position += size;
+      return NO_ERROR;
+    }
   }
 
-  return decoded;
+  // With O_APPEND, pwrite() would write at the end anyway, and the position
+  // follows the end of the file.
+  bool positional = stream->seekable && !stream->append;
+  if (!WriteAll(fd, data, size, positional ? stream->position : -1))
+    return IO_ERR;
+  if (stream->append && stream->seekable)
+    stream->position = lseek(fd, 0, SEEK_CUR);
+  else
+    stream->position += size;
+  return NO_ERROR;
 }
 
-}  // namespace base64
-}  // namespace
-
-void FilesystemContext::HandleFileStreamReadBase64(const picojson::value& msg,
-      std::string& reply) {
-  HandleFileStreamRead(msg, reply);
-  std::string base64_contents = base64::ConvertTo(reply);
-  SetSyncSuccess(reply, base64_contents);
+WebApiAPIErrors FilesystemContext::FlushStream(int fd, Stream& stream) {
+  if (stream.buffer.empty())
+    return NO_ERROR;
+
+  // Whatever happens, the data is not written twice.
+  bool positional = stream.seekable && !stream.append;
+  bool written = WriteAll(fd, stream.buffer.data(), stream.buffer.size(),
+                          positional ? stream.buffer_position : -1);
+  stream.buffer.clear();
+  if (stream.append && stream.seekable)
+    stream.position = lseek(fd, 0, SEEK_CUR);
+  return written ? NO_ERROR : IO_ERR;
 }
 
-void FilesystemContext::HandleFileStreamWrite(const picojson::value& msg,
+void FilesystemContext::HandleFileStreamWrite(const picojson::object_view& msg,
       std::string& reply) {
-  if (!msg.contains("fileDescriptor")) {
+  if (!msg.contains("stringData")) {
     SetSyncError(reply, INVALID_VALUES_ERR);
     return;
   }
-  int fd = msg.get("fileDescriptor").get<double>();
-
-  if (!IsKnownFileDescriptor(fd)) {
-    SetSyncError(reply, IO_ERR);
+  std::string buffer = msg.get("stringData").to_str();
+  WebApiAPIErrors error = WriteStream(msg, buffer.data(), buffer.size());
+  if (error != NO_ERROR) {
+    SetSyncError(reply, error);
     return;
   }
 
-  if (!msg.contains("stringData")) {
+  SetSyncSuccess(reply);
+}
+
+void FilesystemContext::HandleFileStreamWriteBytes(
+      const picojson::object_view& msg, std::string& reply) {
+  HandleFileStreamWrite(msg, reply);
+}
+
+void FilesystemContext::HandleFileStreamWriteBase64(
+      const picojson::object_view& msg, std::string& reply) {
+  // Base64 never needs escaping in JSON, so it can usually be decoded
+  // straight from the message.
+  const char* base64_data;
+  size_t base64_size;
+  std::string escaped;
+  if (!msg.get_raw_string("base64Data", &base64_data, &base64_size)) {
+    if (!msg.contains("base64Data")) {
+      SetSyncError(reply, INVALID_VALUES_ERR);
+      return;
+    }
+    escaped = msg.get("base64Data").to_str();
+    base64_data = escaped.data();
+    base64_size = escaped.size();
+  }
+
+  std::string raw_data;
+  if (!common::base64::Decode(base64_data, base64_size, &raw_data)) {
     SetSyncError(reply, INVALID_VALUES_ERR);
     return;
   }
-  std::string buffer = msg.get("stringData").to_str();
-  if (write(fd, buffer.c_str(), buffer.length()) < 0) {
-    SetSyncError(reply, IO_ERR);
+  WebApiAPIErrors error = WriteStream(msg, raw_data.data(), raw_data.size());
+  if (error != NO_ERROR) {
+    SetSyncError(reply, error);
     return;
   }
 
   SetSyncSuccess(reply);
 }
 
-void FilesystemContext::HandleFileStreamWriteBytes(const picojson::value& msg,
-      std::string& reply) {
-  HandleFileStreamWrite(msg, reply);
+void FilesystemContext::HandleFileStreamFlush(
+      const picojson::object_view& msg, std::string& reply) {
+  int fd;
+  Stream* stream;
+  WebApiAPIErrors error = GetStream(msg, &fd, &stream);
+  if (error == NO_ERROR)
+    error = FlushStream(fd, *stream);
+  if (error != NO_ERROR) {
+    SetSyncError(reply, error);
+    return;
+  }
+  SetSyncSuccess(reply);
 }
 
-void FilesystemContext::HandleFileStreamWriteBase64(const picojson::value& msg,
-      std::string& reply) {
-  if (!msg.contains("base64Data")) {
-    SetSyncError(reply, INVALID_VALUES_ERR);
+void FilesystemContext::HandleFileStreamSeek(
+      const picojson::object_view& msg, std::string& reply) {
+  int fd;
+  Stream* stream;
+  WebApiAPIErrors error = GetStream(msg, &fd, &stream);
+  if (error == NO_ERROR)
+    error = SeekStream(msg, fd, *stream);
+  if (error != NO_ERROR) {
+    SetSyncError(reply, error);
     return;
   }
-  std::string base64_data = msg.get("base64Data").to_str();
-  std::string raw_data = base64::ConvertFrom(base64_data);
-  HandleFileStreamWrite(msg, raw_data);
+
+  picojson::value position(static_cast<double>(stream->position));
+  SetSyncSuccess(reply, position);
 }
 
-void FilesystemContext::HandleFileCreateDirectory(const picojson::value& msg,
-      std::string& reply) {
+void FilesystemContext::HandleFileCreateDirectory(
+      const picojson::object_view& msg, std::string& reply) {
   if (!msg.contains("path")) {
     SetSyncError(reply, INVALID_VALUES_ERR);
     return;
@@ -880,7 +2811,7 @@ void FilesystemContext::HandleFileCreateDirectory(const picojson::value& msg,
   SetSyncSuccess(reply, relative_path);
 }
 
-void FilesystemContext::HandleFileCreateFile(const picojson::value& msg,
+void FilesystemContext::HandleFileCreateFile(const picojson::object_view& msg,
       std::string& reply) {
   if (!msg.contains("path")) {
     SetSyncError(reply, INVALID_VALUES_ERR);
@@ -909,7 +2840,7 @@ void FilesystemContext::HandleFileCreateFile(const picojson::value& msg,
   SetSyncSuccess(reply, file_path);
 }
 
-void FilesystemContext::HandleFileResolve(const picojson::value& msg,
+void FilesystemContext::HandleFileResolve(const picojson::object_view& msg,
       std::string& reply) {
   if (!msg.contains("path")) {
     SetSyncError(reply, INVALID_VALUES_ERR);
@@ -939,7 +2870,7 @@ void FilesystemContext::HandleFileResolve(const picojson::value& msg,
   SetSyncSuccess(reply, path_as_str);
 }
 
-void FilesystemContext::HandleFileStat(const picojson::value& msg,
+void FilesystemContext::HandleFileStat(const picojson::object_view& msg,
       std::string& reply) {
   if (!msg.contains("path")) {
     SetSyncError(reply, INVALID_VALUES_ERR);
@@ -975,7 +2906,135 @@ void FilesystemContext::HandleFileStat(const picojson::value& msg,
   SetSyncSuccess(reply, v);
 }
 
-void FilesystemContext::HandleFileGetFullPath(const picojson::value& msg,
+namespace {
+
+// Bits of the "flags" of a FileStatMany reply.
+const int kStatIsFile = 1;
+const int kStatIsDirectory = 2;
+const int kStatReadOnly = 4;
+
+}  // namespace
+
+// Stats many entries in one call: "names" inside the directory "parent", or
+// full "paths". Replies with one array per field, in the order asked:
+// "names", "sizes", "modified", "created" and "flags". Entries that can't be
+// stat'ed get null sizes and times, and no flags.
+void FilesystemContext::HandleFileStatMany(const picojson::object_view& msg,
+      std::string& reply) {
+  const picojson::value names = msg.get("names");
+  const picojson::value paths = msg.get("paths");
+  const picojson::array* entries;
+  int directory_fd = -1;
+  std::string directory;
+
+  if (names.is<picojson::array>()) {
+    if (!msg.contains("parent")) {
+      SetSyncError(reply, INVALID_VALUES_ERR);
+      return;
+    }
+    directory = msg.get("parent").to_str();
+    directory_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd < 0) {
+      SetSyncError(reply, errno == ENOENT ? NOT_FOUND_ERR : IO_ERR);
+      return;
+    }
+    entries = &names.get<picojson::array>();
+  } else if (paths.is<picojson::array>()) {
+    entries = &paths.get<picojson::array>();
+  } else {
+    SetSyncError(reply, INVALID_VALUES_ERR);
+    return;
+  }
+
+  std::vector<std::string> entry_names(entries->size());
+  std::vector<struct stat> stats(entries->size());
+  std::vector<bool> found(entries->size());
+  for (size_t i = 0; i < entries->size(); ++i) {
+    if (!(*entries)[i].is<std::string>())
+      continue;
+    const std::string& entry = (*entries)[i].get<std::string>();
+    std::string& name = entry_names[i];
+
+    if (!names.is<picojson::array>()) {
+      // Paths in the same directory, as those of a listing usually are,
+      // share its descriptor.
+      size_t slash = entry.rfind('/');
+      std::string parent = slash == std::string::npos
+          ? "." : entry.substr(0, slash ? slash : 1);
+      name = entry.substr(slash + 1);
+      if (parent != directory || directory_fd < 0) {
+        if (directory_fd >= 0)
+          close(directory_fd);
+        directory = parent;
+        directory_fd = open(directory.c_str(),
+                            O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      }
+      if (directory_fd < 0)
+        continue;
+    } else {
+      name = entry;
+      if (!IsValidPathComponent(name))
+        continue;
+    }
+    found[i] = !name.empty()
+        && !fstatat(directory_fd, name.c_str(), &stats[i], 0);
+  }
+  if (directory_fd >= 0)
+    close(directory_fd);
+
+  common::perf::ScopedPhase phase(common::perf::kSerialize);
+  reply.clear();
+  common::JsonWriter writer(&reply);
+  writer.BeginObject();
+  writer.Key("isError").Bool(false);
+  writer.Key("value").BeginObject();
+  writer.Key("names").BeginArray();
+  for (size_t i = 0; i < stats.size(); ++i)
+    writer.String(entry_names[i]);
+  writer.EndArray();
+  writer.Key("sizes").BeginArray();
+  for (size_t i = 0; i < stats.size(); ++i) {
+    if (found[i])
+      writer.Number(stats[i].st_size);
+    else
+      writer.Null();
+  }
+  writer.EndArray();
+  writer.Key("modified").BeginArray();
+  for (size_t i = 0; i < stats.size(); ++i) {
+    if (found[i])
+      writer.Number(stats[i].st_mtime);
+    else
+      writer.Null();
+  }
+  writer.EndArray();
+  writer.Key("created").BeginArray();
+  for (size_t i = 0; i < stats.size(); ++i) {
+    if (found[i])
+      writer.Number(stats[i].st_ctime);
+    else
+      writer.Null();
+  }
+  writer.EndArray();
+  writer.Key("flags").BeginArray();
+  for (size_t i = 0; i < stats.size(); ++i) {
+    int flags = 0;
+    if (found[i]) {
+      if (S_ISREG(stats[i].st_mode))
+        flags |= kStatIsFile;
+      if (S_ISDIR(stats[i].st_mode))
+        flags |= kStatIsDirectory;
+      if (!IsWritable(stats[i]))
+        flags |= kStatReadOnly;
+    }
+    writer.Number(flags);
+  }
+  writer.EndArray();
+  writer.EndObject();
+  writer.EndObject();
+}
+
+void FilesystemContext::HandleFileGetFullPath(const picojson::object_view& msg,
       std::string& reply) {
   if (!msg.contains("path")) {
     SetSyncError(reply, INVALID_VALUES_ERR);
@@ -993,3 +3052,325 @@ void FilesystemContext::HandleFileGetFullPath(const picojson::value& msg,
 
   SetSyncSuccess(reply, full_path_as_str);
 }
+
+void FilesystemContext::HandleFileCopyCancel(const picojson::object_view& msg,
+      std::string& reply) {
+  if (!msg.contains("reply_id")) {
+    SetSyncError(reply, INVALID_VALUES_ERR);
+    return;
+  }
+
+  CopyMap::iterator it = copies_.find(msg.get("reply_id").get<double>());
+  if (it == copies_.end()) {
+    SetSyncError(reply, NOT_FOUND_ERR);
+    return;
+  }
+
+  // The copy notices on its next step, removes what was written so far and
+  // fails with ABORT_ERR.
+  it->second->canceled = true;
+  SetSyncSuccess(reply);
+}
+
+namespace {
+
+enum WatchChange {
+  WATCH_CHANGE_NONE,
+  WATCH_CHANGE_CREATED,
+  WATCH_CHANGE_DELETED,
+  WATCH_CHANGE_MODIFIED
+};
+
+const uint32_t kWatchEvents = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+    IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+
+// Folds |next| into the change already pending for an entry. What matters is
+// the state the app saw at the last batch: an entry created and deleted again
+// never existed for it, one deleted and created again was only modified.
+WatchChange MergeWatchChanges(WatchChange previous, WatchChange next) {
+  switch (previous) {
+  case WATCH_CHANGE_CREATED:
+    return next == WATCH_CHANGE_DELETED ?
+        WATCH_CHANGE_NONE : WATCH_CHANGE_CREATED;
+  case WATCH_CHANGE_DELETED:
+    return next == WATCH_CHANGE_CREATED ?
+        WATCH_CHANGE_MODIFIED : WATCH_CHANGE_DELETED;
+  default:
+    return next == WATCH_CHANGE_DELETED ?
+        WATCH_CHANGE_DELETED : WATCH_CHANGE_MODIFIED;
+  }
+}
+
+};  // namespace
+
+struct DirectoryWatch {
+  DirectoryWatch() : overflow(false), gone(false) {}
+
+  // The File.watch() calls on this directory.
+  std::set<double> ids;
+
+  // Changes since the last batch, by entry name.
+  typedef std::map<std::string, WatchChange> ChangeMap;
+  ChangeMap changes;
+  // Changes were lost, either by the kernel or because there were too many.
+  // The app has to list the directory again.
+  bool overflow;
+  // The directory was deleted, moved or unmounted. The watch ends with the
+  // next batch.
+  bool gone;
+
+  void AddChange(const char* name, WatchChange change) {
+    if (overflow)
+      return;
+    ChangeMap::iterator it = changes.find(name);
+    if (it == changes.end()) {
+      if (changes.size() >= kMaxWatchChanges)
+        SetOverflow();
+      else
+        changes.insert(std::make_pair(std::string(name), change));
+      return;
+    }
+    WatchChange merged = MergeWatchChanges(it->second, change);
+    if (merged == WATCH_CHANGE_NONE)
+      changes.erase(it);
+    else
+      it->second = merged;
+  }
+
+  void SetOverflow() {
+    overflow = true;
+    changes.clear();
+  }
+
+  bool HasPendingChanges() const {
+    return overflow || gone || !changes.empty();
+  }
+};
+
+// Watches the directory in "path" for entries being created, deleted or
+// modified, and replies with the id of the watch. Changes are posted as
+// FileWatchChanges messages, at most one per watch every
+// kWatchFlushInterval, with the changes to each entry folded into one.
+void FilesystemContext::HandleFileWatch(const picojson::object_view& msg,
+      std::string& reply) {
+  if (!msg.contains("path")) {
+    SetSyncError(reply, INVALID_VALUES_ERR);
+    return;
+  }
+  std::string path = msg.get("path").to_str();
+
+  if (inotify_fd_ < 0) {
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+      SetSyncError(reply, IO_ERR);
+      return;
+    }
+    GIOChannel* channel = g_io_channel_unix_new(inotify_fd_);
+    inotify_source_ = g_io_add_watch(channel, G_IO_IN, OnInotifyReadable,
+        this);
+    g_io_channel_unref(channel);
+  }
+
+  // Watching the same directory again gives back the same descriptor.
+  int wd = inotify_add_watch(inotify_fd_, path.c_str(),
+      kWatchEvents | IN_ONLYDIR | IN_EXCL_UNLINK);
+  if (wd < 0) {
+    int error = errno;
+    if (watches_.empty())
+      StopInotify();
+    switch (error) {
+    case ENOENT:
+      SetSyncError(reply, NOT_FOUND_ERR);
+      break;
+    case ENOTDIR:
+      SetSyncError(reply, INVALID_VALUES_ERR);
+      break;
+    default:
+      SetSyncError(reply, IO_ERR);
+    }
+    return;
+  }
+
+  std::shared_ptr<DirectoryWatch>& watch = watches_[wd];
+  if (!watch)
+    watch.reset(new DirectoryWatch);
+  double watch_id = next_watch_id_++;
+  watch->ids.insert(watch_id);
+  watch_ids_[watch_id] = wd;
+
+  picojson::value v(watch_id);
+  SetSyncSuccess(reply, v);
+}
+
+void FilesystemContext::HandleFileUnwatch(const picojson::object_view& msg,
+      std::string& reply) {
+  const picojson::value watch_id = msg.get("watchId");
+  if (!watch_id.is<double>()) {
+    SetSyncError(reply, INVALID_VALUES_ERR);
+    return;
+  }
+  if (!watch_ids_.count(watch_id.get<double>())) {
+    SetSyncError(reply, NOT_FOUND_ERR);
+    return;
+  }
+
+  RemoveWatch(watch_id.get<double>());
+  SetSyncSuccess(reply);
+}
+
+void FilesystemContext::RemoveWatch(double watch_id) {
+  std::map<double, int>::iterator id = watch_ids_.find(watch_id);
+  int wd = id->second;
+  watch_ids_.erase(id);
+
+  WatchMap::iterator it = watches_.find(wd);
+  it->second->ids.erase(watch_id);
+  if (!it->second->ids.empty())
+    return;
+  // Fails harmlessly if the kernel already dropped the watch.
+  inotify_rm_watch(inotify_fd_, wd);
+  watches_.erase(it);
+
+  if (watches_.empty())
+    StopInotify();
+}
+
+void FilesystemContext::StopInotify() {
+  if (watch_flush_timer_) {
+    g_source_remove(watch_flush_timer_);
+    watch_flush_timer_ = 0;
+  }
+  if (inotify_source_) {
+    g_source_remove(inotify_source_);
+    inotify_source_ = 0;
+  }
+  if (inotify_fd_ >= 0) {
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+  }
+}
+
+// static
+gboolean FilesystemContext::OnInotifyReadable(GIOChannel* channel,
+      GIOCondition condition, gpointer data) {
+  static_cast<FilesystemContext*>(data)->ReadInotifyEvents();
+  return TRUE;
+}
+
+void FilesystemContext::ReadInotifyEvents() {
+  char buffer[16 * 1024]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool changed = false;
+
+  for (;;) {
+    ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0)
+      break;
+
+    for (const char* p = buffer; p < buffer + length; ) {
+      const struct inotify_event* event =
+          reinterpret_cast<const struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        for (WatchMap::iterator it = watches_.begin(); it != watches_.end();
+             ++it)
+          it->second->SetOverflow();
+        changed = true;
+        continue;
+      }
+
+      WatchMap::iterator it = watches_.find(event->wd);
+      if (it == watches_.end() || it->second->gone)
+        continue;
+      DirectoryWatch& watch = *it->second;
+      changed = true;
+
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        watch.gone = true;
+        continue;
+      }
+      // Changes to the directory itself.
+      if (!event->len)
+        continue;
+
+      if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        watch.AddChange(event->name, WATCH_CHANGE_CREATED);
+      else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+        watch.AddChange(event->name, WATCH_CHANGE_DELETED);
+      else
+        watch.AddChange(event->name, WATCH_CHANGE_MODIFIED);
+    }
+  }
+
+  if (changed && !watch_flush_timer_) {
+    watch_flush_timer_ =
+        g_timeout_add(kWatchFlushInterval, OnWatchFlushTimer, this);
+  }
+}
+
+// static
+gboolean FilesystemContext::OnWatchFlushTimer(gpointer data) {
+  FilesystemContext* self = static_cast<FilesystemContext*>(data);
+  self->watch_flush_timer_ = 0;
+  self->FlushWatchChanges();
+  return FALSE;
+}
+
+void FilesystemContext::FlushWatchChanges() {
+  static const char* kChangeNames[] = { NULL, "created", "deleted",
+      "modified" };
+  std::vector<double> ended;
+
+  for (WatchMap::iterator it = watches_.begin(); it != watches_.end(); ++it) {
+    DirectoryWatch& watch = *it->second;
+    if (!watch.HasPendingChanges())
+      continue;
+
+    // Written once for all the watches of the directory.
+    std::string changes;
+    if (!watch.overflow) {
+      common::JsonWriter writer(&changes);
+      writer.BeginObject();
+      for (int kind = WATCH_CHANGE_CREATED; kind <= WATCH_CHANGE_MODIFIED;
+           ++kind) {
+        writer.Key(kChangeNames[kind]).BeginArray();
+        for (DirectoryWatch::ChangeMap::const_iterator change =
+                 watch.changes.begin();
+             change != watch.changes.end(); ++change) {
+          if (change->second == kind)
+            writer.String(change->first);
+        }
+        writer.EndArray();
+      }
+      writer.EndObject();
+    }
+
+    for (std::set<double>::const_iterator id = watch.ids.begin();
+         id != watch.ids.end(); ++id) {
+      std::string* message = api_->reply_buffer();
+      common::JsonWriter writer(message);
+      writer.BeginObject();
+      writer.Key("cmd").String("FileWatchChanges");
+      writer.Key("watch_id").Number(*id);
+      if (watch.overflow)
+        writer.Key("overflow").Bool(true);
+      else
+        writer.Key("changes").Raw(changes);
+      if (watch.gone)
+        writer.Key("removed").Bool(true);
+      writer.EndObject();
+      api_->PostMessage(message->c_str());
+    }
+
+    if (watch.gone)
+      ended.insert(ended.end(), watch.ids.begin(), watch.ids.end());
+    watch.changes.clear();
+    watch.overflow = false;
+  }
+
+  for (size_t i = 0; i < ended.size(); ++i)
+    RemoveWatch(ended[i]);
+}
@@ -5,13 +5,52 @@
 #ifndef FILESYSTEM_FILESYSTEM_CONTEXT_H_
 #define FILESYSTEM_FILESYSTEM_CONTEXT_H_
 
-#include <set>
+#include <glib.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "common/command_table.h"
 #include "common/extension_adapter.h"
+#include "common/json_writer.h"
 #include "common/picojson.h"
 #include "tizen/tizen.h"
 
+// Progress of a copy running on the worker pool. The main context reads it
+// to report progress and sets |canceled| to stop the copy.
+struct CopyProgress {
+  CopyProgress() : done(0), total(0), canceled(false), reported(0) {}
+  std::atomic<uint64_t> done;
+  std::atomic<uint64_t> total;
+  std::atomic<bool> canceled;
+  // Only used on the main context.
+  uint64_t reported;
+};
+
+// A file replaced by File.writeAtomic(), see HandleFileWriteAtomic().
+struct AtomicWrite {
+  AtomicWrite() : reply_id(0), error(NO_ERROR) {}
+  double reply_id;
+  std::string path;
+  std::string data;
+  WebApiAPIErrors error;
+};
+
+// The atomic writes of an instance being committed, see
+// HandleFileWriteAtomic().
+struct WriteChain;
+// A directory being listed a page at a time, see HandleFileListFiles().
+struct DirectoryListing;
+// A search walking a tree a page of matches at a time, see
+// HandleFileSearch().
+struct FileSearch;
+// A directory watched for changes, see HandleFileWatch().
+struct DirectoryWatch;
+
 class FilesystemContext {
  public:
   explicit FilesystemContext(ContextAPI* api);
@@ -24,56 +63,237 @@ class FilesystemContext {
   void HandleSyncMessage(const char* message);
 
  private:
+  typedef void (FilesystemContext::*AsyncHandler)(
+        const picojson::object_view& msg);
+  typedef void (FilesystemContext::*SyncHandler)(
+        const picojson::object_view& msg, std::string& reply);
+
+  static void RegisterHandlers();
+  static common::CommandTable<AsyncHandler> async_handlers_;
+  static common::CommandTable<SyncHandler> sync_handlers_;
+
   /* Asynchronous messages */
-  void HandleFileSystemManagerResolve(const picojson::value& msg);
-  void HandleFileSystemManagerGetStorage(const picojson::value& msg);
-  void HandleFileSystemManagerListStorages(const picojson::value& msg);
-  void HandleFileOpenStream(const picojson::value& msg);
-  void HandleFileDeleteDirectory(const picojson::value& msg);
-  void HandleFileDeleteFile(const picojson::value& msg);
-  void HandleFileListFiles(const picojson::value& msg);
-  void HandleFileCopyTo(const picojson::value& msg);
-  void HandleFileMoveTo(const picojson::value& msg);
+  void HandleFileSystemManagerResolve(const picojson::object_view& msg);
+  void HandleFileSystemManagerGetStorage(const picojson::object_view& msg);
+  void HandleFileSystemManagerListStorages(const picojson::object_view& msg);
+  void HandleFileOpenStream(const picojson::object_view& msg);
+  void HandleFileDeleteDirectory(const picojson::object_view& msg);
+  void HandleFileDeleteFile(const picojson::object_view& msg);
+  void HandleFileListFiles(const picojson::object_view& msg);
+  void HandleFileListFilesNext(const picojson::object_view& msg);
+  void HandleFileSearch(const picojson::object_view& msg);
+  void HandleFileSearchNext(const picojson::object_view& msg);
+  void HandleFileCopyTo(const picojson::object_view& msg);
+  void HandleFileMoveTo(const picojson::object_view& msg);
+  void HandleFileWriteAtomic(const picojson::object_view& msg);
 
   /* Asynchronous message helpers */
-  void PostAsyncErrorReply(const picojson::value&, WebApiAPIErrors);
-  void PostAsyncSuccessReply(const picojson::value&, picojson::value::object&);
-  void PostAsyncSuccessReply(const picojson::value&, picojson::value&);
-  void PostAsyncSuccessReply(const picojson::value&, WebApiAPIErrors);
-  void PostAsyncSuccessReply(const picojson::value&);
+  void PostAsyncErrorReply(const picojson::object_view&, WebApiAPIErrors);
+  void PostAsyncErrorReply(double reply_id, WebApiAPIErrors);
+  void PostAsyncSuccessReply(const picojson::object_view&,
+        picojson::value::object&);
+  void PostAsyncSuccessReply(double reply_id, picojson::value::object&);
+  void PostAsyncSuccessReply(const picojson::object_view&, picojson::value&);
+  void PostAsyncSuccessReply(const picojson::object_view&, WebApiAPIErrors);
+  void PostAsyncSuccessReply(const picojson::object_view&);
+
+  // Virtual roots ("documents", "images", ...), the internal storage and
+  // removable storages, by label. They're enumerated when first needed and
+  // again only after the mount table changed, and so are the real paths of
+  // the roots resolved so far.
+  struct Storage {
+    Storage() : type("INTERNAL"), read_only(false), confined(true) {}
+    std::string path;
+    // "INTERNAL" or "EXTERNAL".
+    const char* type;
+    bool read_only;
+    // Whether paths resolved in it must stay inside the internal storage.
+    bool confined;
+  };
+  typedef std::map<std::string, Storage> StorageMap;
+  void LoadStorages();
+  const Storage* FindStorage(const std::string& label);
+  WebApiAPIErrors ResolveLocation(const std::string& location,
+        const std::string& mode, std::string* real_path);
+  static gboolean OnMountsChanged(GIOChannel* channel,
+        GIOCondition condition, gpointer data);
+
+  // Runs |task| on the worker pool and replies to |msg| once it's done. The
+  // task gets only copies of what it needs, never |this|. What the task
+  // wrote with |result| (if anything) is sent as the reply value. When it
+  // fails, what it wrote with |error_result| is sent instead, if anything.
+  // |done|, if given, runs on the main context right before replying.
+  typedef std::function<WebApiAPIErrors(common::JsonWriter* result,
+        common::JsonWriter* error_result)> BlockingTask;
+  void RunBlockingTask(const picojson::object_view& msg,
+        const BlockingTask& task,
+        const std::function<void()>& done = std::function<void()>());
 
   /* Sync messages */
-  void HandleFileSystemManagerGetMaxPathLength(const picojson::value& msg,
+  void HandleFileSystemManagerGetMaxPathLength(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileStreamClose(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileStreamRead(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileStreamReadBytes(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileStreamReadBase64(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileStreamWrite(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileStreamWriteBytes(const picojson::object_view& msg,
         std::string& reply);
-  void HandleFileStreamClose(const picojson::value& msg, std::string& reply);
-  void HandleFileStreamRead(const picojson::value& msg, std::string& reply);
-  void HandleFileStreamReadBytes(const picojson::value& msg,
+  void HandleFileStreamWriteBase64(const picojson::object_view& msg,
         std::string& reply);
-  void HandleFileStreamReadBase64(const picojson::value& msg,
+  void HandleFileStreamFlush(const picojson::object_view& msg,
         std::string& reply);
-  void HandleFileStreamWrite(const picojson::value& msg, std::string& reply);
-  void HandleFileStreamWriteBytes(const picojson::value& msg,
+  void HandleFileStreamSeek(const picojson::object_view& msg,
         std::string& reply);
-  void HandleFileStreamWriteBase64(const picojson::value& msg,
+  void HandleFileCreateDirectory(const picojson::object_view& msg,
         std::string& reply);
-  void HandleFileCreateDirectory(const picojson::value& msg,
+  void HandleFileCreateFile(const picojson::object_view& msg,
         std::string& reply);
-  void HandleFileCreateFile(const picojson::value& msg, std::string& reply);
-  void HandleFileResolve(const picojson::value& msg, std::string& reply);
-  void HandleFileStat(const picojson::value& msg, std::string& reply);
-  void HandleFileGetFullPath(const picojson::value& msg, std::string& reply);
+  void HandleFileResolve(const picojson::object_view& msg, std::string& reply);
+  void HandleFileStat(const picojson::object_view& msg, std::string& reply);
+  void HandleFileStatMany(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileGetFullPath(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileCopyCancel(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileListFilesClose(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileSearchClose(const picojson::object_view& msg,
+        std::string& reply);
+  void HandleFileWatch(const picojson::object_view& msg, std::string& reply);
+  void HandleFileUnwatch(const picojson::object_view& msg,
+        std::string& reply);
+
+  // State of each open FileStream. Reads and writes go through pread() and
+  // pwrite() at |position| instead of the offset of the descriptor, so any
+  // of them can start somewhere else without a separate seek.
+  struct Stream {
+    Stream()
+        : position(0), append(false), seekable(true), mapped_data(NULL),
+          mapped_size(0), buffer_capacity(0), buffer_position(0) {}
+    uint64_t position;
+    // "a" streams always write at the end of the file, and descriptors that
+    // can't seek (pipes, devices) only do sequential I/O.
+    bool append;
+    bool seekable;
+
+    // Read-only streams opened with "mapped" are served from a mapping of
+    // the whole file.
+    const char* mapped_data;
+    size_t mapped_size;
+
+    // Writable streams opened with "bufferSize" collect small writes here
+    // and hand them to the kernel once the buffer is full, when the stream is
+    // read, seeks, is flushed or closed, and when the instance goes away.
+    // Errors writing out the buffer are reported by the call that triggered
+    // it. The buffered bytes go at |buffer_position|.
+    std::string buffer;
+    size_t buffer_capacity;
+    uint64_t buffer_position;
+  };
+  typedef std::map<int, Stream> StreamMap;
 
   /* Sync message helpers */
-  bool IsKnownFileDescriptor(int fd);
-  bool CopyAndRenameSanityChecks(const picojson::value& msg,
-        const std::string& from, const std::string& to, bool overwrite);
+  // Finds the stream in "fileDescriptor" and stores it in |fd| and |stream|.
+  WebApiAPIErrors GetStream(const picojson::object_view& msg, int* fd,
+        Stream** stream);
+  // Moves the stream to "position", if given.
+  WebApiAPIErrors SeekStream(const picojson::object_view& msg, int fd,
+        Stream& stream);
+  // Reads "charCount" (or "byteCount") bytes from the stream, or all that's
+  // left with "readAll", starting at "position" if given. The bytes are read
+  // into |buffer| and |data| points to them, except for mapped streams where
+  // it points into the mapping.
+  WebApiAPIErrors ReadStream(const picojson::object_view& msg,
+        std::string* buffer, const char** data, size_t* size);
+  // Writes all of |data| to the stream in "fileDescriptor", starting at
+  // "position" if given, or to its write buffer if it has one.
+  WebApiAPIErrors WriteStream(const picojson::object_view& msg,
+        const char* data, size_t size);
+  // Writes out what is buffered for the stream, if anything.
+  WebApiAPIErrors FlushStream(int fd, Stream& stream);
   void SetSyncError(std::string& output, WebApiAPIErrors error_type);
   void SetSyncSuccess(std::string& reply);
   void SetSyncSuccess(std::string& reply, std::string& output);
+  void SetSyncSuccess(std::string& reply, const char* output, size_t size);
   void SetSyncSuccess(std::string& reply, picojson::value& output);
 
   ContextAPI* api_;
-  std::set<int> known_file_descriptors_;
+  StreamMap streams_;
+
+  StorageMap storages_;
+  bool storages_loaded_;
+  // Real path of each root resolved so far, by label and mode.
+  std::map<std::string, std::string> resolved_roots_;
+  // /proc/self/mounts, polled for changes to the mount table.
+  int mounts_fd_;
+  guint mounts_source_;
+
+  // Reused by every sync reply so that it keeps its capacity.
+  std::string sync_reply_;
+
+  // Copies, moves and recursive deletes in progress, by reply_id. While
+  // there is any, a timer posts FileProgress messages for the ones that
+  // moved forward.
+  typedef std::map<double, std::shared_ptr<CopyProgress> > CopyMap;
+  std::shared_ptr<CopyProgress> StartCopy(double reply_id);
+  static gboolean OnCopyProgressTimer(gpointer data);
+  CopyMap copies_;
+  guint copy_progress_timer_;
+
+  // writeAtomic() calls waiting for their batch. Those with "groupCommit"
+  // are committed kGroupCommitInterval after the first one comes in, the
+  // others right away, unless the batch before them is still committing.
+  // One batch commits at a time, so writes to the same file land in order.
+  // Once posted, a batch is committed even if the instance goes away first,
+  // only the replies are dropped.
+  typedef std::vector<AtomicWrite> WriteBatch;
+  static gboolean OnGroupCommitTimer(gpointer data);
+  void CommitWriteBatch();
+  std::shared_ptr<WriteBatch> pending_writes_;
+  bool committing_writes_;
+  guint group_commit_timer_;
+  std::shared_ptr<WriteChain> write_chain_;
+
+  // Paged listings that have more to read, by cursor.
+  typedef std::map<double, std::shared_ptr<DirectoryListing> > ListingMap;
+  void ReadListingPage(const picojson::object_view& msg, double cursor,
+        double page_size);
+  void CloseOldCursors();
+  ListingMap listings_;
+  double next_listing_cursor_;
+
+  // Paged searches that have more to find, by cursor. Cursors are shared
+  // with listings.
+  typedef std::map<double, std::shared_ptr<FileSearch> > SearchMap;
+  void ReadSearchPage(const picojson::object_view& msg, double cursor,
+        double page_size);
+  SearchMap searches_;
+
+  // Watched directories, by inotify watch descriptor. Watches of the same
+  // directory share one descriptor; |watch_ids_| maps each of them to it.
+  // The inotify descriptor is open while there is any watch, and changes
+  // read from it are posted in batches by a timer.
+  typedef std::map<int, std::shared_ptr<DirectoryWatch> > WatchMap;
+  static gboolean OnInotifyReadable(GIOChannel* channel,
+        GIOCondition condition, gpointer data);
+  static gboolean OnWatchFlushTimer(gpointer data);
+  void ReadInotifyEvents();
+  void FlushWatchChanges();
+  void RemoveWatch(double watch_id);
+  void StopInotify();
+  WatchMap watches_;
+  std::map<double, int> watch_ids_;
+  double next_watch_id_;
+  int inotify_fd_;
+  guint inotify_source_;
+  guint watch_flush_timer_;
 };
 
 #endif  // FILESYSTEM_FILESYSTEM_CONTEXT_H_
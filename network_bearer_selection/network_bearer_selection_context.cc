@@ -32,7 +32,7 @@ void NetworkBearerSelectionContext::PostMessage(const std::string& cmd,
   o["reply_id"] = picojson::value(reply_id);
 
   picojson::value v(o);
-  api_->PostMessage(v.serialize().c_str());
+  api_->PostMessage(v);
 }
 
 void NetworkBearerSelectionContext::HandleMessage(const char* message) {
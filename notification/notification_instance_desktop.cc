@@ -61,7 +61,7 @@ void NotificationInstanceDesktop::HandlePost(const picojson::value& msg) {
 
   int id = GetNextUniqueID();
   notifications_[id] = notification;
-  SendSyncReply(JSONValueFromInt(id).serialize().c_str());
+  SendSyncReply(JSONValueFromInt(id));
 }
 
 void NotificationInstanceDesktop::HandleRemove(const picojson::value& msg) {
@@ -96,7 +96,7 @@ void NotificationInstanceDesktop::HandleUpdate(const picojson::value& msg) {
   picojson::value result;
   if (notify_notification_show(notification, NULL))
     result = picojson::value(true);
-  SendSyncReply(result.serialize().c_str());
+  SendSyncReply(result);
 }
 
 int NotificationInstanceDesktop::IdFromNotification(
@@ -125,7 +125,7 @@ void NotificationInstanceDesktop::OnNotificationClosed(
   o["cmd"] = picojson::value("NotificationRemoved");
   o["id"] = JSONValueFromInt(id);
   picojson::value v(o);
-  PostMessage(v.serialize().c_str());
+  PostMessage(v);
 
   g_object_unref(notification);
   notifications_.erase(id);
@@ -81,7 +81,7 @@ void NotificationInstanceMobile::HandlePost(const picojson::value& msg) {
     return;
   }
 
-  SendSyncReply(JSONValueFromInt(id).serialize().c_str());
+  SendSyncReply(JSONValueFromInt(id));
 }
 
 void NotificationInstanceMobile::HandleRemove(const picojson::value& msg) {
@@ -112,7 +112,7 @@ void NotificationInstanceMobile::HandleUpdate(const picojson::value& msg) {
   picojson::value result;
   if (manager_->UpdateNotification(notification))
     result = picojson::value(true);
-  SendSyncReply(result.serialize().c_str());
+  SendSyncReply(result);
 }
 
 void NotificationInstanceMobile::OnNotificationRemoved(int id) {
@@ -120,6 +120,6 @@ void NotificationInstanceMobile::OnNotificationRemoved(int id) {
   o["cmd"] = picojson::value("NotificationRemoved");
   o["id"] = JSONValueFromInt(id);
   picojson::value v(o);
-  PostMessage(v.serialize().c_str());
+  PostMessage(v);
 }
 
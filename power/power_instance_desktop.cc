@@ -49,7 +49,14 @@ void OnScreenProxyCreatedThunk(GObject* source, GAsyncResult* res,
   instance->screen_proxy_ = g_dbus_proxy_new_for_bus_finish(res, /* error */ 0);
 }
 
+common::CommandTable<PowerInstanceDesktop::Handler>
+    PowerInstanceDesktop::async_handlers_;
+common::CommandTable<PowerInstanceDesktop::SyncHandler>
+    PowerInstanceDesktop::sync_handlers_;
+
 PowerInstanceDesktop::PowerInstanceDesktop() {
+  if (async_handlers_.empty())
+    RegisterHandlers();
   kMaxBrightness = readInt(DEVICE "/max_brightness");
 
   g_dbus_proxy_new_for_bus(G_BUS_TYPE_SESSION,
@@ -68,6 +75,24 @@ PowerInstanceDesktop::~PowerInstanceDesktop() {
     g_object_unref(screen_proxy_);
 }
 
+// static
+void PowerInstanceDesktop::RegisterHandlers() {
+  async_handlers_.Register("PowerRequest",
+                           &PowerInstanceDesktop::HandleRequest);
+  async_handlers_.Register("PowerRelease",
+                           &PowerInstanceDesktop::HandleRelease);
+  // A brightness of -1 restores the default.
+  async_handlers_.Register("PowerSetScreenBrightness",
+                           &PowerInstanceDesktop::HandleSetScreenBrightness);
+  async_handlers_.Register("PowerSetScreenEnabled",
+                           &PowerInstanceDesktop::HandleSetScreenEnabled);
+
+  sync_handlers_.Register("PowerGetScreenBrightness",
+                          &PowerInstanceDesktop::HandleGetScreenBrightness);
+  sync_handlers_.Register("PowerGetScreenState",
+                          &PowerInstanceDesktop::HandleGetScreenState);
+}
+
 void PowerInstanceDesktop::HandleMessage(const char* message) {
   picojson::value v;
 
@@ -79,18 +104,11 @@ void PowerInstanceDesktop::HandleMessage(const char* message) {
   }
 
   std::string cmd = v.get("cmd").to_str();
-  if (cmd == "PowerRequest") {
-    HandleRequest(v);
-  } else if (cmd == "PowerRelease") {
-    HandleRelease(v);
-  } else if (cmd == "PowerSetScreenBrightness") {
-    // value of -1 means restore to default value.
-    HandleSetScreenBrightness(v);
-  } else if (cmd == "PowerSetScreenEnabled") {
-    HandleSetScreenEnabled(v);
-  } else {
+  Handler handler;
+  if (async_handlers_.Lookup(cmd, &handler))
+    (this->*handler)(v);
+  else
     std::cout << "ASSERT NOT REACHED.\n";
-  }
 }
 
 void PowerInstanceDesktop::HandleSyncMessage(const char* message) {
@@ -104,13 +122,11 @@ void PowerInstanceDesktop::HandleSyncMessage(const char* message) {
   }
 
   std::string cmd = v.get("cmd").to_str();
-  if (cmd == "PowerGetScreenBrightness") {
-    HandleGetScreenBrightness();
-  }  else if (cmd == "PowerGetScreenState") {
-    HandleGetScreenState();
-  } else {
+  SyncHandler handler;
+  if (sync_handlers_.Lookup(cmd, &handler))
+    (this->*handler)();
+  else
     std::cout << "ASSERT NOT REACHED.\n";
-  }
 }
 
 void PowerInstanceDesktop::OnScreenStateChanged(ResourceState state) {
@@ -119,7 +135,7 @@ void PowerInstanceDesktop::OnScreenStateChanged(ResourceState state) {
   o["state"] = picojson::value(static_cast<double>(state));
 
   picojson::value v(o);
-  PostMessage(v.serialize().c_str());
+  PostMessage(v);
 }
 
 void PowerInstanceDesktop::HandleRequest(const picojson::value& msg) {
@@ -183,5 +199,5 @@ void PowerInstanceDesktop::HandleGetScreenState() {
   o["state"] = picojson::value(
       static_cast<double>(SCREEN_NORMAL));
   picojson::value v(o);
-  SendSyncReply(v.serialize().c_str());
+  SendSyncReply(v);
 }
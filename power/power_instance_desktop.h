@@ -7,6 +7,7 @@
 
 #include <gio/gio.h>
 
+#include "common/command_table.h"
 #include "common/extension.h"
 #include "power/power_types.h"
 
@@ -26,6 +27,13 @@ class PowerInstanceDesktop
   // common::Instance implementation.
   virtual void HandleMessage(const char* msg);
   virtual void HandleSyncMessage(const char* msg);
+
+  typedef void (PowerInstanceDesktop::*Handler)(const picojson::value& msg);
+  typedef void (PowerInstanceDesktop::*SyncHandler)();
+
+  static void RegisterHandlers();
+  static common::CommandTable<Handler> async_handlers_;
+  static common::CommandTable<SyncHandler> sync_handlers_;
   void HandleRequest(const picojson::value& msg);
   void HandleRelease(const picojson::value& msg);
   void HandleSetScreenBrightness(const picojson::value& msg);
@@ -12,11 +12,18 @@
 
 #include "common/picojson.h"
 
+common::CommandTable<PowerInstanceMobile::Handler>
+    PowerInstanceMobile::async_handlers_;
+common::CommandTable<PowerInstanceMobile::SyncHandler>
+    PowerInstanceMobile::sync_handlers_;
+
 PowerInstanceMobile::PowerInstanceMobile(PowerEventSource* event_source)
     : js_listening_to_state_change_(false),
       event_source_(event_source) {
   pending_screen_state_change_ = false;
   pending_screen_state_reply_ = false;
+  if (async_handlers_.empty())
+    RegisterHandlers();
 
   event_source_->AddListener(this);
 }
@@ -25,6 +32,25 @@ PowerInstanceMobile::~PowerInstanceMobile() {
   event_source_->RemoveListener(this);
 }
 
+// static
+void PowerInstanceMobile::RegisterHandlers() {
+  async_handlers_.Register("PowerRequest", &PowerInstanceMobile::HandleRequest);
+  async_handlers_.Register("PowerRelease", &PowerInstanceMobile::HandleRelease);
+  // A brightness of -1 restores the default.
+  async_handlers_.Register("PowerSetScreenBrightness",
+                           &PowerInstanceMobile::HandleSetScreenBrightness);
+  async_handlers_.Register("PowerSetScreenEnabled",
+                           &PowerInstanceMobile::HandleSetScreenEnabled);
+  async_handlers_.Register(
+      "SetListenToScreenStateChange",
+      &PowerInstanceMobile::HandleSetListenToScreenStateChange);
+
+  sync_handlers_.Register("PowerGetScreenBrightness",
+                          &PowerInstanceMobile::HandleGetScreenBrightness);
+  sync_handlers_.Register("PowerGetScreenState",
+                          &PowerInstanceMobile::HandleGetScreenState);
+}
+
 ResourceType getResourceType(const picojson::value& msg,
                                            bool* error) {
     int type = msg.get("resource").get<double>();
@@ -64,20 +90,11 @@ void PowerInstanceMobile::HandleMessage(const char* message) {
   }
 
   std::string cmd = v.get("cmd").to_str();
-  if (cmd == "PowerRequest") {
-    HandleRequest(v);
-  } else if (cmd == "PowerRelease") {
-    HandleRelease(v);
-  } else if (cmd == "PowerSetScreenBrightness") {
-    // value of -1 means restore to default value.
-    HandleSetScreenBrightness(v);
-  } else if (cmd == "PowerSetScreenEnabled") {
-    HandleSetScreenEnabled(v);
-  } else if (cmd == "SetListenToScreenStateChange") {
-    HandleSetListenToScreenStateChange(v);
-  } else {
+  Handler handler;
+  if (async_handlers_.Lookup(cmd, &handler))
+    (this->*handler)(v);
+  else
     std::cout << "ASSERT NOT REACHED.\n";
-  }
 }
 
 void PowerInstanceMobile::HandleSyncMessage(const char* message) {
@@ -91,13 +108,11 @@ void PowerInstanceMobile::HandleSyncMessage(const char* message) {
   }
 
   std::string cmd = v.get("cmd").to_str();
-  if (cmd == "PowerGetScreenBrightness") {
-    HandleGetScreenBrightness();
-  }  else if (cmd == "PowerGetScreenState") {
-    HandleGetScreenState();
-  } else {
+  SyncHandler handler;
+  if (sync_handlers_.Lookup(cmd, &handler))
+    (this->*handler)();
+  else
     std::cout << "ASSERT NOT REACHED.\n";
-  }
 }
 
 void PowerInstanceMobile::DispatchScreenStateChangedToJS(
@@ -110,7 +125,7 @@ void PowerInstanceMobile::DispatchScreenStateChangedToJS(
   o["state"] = picojson::value(static_cast<double>(state));
 
   picojson::value v(o);
-  PostMessage(v.serialize().c_str());
+  PostMessage(v);
 }
 
 void PowerInstanceMobile::OnPowerStateChanged(power_state_e pstate) {
@@ -123,7 +138,7 @@ void PowerInstanceMobile::OnPowerStateChanged(power_state_e pstate) {
     o["state"] = picojson::value(static_cast<double>(state));
     picojson::value v(o);
     pending_screen_state_reply_ = false;
-    SendSyncReply(v.serialize().c_str());
+    SendSyncReply(v);
   }
 }
 
@@ -215,7 +230,7 @@ void PowerInstanceMobile::HandleGetScreenState() {
     o["state"] = picojson::value(
             static_cast<double>(toResourceState(power_get_state())));
     picojson::value v(o);
-    SendSyncReply(v.serialize().c_str());
+    SendSyncReply(v);
   }
 }
 
@@ -6,6 +6,7 @@
 #define POWER_POWER_INSTANCE_MOBILE_H_
 
 #include <power.h>
+#include "common/command_table.h"
 #include "common/extension.h"
 #include "power/power_types.h"
 #include "power/mobile/power_event_source.h"
@@ -30,6 +31,13 @@ class PowerInstanceMobile
   virtual void HandleMessage(const char* msg);
   virtual void HandleSyncMessage(const char* msg);
 
+  typedef void (PowerInstanceMobile::*Handler)(const picojson::value& msg);
+  typedef void (PowerInstanceMobile::*SyncHandler)();
+
+  static void RegisterHandlers();
+  static common::CommandTable<Handler> async_handlers_;
+  static common::CommandTable<SyncHandler> sync_handlers_;
+
   void HandleRequest(const picojson::value& msg);
   void HandleRelease(const picojson::value& msg);
   void HandleSetScreenBrightness(const picojson::value& msg);
@@ -86,6 +86,7 @@
         'system_info_wifi_network.h',
         'system_info_wifi_network_desktop.cc',
         'system_info_wifi_network_mobile.cc',
+        '../common/outbound_queue.cc',
       ],
     },
   ],
@@ -13,12 +13,32 @@ var props_array = ['BATTERY', 'CPU',
                    'WIFI_NETWORK', 'CELLULAR_NETWORK',
                    'SIM', 'PERIPHERAL'];
 
+var _pending_messages = [];
+
+// Messages posted during the same turn of the event loop, like the
+// getPropertyValue() calls of an application starting up, are sent together
+// as a single batch.
+var _postMessage = function(msg) {
+  _pending_messages.push(msg);
+  if (_pending_messages.length == 1)
+    setTimeout(_flushMessages, 0);
+};
+
+var _flushMessages = function() {
+  var messages = _pending_messages;
+  _pending_messages = [];
+  if (messages.length == 1)
+    extension.postMessage(JSON.stringify(messages[0]));
+  else
+    extension.postBatch(messages);
+};
+
 var postMessage = function(msg, callback) {
   var reply_id = _next_reply_id;
   _next_reply_id += 1;
   _callbacks[reply_id] = callback;
   msg._reply_id = reply_id.toString();
-  extension.postMessage(JSON.stringify(msg));
+  _postMessage(msg);
 };
 
 function _addConstProperty(obj, propertyKey, propertyValue) {
@@ -80,7 +100,7 @@ extension.setMessageListener(function(json) {
                   'cmd': 'stopListening',
                   'prop': msg.prop
                 };
-                extension.postMessage(JSON.stringify(message));
+                _postMessage(message);
                 return;
               }
               continue;
@@ -203,7 +223,7 @@ exports.addPropertyValueChangeListener = function(prop, successCallback, option)
       'cmd': 'startListening',
       'prop': prop
     };
-    extension.postMessage(JSON.stringify(msg));
+    _postMessage(msg);
   }
 
   var timeStamp = (new Date()).valueOf();
@@ -233,6 +253,6 @@ exports.removePropertyValueChangeListener = function(listenerId) {
       'cmd': 'stopListening',
       'prop': prop
     };
-    extension.postMessage(JSON.stringify(msg));
+    _postMessage(msg);
   }
 };
@@ -27,8 +27,8 @@ class SysInfoBattery {
 
   ~SysInfoBattery();
   void Get(picojson::value& error, picojson::value& data);
-  void StartListening(ContextAPI* api);
-  void StopListening(ContextAPI* api);
+  void StartListening(common::OutboundQueue* queue);
+  void StopListening(common::OutboundQueue* queue);
 
  private:
   explicit SysInfoBattery();
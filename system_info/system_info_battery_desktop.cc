@@ -26,10 +26,10 @@ SysInfoBattery::~SysInfoBattery() {
   pthread_mutex_destroy(&events_list_mutex_);
 }
 
-void SysInfoBattery::StartListening(ContextAPI* api) {
+void SysInfoBattery::StartListening(common::OutboundQueue* queue) {
   // FIXME(halton): Use udev D-Bus interface to monitor.
   AutoLock lock(&events_list_mutex_);
-  battery_events_.push_back(api);
+  battery_events_.push_back(queue);
   if (timeout_cb_id_ == 0) {
     timeout_cb_id_ = g_timeout_add(system_info::default_timeout_interval,
                                    SysInfoBattery::OnUpdateTimeout,
@@ -37,9 +37,9 @@ void SysInfoBattery::StartListening(ContextAPI* api) {
   }
 }
 
-void SysInfoBattery::StopListening(ContextAPI* api) {
+void SysInfoBattery::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  battery_events_.remove(api);
+  battery_events_.remove(queue);
   if (battery_events_.empty() && timeout_cb_id_ > 0) {
     g_source_remove(timeout_cb_id_);
     timeout_cb_id_ = 0;
@@ -126,11 +126,10 @@ gboolean SysInfoBattery::OnUpdateTimeout(gpointer user_data) {
     system_info::SetPicoJsonObjectValue(output, "data", data);
 
     std::string result = output.serialize();
-    const char* result_as_cstr = result.c_str();
     AutoLock lock(&(instance->events_list_mutex_));
     for (SystemInfoEventsList::iterator it = battery_events_.begin();
          it != battery_events_.end(); it++) {
-      (*it)->PostMessage(result_as_cstr);
+      (*it)->Post("BATTERY", result);
     }
   }
 
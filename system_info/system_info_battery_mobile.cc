@@ -53,11 +53,10 @@ bool SysInfoBattery::Update(picojson::value& error) {
   system_info::SetPicoJsonObjectValue(output, "data", data);
 
   std::string result = output.serialize();
-  const char* result_as_cstr = result.c_str();
   AutoLock lock(&events_list_mutex_);
   for (SystemInfoEventsList::iterator it = battery_events_.begin();
        it != battery_events_.end(); it++) {
-    (*it)->PostMessage(result_as_cstr);
+    (*it)->Post("BATTERY", result);
   }
   return true;
 }
@@ -101,9 +100,9 @@ void SysInfoBattery::OnIsChargingChanged(keynode_t* node, void* user_data) {
   battery->UpdateCharging(charging);
 }
 
-void SysInfoBattery::StartListening(ContextAPI* api) {
+void SysInfoBattery::StartListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  battery_events_.push_back(api);
+  battery_events_.push_back(queue);
 
   if (battery_events_.size() > 1)
     return;
@@ -114,9 +113,9 @@ void SysInfoBattery::StartListening(ContextAPI* api) {
       (vconf_callback_fn)OnIsChargingChanged, this);
 }
 
-void SysInfoBattery::StopListening(ContextAPI* api) {
+void SysInfoBattery::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  battery_events_.remove(api);
+  battery_events_.remove(queue);
 
   if (!battery_events_.empty())
     return;
@@ -25,18 +25,18 @@ class SysInfoBuild {
     pthread_mutex_destroy(&events_list_mutex_);
   }
   void Get(picojson::value& error, picojson::value& data);
-  inline void StartListening(ContextAPI* api) {
+  inline void StartListening(common::OutboundQueue* queue) {
     AutoLock lock(&events_list_mutex_);
-    build_events_.push_back(api);
+    build_events_.push_back(queue);
     if (timeout_cb_id_ == 0) {
       timeout_cb_id_ = g_timeout_add(system_info::default_timeout_interval,
                                      SysInfoBuild::OnUpdateTimeout,
                                      static_cast<gpointer>(this));
     }
   }
-  inline void StopListening(ContextAPI* api) {
+  inline void StopListening(common::OutboundQueue* queue) {
     AutoLock lock(&events_list_mutex_);
-    build_events_.remove(api);
+    build_events_.remove(queue);
     if (build_events_.empty() && timeout_cb_id_ > 0) {
       g_source_remove(timeout_cb_id_);
       timeout_cb_id_ = 0;
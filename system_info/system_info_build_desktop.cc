@@ -125,11 +125,10 @@ gboolean SysInfoBuild::OnUpdateTimeout(gpointer user_data) {
     system_info::SetPicoJsonObjectValue(output, "data", data);
 
     std::string result = output.serialize();
-    const char* result_as_cstr = result.c_str();
     AutoLock lock(&(instance->events_list_mutex_));
     for (SystemInfoEventsList::iterator it = build_events_.begin();
          it != build_events_.end(); it++) {
-      (*it)->PostMessage(result_as_cstr);
+      (*it)->Post("BUILD", result);
     }
   }
 
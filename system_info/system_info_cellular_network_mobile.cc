@@ -176,11 +176,10 @@ void SysInfoCellularNetwork::SendUpdate() {
   system_info::SetPicoJsonObjectValue(output, "data", data);
 
   std::string result = output.serialize();
-  const char* result_as_cstr = result.c_str();
   AutoLock lock(&events_list_mutex_);
   for (SystemInfoEventsList::iterator it = cellular_events_.begin();
        it != cellular_events_.end(); it++) {
-    (*it)->PostMessage(result_as_cstr);
+    (*it)->Post("CELLULAR_NETWORK", result);
   }
 }
 
@@ -311,9 +310,9 @@ void SysInfoCellularNetwork::OnFlightModeChanged(keynode_t* node,
   cellular->UpdateFlightMode(flight_mode);
 }
 
-void SysInfoCellularNetwork::StartListening(ContextAPI* api) {
+void SysInfoCellularNetwork::StartListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  cellular_events_.push_back(api);
+  cellular_events_.push_back(queue);
 
   if (cellular_events_.size() > 1)
     return;
@@ -332,9 +331,9 @@ void SysInfoCellularNetwork::StartListening(ContextAPI* api) {
       (vconf_callback_fn)OnFlightModeChanged, this);
 }
 
-void SysInfoCellularNetwork::StopListening(ContextAPI* api) {
+void SysInfoCellularNetwork::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  cellular_events_.remove(api);
+  cellular_events_.remove(queue);
 
   if (!cellular_events_.empty())
     return;
@@ -22,10 +22,36 @@ const char* sSystemInfoFilePath = "/usr/etc/system-info.ini";
 
 }  // namespace
 
+// The SysInfo* classes don't share a base class, but all of them provide the
+// same Get()/StartListening()/StopListening() trio.
+template <typename T>
+class SystemInfoContext::SysInfoPropertyImpl : public SysInfoProperty {
+ public:
+  explicit SysInfoPropertyImpl(T& info) : info_(info) {}
+
+  virtual void Get(picojson::value& error, picojson::value& data) {
+    info_.Get(error, data);
+  }
+  virtual void StartListening(common::OutboundQueue* queue) {
+    info_.StartListening(queue);
+  }
+  virtual void StopListening(common::OutboundQueue* queue) {
+    info_.StopListening(queue);
+  }
+
+ private:
+  T& info_;
+};
+
+common::CommandTable<SystemInfoContext::Handler> SystemInfoContext::handlers_;
+common::CommandTable<SystemInfoContext::SysInfoProperty*>
+    SystemInfoContext::properties_;
+
 DEFINE_XWALK_EXTENSION(SystemInfoContext);
 
 SystemInfoContext::SystemInfoContext(ContextAPI* api)
     : api_(api),
+      outbound_queue_(api),
       battery_(SysInfoBattery::GetSysInfoBattery()),
       build_(SysInfoBuild::GetSysInfoBuild()),
       cellular_network_(
@@ -40,21 +66,74 @@ SystemInfoContext::SystemInfoContext(ContextAPI* api)
       sim_(SysInfoSim::GetSysInfoSim()),
       storage_(SysInfoStorage::GetSysInfoStorage()),
       wifi_network_(SysInfoWifiNetwork::GetSysInfoWifiNetwork()) {
+  if (handlers_.empty())
+    RegisterHandlers();
+}
+
+// static
+void SystemInfoContext::RegisterHandlers() {
+  handlers_.Register("getPropertyValue",
+                     &SystemInfoContext::HandleGetPropertyValue);
+  handlers_.Register("startListening",
+                     &SystemInfoContext::HandleStartListening);
+  handlers_.Register("stopListening",
+                     &SystemInfoContext::HandleStopListening);
+
+  // All the SysInfo* objects are singletons, so the table can point to them
+  // directly and be shared by every context.
+  static SysInfoPropertyImpl<SysInfoBattery> battery(
+      SysInfoBattery::GetSysInfoBattery());
+  static SysInfoPropertyImpl<SysInfoBuild> build(
+      SysInfoBuild::GetSysInfoBuild());
+  static SysInfoPropertyImpl<SysInfoCellularNetwork> cellular_network(
+      SysInfoCellularNetwork::GetSysInfoCellularNetwork());
+  static SysInfoPropertyImpl<SysInfoCpu> cpu(
+      SysInfoCpu::GetSysInfoCpu());
+  static SysInfoPropertyImpl<SysInfoDeviceOrientation> device_orientation(
+      SysInfoDeviceOrientation::GetSysInfoDeviceOrientation());
+  static SysInfoPropertyImpl<SysInfoDisplay> display(
+      SysInfoDisplay::GetSysInfoDisplay());
+  static SysInfoPropertyImpl<SysInfoLocale> locale(
+      SysInfoLocale::GetSysInfoLocale());
+  static SysInfoPropertyImpl<SysInfoNetwork> network(
+      SysInfoNetwork::GetSysInfoNetwork());
+  static SysInfoPropertyImpl<SysInfoPeripheral> peripheral(
+      SysInfoPeripheral::GetSysInfoPeripheral());
+  static SysInfoPropertyImpl<SysInfoSim> sim(
+      SysInfoSim::GetSysInfoSim());
+  static SysInfoPropertyImpl<SysInfoStorage> storage(
+      SysInfoStorage::GetSysInfoStorage());
+  static SysInfoPropertyImpl<SysInfoWifiNetwork> wifi_network(
+      SysInfoWifiNetwork::GetSysInfoWifiNetwork());
+
+  properties_.Register("BATTERY", &battery);
+  properties_.Register("CPU", &cpu);
+  properties_.Register("STORAGE", &storage);
+  properties_.Register("DISPLAY", &display);
+  properties_.Register("DEVICE_ORIENTATION", &device_orientation);
+  properties_.Register("BUILD", &build);
+  properties_.Register("LOCALE", &locale);
+  properties_.Register("NETWORK", &network);
+  properties_.Register("WIFI_NETWORK", &wifi_network);
+  properties_.Register("CELLULAR_NETWORK", &cellular_network);
+  properties_.Register("SIM", &sim);
+  properties_.Register("PERIPHERAL", &peripheral);
 }
 
 SystemInfoContext::~SystemInfoContext() {
-  cpu_.StopListening(api_);
-  wifi_network_.StopListening(api_);
-  peripheral_.StopListening(api_);
-  network_.StopListening(api_);
-  storage_.StopListening(api_);
-  sim_.StopListening(api_);
-  locale_.StopListening(api_);
-  display_.StopListening(api_);
-  device_orientation_.StopListening(api_);
-  cellular_network_.StopListening(api_);
-  build_.StopListening(api_);
-  battery_.StopListening(api_);
+  cpu_.StopListening(&outbound_queue_);
+  wifi_network_.StopListening(&outbound_queue_);
+  peripheral_.StopListening(&outbound_queue_);
+  network_.StopListening(&outbound_queue_);
+  storage_.StopListening(&outbound_queue_);
+  sim_.StopListening(&outbound_queue_);
+  locale_.StopListening(&outbound_queue_);
+  display_.StopListening(&outbound_queue_);
+  device_orientation_.StopListening(&outbound_queue_);
+  cellular_network_.StopListening(&outbound_queue_);
+  build_.StopListening(&outbound_queue_);
+  battery_.StopListening(&outbound_queue_);
+  outbound_queue_.Clear();
   delete api_;
 }
 
@@ -67,8 +146,8 @@ const char* SystemInfoContext::GetJavaScript() {
   return kSource_system_info_api;
 }
 
-void SystemInfoContext::HandleGetPropertyValue(const picojson::value& input,
-                                               picojson::value& output) {
+void SystemInfoContext::HandleGetPropertyValue(const picojson::value& input) {
+  picojson::value output = picojson::value(picojson::object());
   std::string reply_id = input.get("_reply_id").to_str();
   system_info::SetPicoJsonObjectValue(output, "_reply_id",
       picojson::value(reply_id));
@@ -79,30 +158,9 @@ void SystemInfoContext::HandleGetPropertyValue(const picojson::value& input,
   system_info::SetPicoJsonObjectValue(error, "message", picojson::value(""));
   std::string prop = input.get("prop").to_str();
 
-  if (prop == "BATTERY") {
-    battery_.Get(error, data);
-  } else if (prop == "CPU") {
-    cpu_.Get(error, data);
-  } else if (prop == "STORAGE") {
-    storage_.Get(error, data);
-  } else if (prop == "DISPLAY") {
-    display_.Get(error, data);
-  } else if (prop == "DEVICE_ORIENTATION") {
-    device_orientation_.Get(error, data);
-  } else if (prop == "BUILD") {
-    build_.Get(error, data);
-  } else if (prop == "LOCALE") {
-    locale_.Get(error, data);
-  } else if (prop == "NETWORK") {
-    network_.Get(error, data);
-  } else if (prop == "WIFI_NETWORK") {
-    wifi_network_.Get(error, data);
-  } else if (prop == "CELLULAR_NETWORK") {
-    cellular_network_.Get(error, data);
-  } else if (prop == "SIM") {
-    sim_.Get(error, data);
-  } else if (prop == "PERIPHERAL") {
-    peripheral_.Get(error, data);
+  SysInfoProperty* property;
+  if (properties_.Lookup(prop, &property)) {
+    property->Get(error, data);
   } else {
     system_info::SetPicoJsonObjectValue(error, "message",
         picojson::value("Not supported property " + prop));
@@ -119,63 +177,15 @@ void SystemInfoContext::HandleGetPropertyValue(const picojson::value& input,
 }
 
 void SystemInfoContext::HandleStartListening(const picojson::value& input) {
-  std::string prop = input.get("prop").to_str();
-
-  if (prop == "BATTERY") {
-    battery_.StartListening(api_);
-  } else if (prop == "CPU") {
-    cpu_.StartListening(api_);
-  } else if (prop == "STORAGE") {
-    storage_.StartListening(api_);
-  } else if (prop == "DISPLAY") {
-    display_.StartListening(api_);
-  } else if (prop == "DEVICE_ORIENTATION") {
-    device_orientation_.StartListening(api_);
-  } else if (prop == "BUILD") {
-    build_.StartListening(api_);
-  } else if (prop == "LOCALE") {
-    locale_.StartListening(api_);
-  } else if (prop == "NETWORK") {
-    network_.StartListening(api_);
-  } else if (prop == "WIFI_NETWORK") {
-    wifi_network_.StartListening(api_);
-  } else if (prop == "CELLULAR_NETWORK") {
-    cellular_network_.StartListening(api_);
-  } else if (prop == "SIM") {
-    sim_.StartListening(api_);
-  } else if (prop == "PERIPHERAL") {
-    peripheral_.StartListening(api_);
-  }
+  SysInfoProperty* property;
+  if (properties_.Lookup(input.get("prop").to_str(), &property))
+    property->StartListening(&outbound_queue_);
 }
 
 void SystemInfoContext::HandleStopListening(const picojson::value& input) {
-  std::string prop = input.get("prop").to_str();
-
-  if (prop == "BATTERY") {
-    battery_.StopListening(api_);
-  } else if (prop == "CPU") {
-    cpu_.StopListening(api_);
-  } else if (prop == "STORAGE") {
-    storage_.StopListening(api_);
-  } else if (prop == "DISPLAY") {
-    display_.StopListening(api_);
-  } else if (prop == "DEVICE_ORIENTATION") {
-    device_orientation_.StopListening(api_);
-  } else if (prop == "BUILD") {
-    build_.StopListening(api_);
-  } else if (prop == "LOCALE") {
-    locale_.StopListening(api_);
-  } else if (prop == "NETWORK") {
-    network_.StopListening(api_);
-  } else if (prop == "WIFI_NETWORK") {
-    wifi_network_.StopListening(api_);
-  } else if (prop == "CELLULAR_NETWORK") {
-    cellular_network_.StopListening(api_);
-  } else if (prop == "SIM") {
-    sim_.StopListening(api_);
-  } else if (prop == "PERIPHERAL") {
-    peripheral_.StopListening(api_);
-  }
+  SysInfoProperty* property;
+  if (properties_.Lookup(input.get("prop").to_str(), &property))
+    property->StopListening(&outbound_queue_);
 }
 
 void SystemInfoContext::HandleMessage(const char* message) {
@@ -188,15 +198,9 @@ void SystemInfoContext::HandleMessage(const char* message) {
     return;
   }
 
-  std::string cmd = input.get("cmd").to_str();
-  if (cmd == "getPropertyValue") {
-    picojson::value output = picojson::value(picojson::object());
-    HandleGetPropertyValue(input, output);
-  } else if (cmd == "startListening") {
-    HandleStartListening(input);
-  } else if (cmd == "stopListening") {
-    HandleStopListening(input);
-  }
+  Handler handler;
+  if (handlers_.Lookup(input.get("cmd").to_str(), &handler))
+    (this->*handler)(input);
 }
 
 void SystemInfoContext::HandleSyncMessage(const char* message) {
@@ -218,7 +222,9 @@ void SystemInfoContext::HandleSyncMessage(const char* message) {
 }
 
 void SystemInfoContext::HandleGetCapabilities() {
-  picojson::value::object o;
+  std::string* reply = api_->reply_buffer();
+  common::JsonWriter writer(reply);
+  writer.BeginObject();
 
 #if defined(TIZEN_MOBILE)
   bool b;
@@ -226,255 +232,250 @@ void SystemInfoContext::HandleGetCapabilities() {
   char* s;
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_BLUETOOTH_SUPPORTED, &b);
-  o["bluetooth"] = picojson::value(b);
+  writer.Key("bluetooth").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_NFC_SUPPORTED, &b);
-  o["nfc"] = picojson::value(b);
+  writer.Key("nfc").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_NFC_RESERVED_PUSH_SUPPORTED, &b);
-  o["nfcReservedPush"] = picojson::value(b);
+  writer.Key("nfcReservedPush").Bool(b);
 
   system_info_get_value_int(SYSTEM_INFO_KEY_MULTI_POINT_TOUCH_COUNT, &i);
-  o["multiTouchCount"] = picojson::value(static_cast<double>(i));
+  writer.Key("multiTouchCount").Number(i);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_KEYBOARD_TYPE, &b);
-  o["inputKeyboard"] = picojson::value(b);
+  writer.Key("inputKeyboard").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_KEYBOARD_TYPE, &b);
-  o["inputKeyboardLayout"] = picojson::value(b);
+  writer.Key("inputKeyboardLayout").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_WIFI_SUPPORTED, &b);
-  o["wifi"] = picojson::value(b);
+  writer.Key("wifi").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_WIFI_DIRECT_SUPPORTED, &b);
-  o["wifiDirect"] = picojson::value(b);
+  writer.Key("wifiDirect").Bool(b);
 
   s = NULL;
   system_info_get_value_string(SYSTEM_INFO_KEY_OPENGLES_VERSION, &s);
   if (s && (strlen(s) != 0)) {
-    o["opengles"] = picojson::value(true);
+    writer.Key("opengles").Bool(true);
 
     if (strstr(s, "1.1"))
-      o["openglesVersion1_1"] = picojson::value(true);
+      writer.Key("openglesVersion1_1").Bool(true);
     else
-      o["openglesVersion1_1"] = picojson::value(false);
+      writer.Key("openglesVersion1_1").Bool(false);
 
     if (strstr(s, "2.0"))
-      o["openglesVersion2_0"] = picojson::value(true);
+      writer.Key("openglesVersion2_0").Bool(true);
     else
-      o["openglesVersion2_0"] = picojson::value(false);
+      writer.Key("openglesVersion2_0").Bool(false);
   } else {
-    o["opengles"] = picojson::value(false);
-    o["openglesVersion1_1"] = picojson::value(false);
-    o["openglesVersion2_0"] = picojson::value(false);
+    writer.Key("opengles").Bool(false);
+    writer.Key("openglesVersion1_1").Bool(false);
+    writer.Key("openglesVersion2_0").Bool(false);
   }
   free(s);
 
   s = NULL;
   system_info_get_value_string(SYSTEM_INFO_KEY_OPENGLES_TEXTURE_FORMAT, &s);
-  SetStringPropertyValue(o, "openglestextureFormat", s ? s : "");
+  SetStringPropertyValue(writer, "openglestextureFormat", s ? s : "");
   free(s);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_FMRADIO_SUPPORTED, &b);
-  o["fmRadio"] = picojson::value(b);
+  writer.Key("fmRadio").Bool(b);
 
   s = NULL;
   system_info_get_value_string(SYSTEM_INFO_KEY_TIZEN_VERSION, &s);
-  SetStringPropertyValue(o, "platformVersion", s ? s : "");
+  SetStringPropertyValue(writer, "platformVersion", s ? s : "");
   free(s);
 
   std::string version =
       system_info::GetPropertyFromFile(
           sSystemInfoFilePath,
           "http://tizen.org/feature/platform.web.api.version");
-  SetStringPropertyValue(o, "webApiVersion", version.c_str());
+  SetStringPropertyValue(writer, "webApiVersion", version.c_str());
 
   version = system_info::GetPropertyFromFile(
                 sSystemInfoFilePath,
                 "http://tizen.org/feature/platform.native.api.version");
-  SetStringPropertyValue(o, "nativeApiVersion", version.c_str());
+  SetStringPropertyValue(writer, "nativeApiVersion", version.c_str());
 
   s = NULL;
   system_info_get_value_string(SYSTEM_INFO_KEY_PLATFORM_NAME, &s);
-  SetStringPropertyValue(o, "platformName", s ? s : "");
+  SetStringPropertyValue(writer, "platformName", s ? s : "");
   free(s);
 
   system_info_get_value_int(SYSTEM_INFO_KEY_CAMERA_COUNT, &i);
-  o["camera"] = picojson::value(i > 0);
+  writer.Key("camera").Bool(i > 0);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_FRONT_CAMERA_SUPPORTED, &b);
-  o["cameraFront"] = picojson::value(b);
+  writer.Key("cameraFront").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_FRONT_CAMERA_FLASH_SUPPORTED, &b);
-  o["cameraFrontFlash"] = picojson::value(b);
+  writer.Key("cameraFrontFlash").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_BACK_CAMERA_SUPPORTED, &b);
-  o["cameraBack"] = picojson::value(b);
+  writer.Key("cameraBack").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_BACK_CAMERA_FLASH_SUPPORTED, &b);
-  o["cameraBackFlash"] = picojson::value(b);
+  writer.Key("cameraBackFlash").Bool(b);
 
   bool b_gps;
   system_info_get_value_bool(SYSTEM_INFO_KEY_GPS_SUPPORTED, &b_gps);
-  o["locationGps"] = picojson::value(b_gps);
+  writer.Key("locationGps").Bool(b_gps);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_WPS_SUPPORTED, &b);
-  o["locationWps"] = picojson::value(b);
+  writer.Key("locationWps").Bool(b);
 
-  o["location"] = picojson::value(b && b_gps);
+  writer.Key("location").Bool(b && b_gps);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_MICROPHONE_SUPPORTED, &b);
-  o["microphone"] = picojson::value(b);
+  writer.Key("microphone").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_USB_HOST_SUPPORTED, &b);
-  o["usbHost"] = picojson::value(b);
+  writer.Key("usbHost").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_USB_ACCESSORY_SUPPORTED, &b);
-  o["usbAccessory"] = picojson::value(b);
+  writer.Key("usbAccessory").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_RCA_SUPPORTED, &b);
-  o["screenOutputRca"] = picojson::value(b);
+  writer.Key("screenOutputRca").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_HDMI_SUPPORTED, &b);
-  o["screenOutputHdmi"] = picojson::value(b);
+  writer.Key("screenOutputHdmi").Bool(b);
 
   s = NULL;
   system_info_get_value_string(SYSTEM_INFO_KEY_CORE_CPU_ARCH, &s);
-  SetStringPropertyValue(o, "platformCoreCpuArch", s ? s : "");
+  SetStringPropertyValue(writer, "platformCoreCpuArch", s ? s : "");
   free(s);
 
   s = NULL;
   system_info_get_value_string(SYSTEM_INFO_KEY_CORE_FPU_ARCH, &s);
-  SetStringPropertyValue(o, "platformCoreFpuArch", s ? s : "");
+  SetStringPropertyValue(writer, "platformCoreFpuArch", s ? s : "");
   free(s);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_SIP_VOIP_SUPPORTED, &b);
-  o["sipVoip"] = picojson::value(b);
+  writer.Key("sipVoip").Bool(b);
 
   s = NULL;
   system_info_get_value_string(SYSTEM_INFO_KEY_DEVICE_UUID, &s);
-  SetStringPropertyValue(o, "duid", s ? s : "");
+  SetStringPropertyValue(writer, "duid", s ? s : "");
   free(s);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_SPEECH_RECOGNITION_SUPPORTED, &b);
-  o["speechRecognition"] = picojson::value(b);
+  writer.Key("speechRecognition").Bool(b);
 
   b = system_info::PathExists("/usr/lib/libtts.so");
-  o["speechSynthesis"] = picojson::value(b);
+  writer.Key("speechSynthesis").Bool(b);
 
   sensor_is_supported(SENSOR_ACCELEROMETER, &b);
-  o["accelerometer"] = picojson::value(b);
+  writer.Key("accelerometer").Bool(b);
 
   sensor_awake_is_supported(SENSOR_ACCELEROMETER, &b);
-  o["accelerometerWakeup"] = picojson::value(b);
+  writer.Key("accelerometerWakeup").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_BAROMETER_SENSOR_SUPPORTED, &b);
-  o["barometer"] = picojson::value(b);
+  writer.Key("barometer").Bool(b);
 
   // FIXME(halton): find which key reflect this prop
-  o["barometerWakeup"] = picojson::value(false);
+  writer.Key("barometerWakeup").Bool(false);
 
   sensor_is_supported(SENSOR_GYROSCOPE, &b);
-  o["gyroscope"] = picojson::value(b);
+  writer.Key("gyroscope").Bool(b);
 
   sensor_awake_is_supported(SENSOR_GYROSCOPE, &b);
-  o["gyroscopeWakeup"] = picojson::value(b);
+  writer.Key("gyroscopeWakeup").Bool(b);
 
   sensor_is_supported(SENSOR_MAGNETIC, &b);
-  o["magnetometer"] = picojson::value(b);
+  writer.Key("magnetometer").Bool(b);
 
   sensor_awake_is_supported(SENSOR_MAGNETIC, &b);
-  o["magnetometerWakeup"] = picojson::value(b);
+  writer.Key("magnetometerWakeup").Bool(b);
 
   sensor_is_supported(SENSOR_LIGHT, &b);
-  o["photometer"] = picojson::value(b);
+  writer.Key("photometer").Bool(b);
 
   sensor_awake_is_supported(SENSOR_LIGHT, &b);
-  o["photometerWakeup"] = picojson::value(b);
+  writer.Key("photometerWakeup").Bool(b);
 
   sensor_is_supported(SENSOR_PROXIMITY, &b);
-  o["proximity"] = picojson::value(b);
+  writer.Key("proximity").Bool(b);
 
   sensor_awake_is_supported(SENSOR_PROXIMITY, &b);
-  o["proximityWakeup"] = picojson::value(b);
+  writer.Key("proximityWakeup").Bool(b);
 
   sensor_is_supported(SENSOR_MOTION_TILT, &b);
-  o["tiltmeter"] = picojson::value(b);
+  writer.Key("tiltmeter").Bool(b);
 
   sensor_awake_is_supported(SENSOR_MOTION_TILT, &b);
-  o["tiltmeterWakeup"] = picojson::value(b);
+  writer.Key("tiltmeterWakeup").Bool(b);
 
   b = system_info::PathExists("/usr/lib/libsqlite3.so.0");
-  o["dataEncryption"] = picojson::value(b);
+  writer.Key("dataEncryption").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_GRAPHICS_HWACCEL_SUPPORTED, &b);
-  o["graphicsAcceleration"] = picojson::value(b);
+  writer.Key("graphicsAcceleration").Bool(b);
 
   b = system_info::PathExists("/usr/bin/pushd");
-  o["push"] = picojson::value(b);
+  writer.Key("push").Bool(b);
 
   b = system_info::PathExists("/usr/bin/telephony-daemon");
-  o["telephony"] = picojson::value(b);
+  writer.Key("telephony").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_MMS_SUPPORTED, &b);
-  o["telephonyMms"] = picojson::value(b);
+  writer.Key("telephonyMms").Bool(b);
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_SMS_SUPPORTED, &b);
-  o["telephonySms"] = picojson::value(b);
+  writer.Key("telephonySms").Bool(b);
 
   std::string screensize_normal =
       system_info::GetPropertyFromFile(
           sSystemInfoFilePath,
           "http://tizen.org/feature/screen.coordinate_system.size.normal");
-  o["screenSizeNormal"] =
-      picojson::value(system_info::ParseBoolean(screensize_normal));
+  writer.Key("screenSizeNormal").Bool(
+      system_info::ParseBoolean(screensize_normal));
 
   int height;
   int width;
   system_info_get_value_int(SYSTEM_INFO_KEY_SCREEN_HEIGHT, &height);
   system_info_get_value_int(SYSTEM_INFO_KEY_SCREEN_WIDTH, &width);
-  o["screenSize480_800"] = picojson::value(false);
-  o["screenSize720_1280"] = picojson::value(false);
-  if ((width == 480) && (height == 800)) {
-    o["screenSize480_800"] = picojson::value(true);
-  } else if ((width == 720) && (height == 1280)) {
-    o["screenSize720_1280"] = picojson::value(true);
-  }
+  writer.Key("screenSize480_800").Bool((width == 480) && (height == 800));
+  writer.Key("screenSize720_1280").Bool((width == 720) && (height == 1280));
 
   system_info_get_value_bool(SYSTEM_INFO_KEY_FEATURE_AUTO_ROTATION_SUPPORTED,
                              &b);
-  o["autoRotation"] = picojson::value(b);
+  writer.Key("autoRotation").Bool(b);
 
   pkgmgrinfo_pkginfo_h handle;
   if (pkgmgrinfo_pkginfo_get_pkginfo("gi2qxenosh", &handle) == PMINFO_R_OK)
-    o["shellAppWidget"] = picojson::value(true);
+    writer.Key("shellAppWidget").Bool(true);
   else
-    o["shellAppWidget"] = picojson::value(false);
+    writer.Key("shellAppWidget").Bool(false);
 
   b = system_info::PathExists("/usr/lib/osp/libarengine.so");
-  o["visionImageRecognition"] = picojson::value(b);
-  o["visionQrcodeGeneration"] = picojson::value(b);
-  o["visionQrcodeRecognition"] = picojson::value(b);
-  o["visionFaceRecognition"] = picojson::value(b);
+  writer.Key("visionImageRecognition").Bool(b);
+  writer.Key("visionQrcodeGeneration").Bool(b);
+  writer.Key("visionQrcodeRecognition").Bool(b);
+  writer.Key("visionFaceRecognition").Bool(b);
 
   b = system_info::PathExists("/usr/bin/smartcard-daemon");
-  o["secureElement"] = picojson::value(b);
+  writer.Key("secureElement").Bool(b);
 
   std::string osp_compatible =
       system_info::GetPropertyFromFile(
           sSystemInfoFilePath,
           "http://tizen.org/feature/platform.native.osp_compatible");
-  o["nativeOspCompatible"] =
-      picojson::value(system_info::ParseBoolean(osp_compatible));
+  writer.Key("nativeOspCompatible").Bool(
+      system_info::ParseBoolean(osp_compatible));
 
   // FIXME(halton): Not supported until Tizen 2.2
-  o["profile"] = picojson::value("MOBILE_WEB");
+  writer.Key("profile").String("MOBILE_WEB");
 
-  o["error"] = picojson::value("");
+  writer.Key("error").String("");
 #elif defined(GENERIC_DESKTOP)
-  o["error"] = picojson::value("getCapabilities is not supported on desktop.");
+  writer.Key("error").String("getCapabilities is not supported on desktop.");
 #endif
 
-  picojson::value v(o);
-  api_->SetSyncReply(v.serialize().c_str());
+  writer.EndObject();
+  api_->SetSyncReply(reply->c_str());
 }
@@ -5,7 +5,10 @@
 #ifndef SYSTEM_INFO_SYSTEM_INFO_CONTEXT_H_
 #define SYSTEM_INFO_SYSTEM_INFO_CONTEXT_H_
 
+#include "common/command_table.h"
 #include "common/extension_adapter.h"
+#include "common/json_writer.h"
+#include "common/outbound_queue.h"
 #include "common/picojson.h"
 #include "system_info/system_info_battery.h"
 #include "system_info/system_info_build.h"
@@ -31,24 +34,42 @@ class SystemInfoContext {
 
   // ExtensionAdapter implementation.
   static const char name[];
+  static const bool batch_messages = true;
   static const char* GetJavaScript();
   void HandleMessage(const char* message);
   void HandleSyncMessage(const char* message);
 
  private:
-  void HandleGetPropertyValue(const picojson::value& input,
-                              picojson::value& output);
+  typedef void (SystemInfoContext::*Handler)(const picojson::value& input);
+
+  // Common view of the SysInfo* singletons, used to dispatch on "prop".
+  class SysInfoProperty {
+   public:
+    virtual ~SysInfoProperty() {}
+    virtual void Get(picojson::value& error, picojson::value& data) = 0;
+    virtual void StartListening(common::OutboundQueue* queue) = 0;
+    virtual void StopListening(common::OutboundQueue* queue) = 0;
+  };
+  template <typename T>
+  class SysInfoPropertyImpl;
+
+  static void RegisterHandlers();
+  static common::CommandTable<Handler> handlers_;
+  static common::CommandTable<SysInfoProperty*> properties_;
+
+  void HandleGetPropertyValue(const picojson::value& input);
   void HandleStartListening(const picojson::value& input);
   void HandleStopListening(const picojson::value& input);
   void HandleGetCapabilities();
-  inline void SetStringPropertyValue(picojson::object& o,
+  inline void SetStringPropertyValue(common::JsonWriter& writer,
                                      const char* prop,
                                      const char* val) {
     if (val)
-      o[prop] = picojson::value(val);
+      writer.Key(prop).String(val);
   }
 
   ContextAPI* api_;
+  common::OutboundQueue outbound_queue_;
   SysInfoBattery& battery_;
   SysInfoBuild& build_;
   SysInfoCellularNetwork& cellular_network_;
@@ -36,20 +36,19 @@ gboolean SysInfoCpu::OnUpdateTimeout(gpointer user_data) {
     system_info::SetPicoJsonObjectValue(output, "data", data);
 
     std::string result = output.serialize();
-    const char* result_as_cstr = result.c_str();
     AutoLock lock(&(instance->events_list_mutex_));
     for (SystemInfoEventsList::iterator it = cpu_events_.begin();
          it != cpu_events_.end(); it++) {
-      (*it)->PostMessage(result_as_cstr);
+      (*it)->Post("CPU", result);
     }
   }
 
   return TRUE;
 }
 
-void SysInfoCpu::StartListening(ContextAPI* api) {
+void SysInfoCpu::StartListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  cpu_events_.push_back(api);
+  cpu_events_.push_back(queue);
   if (timeout_cb_id_ == 0) {
     timeout_cb_id_ = g_timeout_add(system_info::default_timeout_interval,
                                    SysInfoCpu::OnUpdateTimeout,
@@ -57,9 +56,9 @@ void SysInfoCpu::StartListening(ContextAPI* api) {
   }
 }
 
-void SysInfoCpu::StopListening(ContextAPI* api) {
+void SysInfoCpu::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  cpu_events_.remove(api);
+  cpu_events_.remove(queue);
   if (cpu_events_.empty() && timeout_cb_id_ > 0) {
     g_source_remove(timeout_cb_id_);
     timeout_cb_id_ = 0;
@@ -27,8 +27,8 @@ class SysInfoCpu {
   void Get(picojson::value& error, picojson::value& data);
 
   // Listerner support
-  void StartListening(ContextAPI* api);
-  void StopListening(ContextAPI* api);
+  void StartListening(common::OutboundQueue* queue);
+  void StopListening(common::OutboundQueue* queue);
 
  private:
   explicit SysInfoCpu()
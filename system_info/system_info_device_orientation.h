@@ -37,8 +37,8 @@ class SysInfoDeviceOrientation {
     pthread_mutex_destroy(&events_list_mutex_);
   }
   void Get(picojson::value& error, picojson::value& data);
-  void StartListening(ContextAPI* api);
-  void StopListening(ContextAPI* api);
+  void StartListening(common::OutboundQueue* queue);
+  void StopListening(common::OutboundQueue* queue);
 
  private:
   explicit SysInfoDeviceOrientation()
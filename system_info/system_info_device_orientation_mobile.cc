@@ -56,11 +56,10 @@ void SysInfoDeviceOrientation::SendUpdate() {
   system_info::SetPicoJsonObjectValue(output, "data", data);
 
   std::string result = output.serialize();
-  const char* result_as_cstr = result.c_str();
   AutoLock lock(&events_list_mutex_);
   for (SystemInfoEventsList::iterator it = device_orientation_events_.begin();
        it != device_orientation_events_.end(); it++)
-    (*it)->PostMessage(result_as_cstr);
+    (*it)->Post("DEVICE_ORIENTATION", result);
 }
 
 std::string SysInfoDeviceOrientation::ToOrientationStatusString(
@@ -139,9 +138,9 @@ void SysInfoDeviceOrientation::OnAutoRotationChanged(keynode_t* node,
   orientation->SendUpdate();
 }
 
-void SysInfoDeviceOrientation::StartListening(ContextAPI* api) {
+void SysInfoDeviceOrientation::StartListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  device_orientation_events_.push_back(api);
+  device_orientation_events_.push_back(queue);
 
   if (device_orientation_events_.size() > 1)
     return;
@@ -167,9 +166,9 @@ void SysInfoDeviceOrientation::StartListening(ContextAPI* api) {
   }
 }
 
-void SysInfoDeviceOrientation::StopListening(ContextAPI* api) {
+void SysInfoDeviceOrientation::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  device_orientation_events_.remove(api);
+  device_orientation_events_.remove(queue);
 
   if (!device_orientation_events_.empty())
     return;
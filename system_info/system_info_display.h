@@ -26,10 +26,10 @@ class SysInfoDisplay {
   // Get support
   void Get(picojson::value& error, picojson::value& data);
   // Listerner support
-  inline void StartListening(ContextAPI* api) {
+  inline void StartListening(common::OutboundQueue* queue) {
     // FIXME(halton): Use Xlib event or D-Bus interface to monitor.
     AutoLock lock(&events_list_mutex_);
-    display_events_.push_back(api);
+    display_events_.push_back(queue);
 
     if (timeout_cb_id_ == 0) {
       timeout_cb_id_ = g_timeout_add(system_info::default_timeout_interval,
@@ -37,9 +37,9 @@ class SysInfoDisplay {
                                      static_cast<gpointer>(this));
     }
   }
-  inline void StopListening(ContextAPI* api) {
+  inline void StopListening(common::OutboundQueue* queue) {
     AutoLock lock(&events_list_mutex_);
-    display_events_.remove(api);
+    display_events_.remove(queue);
     if (display_events_.empty() && timeout_cb_id_ > 0) {
       g_source_remove(timeout_cb_id_);
       timeout_cb_id_ = 0;
@@ -121,11 +121,10 @@ gboolean SysInfoDisplay::OnUpdateTimeout(gpointer user_data) {
     system_info::SetPicoJsonObjectValue(output, "data", data);
 
     std::string result = output.serialize();
-    const char* result_as_cstr = result.c_str();
     AutoLock lock(&(instance->events_list_mutex_));
     for (SystemInfoEventsList::iterator it = display_events_.begin();
          it != display_events_.end(); it++) {
-      (*it)->PostMessage(result_as_cstr);
+      (*it)->Post("DISPLAY", result);
     }
   }
 
@@ -18,9 +18,9 @@ SysInfoLocale::SysInfoLocale()
   pthread_mutex_init(&events_list_mutex_, NULL);
 }
 
-void SysInfoLocale::StartListening(ContextAPI* api) {
+void SysInfoLocale::StartListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  local_events_.push_back(api);
+  local_events_.push_back(queue);
   if (timeout_cb_id_ == 0) {
     timeout_cb_id_ = g_timeout_add(system_info::default_timeout_interval,
                                    SysInfoLocale::OnUpdateTimeout,
@@ -28,9 +28,9 @@ void SysInfoLocale::StartListening(ContextAPI* api) {
   }
 }
 
-void SysInfoLocale::StopListening(ContextAPI* api) {
+void SysInfoLocale::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  local_events_.remove(api);
+  local_events_.remove(queue);
   if (local_events_.empty() && timeout_cb_id_ > 0) {
     g_source_remove(timeout_cb_id_);
     timeout_cb_id_ = 0;
@@ -127,11 +127,10 @@ gboolean SysInfoLocale::OnUpdateTimeout(gpointer user_data) {
     system_info::SetPicoJsonObjectValue(output, "data", data);
 
     std::string result = output.serialize();
-    const char* result_as_cstr = result.c_str();
     AutoLock lock(&(instance->events_list_mutex_));
     for (SystemInfoEventsList::iterator it = local_events_.begin();
          it != local_events_.end(); it++) {
-      (*it)->PostMessage(result_as_cstr);
+      (*it)->Post("LOCALE", result);
     }
   }
 
@@ -12,9 +12,9 @@ SysInfoLocale::SysInfoLocale() {
   pthread_mutex_init(&events_list_mutex_, NULL);
 }
 
-void SysInfoLocale::StartListening(ContextAPI* api) {
+void SysInfoLocale::StartListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  local_events_.push_back(api);
+  local_events_.push_back(queue);
 
   if (local_events_.size() > 1)
     return;
@@ -25,9 +25,9 @@ void SysInfoLocale::StartListening(ContextAPI* api) {
       static_cast<vconf_callback_fn>(OnLanguageChanged), this);
 }
 
-void SysInfoLocale::StopListening(ContextAPI* api) {
+void SysInfoLocale::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  local_events_.remove(api);
+  local_events_.remove(queue);
 
   if (!local_events_.empty())
     return;
@@ -103,11 +103,10 @@ void SysInfoLocale::Update() {
   system_info::SetPicoJsonObjectValue(output, "data", data);
 
   std::string result = output.serialize();
-  const char* result_as_cstr = result.c_str();
   AutoLock lock(&events_list_mutex_);
   for (SystemInfoEventsList::iterator it = local_events_.begin();
        it != local_events_.end(); it++) {
-    (*it)->PostMessage(result_as_cstr);
+    (*it)->Post("LOCALE", result);
   }
 }
 
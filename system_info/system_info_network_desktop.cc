@@ -43,10 +43,10 @@ SysInfoNetwork::~SysInfoNetwork() {
   pthread_mutex_destroy(&events_list_mutex_);
 }
 
-void SysInfoNetwork::StartListening(ContextAPI* api) {
+void SysInfoNetwork::StartListening(common::OutboundQueue* queue) {
 }
 
-void SysInfoNetwork::StopListening(ContextAPI* api) {
+void SysInfoNetwork::StopListening(common::OutboundQueue* queue) {
 }
 
 void SysInfoNetwork::OnNetworkManagerCreated(GObject*, GAsyncResult* res) {
@@ -229,11 +229,10 @@ void SysInfoNetwork::SendUpdate(guint new_device_type) {
   system_info::SetPicoJsonObjectValue(output, "data", data);
 
   std::string result = output.serialize();
-  const char* result_as_cstr = result.c_str();
   AutoLock lock(&events_list_mutex_);
   for (SystemInfoEventsList::iterator it = network_events_.begin();
        it != network_events_.end(); it++) {
-    (*it)->PostMessage(result_as_cstr);
+    (*it)->Post("NETWORK", result);
   }
 }
 
@@ -28,18 +28,18 @@ SysInfoNetwork::~SysInfoNetwork() {
   pthread_mutex_destroy(&events_list_mutex_);
 }
 
-void SysInfoNetwork::StartListening(ContextAPI* api) {
+void SysInfoNetwork::StartListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  network_events_.push_back(api);
+  network_events_.push_back(queue);
   if (connection_handle_ && network_events_.size() == 1) {
     connection_set_type_changed_cb(connection_handle_,
                                    OnTypeChanged, this);
   }
 }
 
-void SysInfoNetwork::StopListening(ContextAPI* api) {
+void SysInfoNetwork::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  network_events_.remove(api);
+  network_events_.remove(queue);
   if (network_events_.empty() && connection_handle_) {
     connection_unset_type_changed_cb(connection_handle_);
   }
@@ -128,10 +128,9 @@ void SysInfoNetwork::OnTypeChanged(connection_type_e type, void* user_data) {
   system_info::SetPicoJsonObjectValue(output, "data", data);
 
   std::string result = output.serialize();
-  const char* result_as_cstr = result.c_str();
   AutoLock lock(&(network->events_list_mutex_));
   for (SystemInfoEventsList::iterator it = network_events_.begin();
        it != network_events_.end(); it++) {
-    (*it)->PostMessage(result_as_cstr);
+    (*it)->Post("NETWORK", result);
   }
 }
@@ -45,11 +45,10 @@ void SysInfoPeripheral::UpdateIsVideoOutputOn() {
   system_info::SetPicoJsonObjectValue(output, "data", data);
 
   std::string result = output.serialize();
-  const char* result_as_cstr = result.c_str();
   AutoLock lock(&events_list_mutex_);
   for (SystemInfoEventsList::iterator it = peripheral_events_.begin();
        it != peripheral_events_.end(); it++) {
-    (*it)->PostMessage(result_as_cstr);
+    (*it)->Post("PERIPHERAL", result);
   }
 }
 
@@ -79,9 +78,9 @@ void SysInfoPeripheral::OnHDMIChanged(keynode_t* node, void* user_data) {
   peripheral->SetHDMI(hdmi);
 }
 
-void SysInfoPeripheral::StartListening(ContextAPI* api) {
+void SysInfoPeripheral::StartListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  peripheral_events_.push_back(api);
+  peripheral_events_.push_back(queue);
 
   if (peripheral_events_.size() > 1)
     return;
@@ -92,9 +91,9 @@ void SysInfoPeripheral::StartListening(ContextAPI* api) {
       (vconf_callback_fn)OnHDMIChanged, this);
 }
 
-void SysInfoPeripheral::StopListening(ContextAPI* api) {
+void SysInfoPeripheral::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  peripheral_events_.remove(api);
+  peripheral_events_.remove(queue);
 
   if (!peripheral_events_.empty())
     return;
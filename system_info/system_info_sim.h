@@ -31,8 +31,8 @@ class SysInfoSim {
     pthread_mutex_destroy(&events_list_mutex_);
   }
   void Get(picojson::value& error, picojson::value& data);
-  void StartListening(ContextAPI* api);
-  void StopListening(ContextAPI* api);
+  void StartListening(common::OutboundQueue* queue);
+  void StopListening(common::OutboundQueue* queue);
 
   enum SystemInfoSimState {
     SYSTEM_INFO_SIM_ABSENT = 0,
@@ -10,5 +10,5 @@ void SysInfoSim::Get(picojson::value& error,
       picojson::value("SIM is not supported on desktop."));
 }
 
-void SysInfoSim::StartListening(ContextAPI* api) { }
-void SysInfoSim::StopListening(ContextAPI* api) { }
+void SysInfoSim::StartListening(common::OutboundQueue* queue) { }
+void SysInfoSim::StopListening(common::OutboundQueue* queue) { }
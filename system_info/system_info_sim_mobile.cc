@@ -141,16 +141,16 @@ std::string SysInfoSim::ToSimStateString(SystemInfoSimState state) {
   return ret;
 }
 
-void SysInfoSim::StartListening(ContextAPI* api) {
+void SysInfoSim::StartListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  sim_events_.push_back(api);
+  sim_events_.push_back(queue);
   if (sim_events_.size() == 1)
     sim_set_state_changed_cb(OnSimStateChanged, this);
 }
 
-void SysInfoSim::StopListening(ContextAPI* api) {
+void SysInfoSim::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  sim_events_.remove(api);
+  sim_events_.remove(queue);
   if (sim_events_.empty())
     sim_unset_state_changed_cb();
 }
@@ -200,9 +200,8 @@ void SysInfoSim::OnSimStateChanged(sim_state_e state, void *user_data) {
       picojson::value("SIM"));
   system_info::SetPicoJsonObjectValue(output, "data", data);
   std::string result = output.serialize();
-  const char* result_as_cstr = result.c_str();
   AutoLock lock(&(sim->events_list_mutex_));
   for (SystemInfoEventsList::iterator it = sim_events_.begin();
        it != sim_events_.end(); it++)
-    (*it)->PostMessage(result_as_cstr);
+    (*it)->Post("SIM", result);
 }
@@ -52,21 +52,20 @@ gboolean SysInfoStorage::OnUpdateTimeout(gpointer user_data) {
     system_info::SetPicoJsonObjectValue(output, "data", data);
 
     std::string result = output.serialize();
-    const char* result_as_cstr = result.c_str();
     AutoLock lock(&(instance->events_list_mutex_));
     for (SystemInfoEventsList::iterator it = storage_events_.begin();
          it != storage_events_.end(); it++) {
-      (*it)->PostMessage(result_as_cstr);
+      (*it)->Post("STORAGE", result);
     }
   }
 
   return TRUE;
 }
 
-void SysInfoStorage::StartListening(ContextAPI* api) {
+void SysInfoStorage::StartListening(common::OutboundQueue* queue) {
   // FIXME(halton): Use udev D-Bus interface to monitor.
   AutoLock lock(&events_list_mutex_);
-  storage_events_.push_back(api);
+  storage_events_.push_back(queue);
   if (timeout_cb_id_ == 0) {
     timeout_cb_id_ = g_timeout_add(system_info::default_timeout_interval,
                                    SysInfoStorage::OnUpdateTimeout,
@@ -74,9 +73,9 @@ void SysInfoStorage::StartListening(ContextAPI* api) {
   }
 }
 
-void SysInfoStorage::StopListening(ContextAPI* api) {
+void SysInfoStorage::StopListening(common::OutboundQueue* queue) {
   AutoLock lock(&events_list_mutex_);
-  storage_events_.remove(api);
+  storage_events_.remove(queue);
   if (storage_events_.empty() && timeout_cb_id_ > 0) {
     g_source_remove(timeout_cb_id_);
     timeout_cb_id_ = 0;
@@ -12,9 +12,13 @@
 #include <string>
 
 #include "common/extension_adapter.h"
+#include "common/outbound_queue.h"
 #include "common/picojson.h"
 
-typedef std::list<ContextAPI*> SystemInfoEventsList;
+// Property change events are posted through the OutboundQueue of each
+// listening instance, so a slow consumer only gets the latest value of each
+// property.
+typedef std::list<common::OutboundQueue*> SystemInfoEventsList;
 
 static SystemInfoEventsList battery_events_;
 static SystemInfoEventsList build_events_;
@@ -29,10 +29,9 @@ void SysInfoWifiNetwork::SendUpdate() {
   system_info::SetPicoJsonObjectValue(output, "data", data);
 
   std::string result = output.serialize();
-  const char* result_as_cstr = result.c_str();
   AutoLock lock(&events_list_mutex_);
   for (SystemInfoEventsList::iterator it = wifi_network_events_.begin();
     it != wifi_network_events_.end(); it++) {
-    (*it)->PostMessage(result_as_cstr);
+    (*it)->Post("WIFI_NETWORK", result);
   }
 }
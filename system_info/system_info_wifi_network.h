@@ -35,8 +35,8 @@ class SysInfoWifiNetwork {
   }
   ~SysInfoWifiNetwork();
   void Get(picojson::value& error, picojson::value& data);
-  void StartListening(ContextAPI* api);
-  void StopListening(ContextAPI* api);
+  void StartListening(common::OutboundQueue* queue);
+  void StopListening(common::OutboundQueue* queue);
 
  private:
   explicit SysInfoWifiNetwork();
@@ -47,8 +47,8 @@ SysInfoWifiNetwork::~SysInfoWifiNetwork() {
   pthread_mutex_destroy(&events_list_mutex_);
 }
 
-void SysInfoWifiNetwork::StartListening(ContextAPI* api) { }
-void SysInfoWifiNetwork::StopListening(ContextAPI* api) { }
+void SysInfoWifiNetwork::StartListening(common::OutboundQueue* queue) { }
+void SysInfoWifiNetwork::StopListening(common::OutboundQueue* queue) { }
 
 void SysInfoWifiNetwork::SetData(picojson::value& data) {
   system_info::SetPicoJsonObjectValue(data, "status",
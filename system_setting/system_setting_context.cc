@@ -54,5 +54,5 @@ void SystemSettingContext::OnPropertyHandled(const char* reply_id,
   o["_error"] = picojson::value(static_cast<double>(ret));
 
   picojson::value v(o);
-  api_->PostMessage(v.serialize().c_str());
+  api_->PostMessage(v);
 }
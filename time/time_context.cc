@@ -43,11 +43,14 @@ void TimeContext::HandleSyncMessage(const char* message) {
   }
 
   std::string cmd = v.get("cmd").to_str();
+  if (cmd == "GetAvailableTimeZones") {
+    HandleGetAvailableTimeZones(v);
+    return;
+  }
+
   picojson::value::object o;
   if (cmd == "GetLocalTimeZone")
     o = HandleGetLocalTimeZone(v);
-  else if (cmd == "GetAvailableTimeZones")
-    o = HandleGetAvailableTimeZones(v);
   else if (cmd == "GetTimeZoneRawOffset")
     o = HandleGetTimeZoneRawOffset(v);
   else if (cmd == "GetTimeZoneAbbreviation")
@@ -84,32 +87,34 @@ const picojson::value::object TimeContext::HandleGetLocalTimeZone(
   return o;
 }
 
-const picojson::value::object TimeContext::HandleGetAvailableTimeZones(
-  const picojson::value& msg) {
-  picojson::value::object o;
+void TimeContext::HandleGetAvailableTimeZones(const picojson::value& msg) {
+  std::string* reply = api_->reply_buffer();
+  common::JsonWriter writer(reply);
+  writer.BeginObject();
 
   UErrorCode ec = U_ZERO_ERROR;
   std::unique_ptr<StringEnumeration> timezones(TimeZone::createEnumeration());
   int32_t count = timezones->count(ec);
 
-  if (U_FAILURE(ec))
-    return o;
-
-  picojson::value::array a;
-  const char *timezone = NULL;
-  int i = 0;
-  do {
-    int32_t resultLen = 0;
-    timezone = timezones->next(&resultLen, ec);
-    if (U_SUCCESS(ec)) {
-      a.push_back(picojson::value(timezone));
-      i++;
-    }
-  }while(timezone && i < count);
-
-  o["value"] = picojson::value(a);
+  if (U_FAILURE(ec)) {
+    writer.Key("error").Bool(true);
+  } else {
+    writer.Key("value").BeginArray();
+    const char *timezone = NULL;
+    int i = 0;
+    do {
+      int32_t resultLen = 0;
+      timezone = timezones->next(&resultLen, ec);
+      if (U_SUCCESS(ec) && timezone) {
+        writer.String(timezone, resultLen);
+        i++;
+      }
+    }while(timezone && i < count);
+    writer.EndArray();
+  }
 
-  return o;
+  writer.EndObject();
+  api_->SetSyncReply(reply->c_str());
 }
 
 const picojson::value::object TimeContext::HandleGetTimeZoneRawOffset(
@@ -306,5 +311,5 @@ UnicodeString TimeContext::getDateTimeFormat(DateTimeFormatType type,
 }
 
 void TimeContext::SetSyncReply(picojson::value v) {
-  api_->SetSyncReply(v.serialize().c_str());
+  api_->SetSyncReply(v);
 }
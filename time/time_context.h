@@ -6,6 +6,7 @@
 #define TIME_TIME_CONTEXT_H_
 
 #include "common/extension_adapter.h"
+#include "common/json_writer.h"
 #include "common/picojson.h"
 
 #include "unicode/unistr.h"
@@ -34,8 +35,7 @@ class TimeContext {
 
   const picojson::value::object
      HandleGetLocalTimeZone(const picojson::value& msg);
-  const picojson::value::object
-     HandleGetAvailableTimeZones(const picojson::value& msg);
+  void HandleGetAvailableTimeZones(const picojson::value& msg);
   const picojson::value::object
      HandleGetTimeZoneRawOffset(const picojson::value& msg);
   const picojson::value::object
@@ -8,6 +8,7 @@
       'target_name': 'build_all_tizen_extensions',
       'type': 'none',
       'dependencies': [
+        'benchmarks/benchmarks.gyp:*',
         'bluetooth/bluetooth.gyp:*',
         'bookmark/bookmark.gyp:*',
         'filesystem/filesystem.gyp:*',